@@ -0,0 +1,657 @@
+#include "async_writer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+#ifdef _WIN32
+    #include <filesystem>
+    #include <fstream>
+    #include <malloc.h>
+#else
+    #include <cerrno>
+    #include <cstdlib>
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+#if defined(__linux__)
+    #include <linux/io_uring.h>
+    #include <sys/mman.h>
+    #include <sys/syscall.h>
+    #if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+        #define PERIDYNAMIC_HAVE_IO_URING 1
+    #endif
+#endif
+
+namespace {
+
+// O_DIRECT needs buffer addresses, lengths and file offsets aligned to the
+// logical block size; 4 KiB covers every common device.
+const size_t kIoAlignment = 4096;
+
+char* alignedAlloc(size_t bytes) {
+#ifdef _WIN32
+    return static_cast<char*>(_aligned_malloc(bytes, kIoAlignment));
+#else
+    void* p = nullptr;
+    if (posix_memalign(&p, kIoAlignment, bytes) != 0) {
+        return nullptr;
+    }
+    return static_cast<char*>(p);
+#endif
+}
+
+void alignedFree(char* p) {
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    std::free(p);
+#endif
+}
+
+}  // namespace
+
+// -----------------------------
+// Backend interface
+// -----------------------------
+// A backend owns the file. Buffers are identified by index; a submitted buffer
+// must stay untouched until waitCompleted() hands its index back.
+class AsyncIoBackend {
+public:
+    virtual ~AsyncIoBackend() = default;
+    virtual const char* name() const = 0;
+    virtual bool direct() const = 0;
+    virtual bool submit(int index, const char* data, size_t length, unsigned long long offset) = 0;
+    // Blocks until one write finished; returns its buffer index, -1 on I/O error
+    virtual int waitCompleted() = 0;
+    virtual int inFlight() const = 0;
+    // Set the final file size and close
+    virtual bool finish(unsigned long long finalSize) = 0;
+};
+
+namespace {
+
+#ifndef _WIN32
+// Open for writing, with O_DIRECT when requested and supported
+int openOutputFile(const std::string& path, bool wantDirect, bool& direct) {
+    int flags = O_WRONLY | O_CREAT | O_TRUNC;
+    direct = false;
+#ifdef O_DIRECT
+    if (wantDirect) {
+        int fd = ::open(path.c_str(), flags | O_DIRECT, 0644);
+        if (fd >= 0) {
+            direct = true;
+            return fd;
+        }
+    }
+#else
+    (void)wantDirect;
+#endif
+    return ::open(path.c_str(), flags, 0644);
+}
+
+void preallocate(int fd, unsigned long long bytes) {
+#if defined(__linux__)
+    if (bytes > 0) {
+        // Best effort: not every filesystem supports fallocate
+        (void)fallocate(fd, 0, 0, static_cast<off_t>(bytes));
+    }
+#else
+    (void)fd;
+    (void)bytes;
+#endif
+}
+
+// Blocking pwrite of the whole range. If the filesystem rejects an O_DIRECT
+// write, direct I/O is switched off for the descriptor and the write retried.
+bool pwriteAll(int fd, const char* data, size_t length, unsigned long long offset, bool& direct) {
+    while (length > 0) {
+        ssize_t n = ::pwrite(fd, data, length, static_cast<off_t>(offset));
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+#ifdef O_DIRECT
+            if (errno == EINVAL && direct) {
+                fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+                direct = false;
+                continue;
+            }
+#endif
+            return false;
+        }
+        data += n;
+        length -= static_cast<size_t>(n);
+        offset += static_cast<unsigned long long>(n);
+    }
+    return true;
+}
+#endif
+
+// -----------------------------
+// Thread-pool backend (pwrite; a single ordered writer on Windows)
+// -----------------------------
+class ThreadBackend : public AsyncIoBackend {
+public:
+    bool open(const std::string& path, unsigned long long expectedBytes, const AsyncWriterOptions& options) {
+#ifdef _WIN32
+        (void)expectedBytes;
+        path_ = path;
+        out_.open(path, std::ios::binary | std::ios::trunc);
+        if (!out_) {
+            return false;
+        }
+        int threads = 1;  // ofstream writes are not positional-thread-safe
+#else
+        bool direct = false;
+        fd_ = openOutputFile(path, options.direct, direct);
+        if (fd_ < 0) {
+            return false;
+        }
+        direct_ = direct;
+        preallocate(fd_, expectedBytes);
+        int threads = std::max(1, options.buffers);
+#endif
+        for (int t = 0; t < threads; ++t) {
+            workers_.emplace_back([this] { workerLoop(); });
+        }
+        return true;
+    }
+
+    ~ThreadBackend() override {
+        stopWorkers();
+#ifndef _WIN32
+        if (fd_ >= 0) {
+            ::close(fd_);
+        }
+#endif
+    }
+
+    const char* name() const override {
+        return "pwrite thread pool";
+    }
+
+    bool direct() const override {
+        return direct_;
+    }
+
+    bool submit(int index, const char* data, size_t length, unsigned long long offset) override {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            jobs_.push_back({ index, data, length, offset });
+            inFlight_++;
+        }
+        wake_.notify_one();
+        return true;
+    }
+
+    int waitCompleted() override {
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_.wait(lock, [this] { return !completed_.empty(); });
+        int index = completed_.front();
+        completed_.pop_front();
+        inFlight_--;
+        return failed_ ? -1 : index;
+    }
+
+    int inFlight() const override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return inFlight_;
+    }
+
+    bool finish(unsigned long long finalSize) override {
+        stopWorkers();
+#ifdef _WIN32
+        out_.close();
+        std::error_code ec;
+        std::filesystem::resize_file(path_, finalSize, ec);
+        return !failed_ && !ec;
+#else
+        bool ok = !failed_ && ftruncate(fd_, static_cast<off_t>(finalSize)) == 0;
+        ok = (::close(fd_) == 0) && ok;
+        fd_ = -1;
+        return ok;
+#endif
+    }
+
+private:
+    struct Job {
+        int index;
+        const char* data;
+        size_t length;
+        unsigned long long offset;
+    };
+
+    void workerLoop() {
+        for (;;) {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                wake_.wait(lock, [this] { return stop_ || !jobs_.empty(); });
+                if (jobs_.empty()) {
+                    return;
+                }
+                job = jobs_.front();
+                jobs_.pop_front();
+            }
+            bool ok = writeJob(job);
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (!ok) {
+                    failed_ = true;
+                }
+                completed_.push_back(job.index);
+            }
+            done_.notify_all();
+        }
+    }
+
+    bool writeJob(const Job& job) {
+#ifdef _WIN32
+        out_.seekp(static_cast<std::streamoff>(job.offset));
+        out_.write(job.data, static_cast<std::streamsize>(job.length));
+        return static_cast<bool>(out_);
+#else
+        bool direct = direct_.load();
+        bool ok = pwriteAll(fd_, job.data, job.length, job.offset, direct);
+        if (!direct) {
+            direct_ = false;
+        }
+        return ok;
+#endif
+    }
+
+    void stopWorkers() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        wake_.notify_all();
+        for (std::thread& t : workers_) {
+            t.join();
+        }
+        workers_.clear();
+    }
+
+#ifdef _WIN32
+    std::string path_;
+    std::ofstream out_;
+#else
+    int fd_ = -1;
+#endif
+    std::atomic<bool> direct_{ false };
+    std::vector<std::thread> workers_;
+    mutable std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    std::deque<Job> jobs_;
+    std::deque<int> completed_;
+    int inFlight_ = 0;
+    bool stop_ = false;
+    bool failed_ = false;
+};
+
+#ifdef PERIDYNAMIC_HAVE_IO_URING
+// -----------------------------
+// io_uring backend (raw syscalls)
+// -----------------------------
+class UringBackend : public AsyncIoBackend {
+public:
+    // Returns false (and leaves nothing open) if io_uring is unavailable
+    bool open(const std::string& path, unsigned long long expectedBytes, const AsyncWriterOptions& options) {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        unsigned entries = static_cast<unsigned>(std::max(2, options.buffers));
+        ringFd_ = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+        if (ringFd_ < 0) {
+            return false;
+        }
+
+        sqRingBytes_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingBytes_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        singleMmap_ = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (singleMmap_) {
+            sqRingBytes_ = cqRingBytes_ = std::max(sqRingBytes_, cqRingBytes_);
+        }
+        sqRing_ = mmap(nullptr, sqRingBytes_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       ringFd_, IORING_OFF_SQ_RING);
+        if (sqRing_ == MAP_FAILED) {
+            sqRing_ = nullptr;
+            return false;
+        }
+        if (singleMmap_) {
+            cqRing_ = sqRing_;
+        }
+        else {
+            cqRing_ = mmap(nullptr, cqRingBytes_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                           ringFd_, IORING_OFF_CQ_RING);
+            if (cqRing_ == MAP_FAILED) {
+                cqRing_ = nullptr;
+                return false;
+            }
+        }
+        sqesBytes_ = params.sq_entries * sizeof(io_uring_sqe);
+        void* sqes = mmap(nullptr, sqesBytes_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          ringFd_, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) {
+            return false;
+        }
+        sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+        char* sq = static_cast<char*>(sqRing_);
+        char* cq = static_cast<char*>(cqRing_);
+        sqTail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sqMask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sqArray_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        cqHead_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cqTail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cqMask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+        fd_ = openOutputFile(path, options.direct, direct_);
+        if (fd_ < 0) {
+            return false;
+        }
+        preallocate(fd_, expectedBytes);
+        pending_.resize(std::max(1, options.buffers));
+        return true;
+    }
+
+    ~UringBackend() override {
+        if (fd_ >= 0) {
+            ::close(fd_);
+        }
+        if (sqes_ != nullptr) {
+            munmap(sqes_, sqesBytes_);
+        }
+        if (cqRing_ != nullptr && !singleMmap_) {
+            munmap(cqRing_, cqRingBytes_);
+        }
+        if (sqRing_ != nullptr) {
+            munmap(sqRing_, sqRingBytes_);
+        }
+        if (ringFd_ >= 0) {
+            ::close(ringFd_);
+        }
+    }
+
+    const char* name() const override {
+        return "io_uring";
+    }
+
+    bool direct() const override {
+        return direct_;
+    }
+
+    bool submit(int index, const char* data, size_t length, unsigned long long offset) override {
+        pending_[index] = { data, length, offset };
+
+        unsigned tail = *sqTail_;
+        unsigned slot = tail & sqMask_;
+        io_uring_sqe* sqe = &sqes_[slot];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_WRITE;
+        sqe->fd = fd_;
+        sqe->addr = reinterpret_cast<unsigned long long>(data);
+        sqe->len = static_cast<unsigned>(length);
+        sqe->off = offset;
+        sqe->user_data = static_cast<unsigned long long>(index);
+        sqArray_[slot] = slot;
+        __atomic_store_n(sqTail_, tail + 1, __ATOMIC_RELEASE);
+
+        for (;;) {
+            long ret = syscall(__NR_io_uring_enter, ringFd_, 1, 0, 0, nullptr, 0);
+            if (ret == 1) {
+                inFlight_++;
+                return true;
+            }
+            if (ret < 0 && errno == EINTR) {
+                continue;
+            }
+            // Short of kernel resources or completion space: take finished
+            // writes off the ring before trying again
+            bool busy = ret < 0 && (errno == EAGAIN || errno == EBUSY);
+            if (!busy || static_cast<size_t>(inFlight_) == reaped_.size() || !reap()) {
+                break;
+            }
+        }
+        // Not submitted: withdraw the entry, so that no later enter writes
+        // from a buffer the caller is free to reuse. Only io_uring_enter
+        // consumes entries, and it reports every entry it consumed.
+        __atomic_store_n(sqTail_, tail, __ATOMIC_RELEASE);
+        return false;
+    }
+
+    int waitCompleted() override {
+        if (reaped_.empty() && !reap()) {
+            return -1;
+        }
+        Completion c = reaped_.front();
+        reaped_.pop_front();
+        inFlight_--;
+        return complete(c.index, c.res) ? c.index : -1;
+    }
+
+    int inFlight() const override {
+        return inFlight_;
+    }
+
+    bool finish(unsigned long long finalSize) override {
+        bool ok = ftruncate(fd_, static_cast<off_t>(finalSize)) == 0;
+        ok = (::close(fd_) == 0) && ok;
+        fd_ = -1;
+        return ok;
+    }
+
+private:
+    struct Pending {
+        const char* data = nullptr;
+        size_t length = 0;
+        unsigned long long offset = 0;
+    };
+
+    struct Completion {
+        int index;
+        int res;
+    };
+
+    // Moves one completion from the ring to reaped_, waiting for it if none
+    // is posted yet; returns false on error
+    bool reap() {
+        for (;;) {
+            unsigned head = *cqHead_;
+            unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+            if (head != tail) {
+                const io_uring_cqe& cqe = cqes_[head & cqMask_];
+                reaped_.push_back({ static_cast<int>(cqe.user_data), cqe.res });
+                __atomic_store_n(cqHead_, head + 1, __ATOMIC_RELEASE);
+                return true;
+            }
+            long ret = syscall(__NR_io_uring_enter, ringFd_, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+            if (ret < 0 && errno != EINTR) {
+                return false;
+            }
+        }
+    }
+
+    // Finish a completion: errors that a plain pwrite can recover from (an
+    // O_DIRECT write the filesystem rejects, or a short write) are redone
+    // synchronously.
+    bool complete(int index, int res) {
+        const Pending& p = pending_[index];
+        if (res >= 0 && static_cast<size_t>(res) == p.length) {
+            return true;
+        }
+        if (res < 0 && res != -EINVAL) {
+            errno = -res;
+            return false;
+        }
+        size_t done = (res > 0) ? static_cast<size_t>(res) : 0;
+        return pwriteAll(fd_, p.data + done, p.length - done, p.offset + done, direct_);
+    }
+
+    int ringFd_ = -1;
+    int fd_ = -1;
+    bool direct_ = false;
+    bool singleMmap_ = false;
+    void* sqRing_ = nullptr;
+    void* cqRing_ = nullptr;
+    size_t sqRingBytes_ = 0;
+    size_t cqRingBytes_ = 0;
+    size_t sqesBytes_ = 0;
+    io_uring_sqe* sqes_ = nullptr;
+    unsigned* sqTail_ = nullptr;
+    unsigned sqMask_ = 0;
+    unsigned* sqArray_ = nullptr;
+    unsigned* cqHead_ = nullptr;
+    unsigned* cqTail_ = nullptr;
+    unsigned cqMask_ = 0;
+    io_uring_cqe* cqes_ = nullptr;
+    std::vector<Pending> pending_;
+    std::deque<Completion> reaped_;  // taken off the ring, not yet handed back
+    int inFlight_ = 0;                // submitted, not yet handed back
+};
+#endif
+
+}  // namespace
+
+// -----------------------------
+// AsyncFileWriter
+// -----------------------------
+AsyncFileWriter::AsyncFileWriter() = default;
+
+AsyncFileWriter::~AsyncFileWriter() {
+    if (backend_) {
+        // Never free a buffer the kernel may still be writing from
+        for (int pending = backend_->inFlight(); pending > 0 && backend_->inFlight() > 0; --pending) {
+            backend_->waitCompleted();
+        }
+    }
+    backend_.reset();
+    for (char* b : buffers_) {
+        alignedFree(b);
+    }
+}
+
+bool AsyncFileWriter::open(const std::string& path, unsigned long long expectedBytes,
+                           const AsyncWriterOptions& options) {
+    start_ = std::chrono::steady_clock::now();
+    bufferBytes_ = std::max(kIoAlignment, (options.bufferBytes + kIoAlignment - 1) / kIoAlignment * kIoAlignment);
+    int count = std::max(1, options.buffers);
+
+#ifdef PERIDYNAMIC_HAVE_IO_URING
+    if (options.allowUring) {
+        std::unique_ptr<UringBackend> uring(new UringBackend());
+        if (uring->open(path, expectedBytes, options)) {
+            backend_ = std::move(uring);
+        }
+    }
+#endif
+    if (!backend_) {
+        std::unique_ptr<ThreadBackend> threads(new ThreadBackend());
+        if (!threads->open(path, expectedBytes, options)) {
+            std::cerr << "Error: could not open " << path << " for writing.\n";
+            return false;
+        }
+        backend_ = std::move(threads);
+    }
+
+    for (int b = 0; b < count; ++b) {
+        char* buffer = alignedAlloc(bufferBytes_);
+        if (buffer == nullptr) {
+            std::cerr << "Error: could not allocate output buffers.\n";
+            return false;
+        }
+        buffers_.push_back(buffer);
+        freeBuffers_.push_back(count - 1 - b);
+    }
+    return true;
+}
+
+bool AsyncFileWriter::acquireBuffer() {
+    if (freeBuffers_.empty()) {
+        int index = backend_->waitCompleted();
+        if (index < 0) {
+            failed_ = true;
+            return false;
+        }
+        freeBuffers_.push_back(index);
+    }
+    current_ = freeBuffers_.back();
+    freeBuffers_.pop_back();
+    fill_ = 0;
+    return true;
+}
+
+bool AsyncFileWriter::submitCurrent(size_t length) {
+    if (!backend_->submit(current_, buffers_[current_], length, offset_)) {
+        failed_ = true;
+        return false;
+    }
+    offset_ += fill_;
+    fill_ = 0;
+    current_ = -1;
+    return true;
+}
+
+bool AsyncFileWriter::append(const char* data, size_t n) {
+    while (n > 0 && !failed_) {
+        if (current_ < 0 && !acquireBuffer()) {
+            return false;
+        }
+        size_t chunk = std::min(n, bufferBytes_ - fill_);
+        std::memcpy(buffers_[current_] + fill_, data, chunk);
+        fill_ += chunk;
+        data += chunk;
+        n -= chunk;
+        if (fill_ == bufferBytes_ && !submitCurrent(bufferBytes_)) {
+            return false;
+        }
+    }
+    return !failed_;
+}
+
+bool AsyncFileWriter::close() {
+    if (!backend_) {
+        return false;
+    }
+    unsigned long long finalSize = offset_ + fill_;
+    if (current_ >= 0 && fill_ > 0 && !failed_) {
+        size_t length = fill_;
+        if (backend_->direct()) {
+            // Direct I/O writes whole blocks; the padding is cut off by finish()
+            length = (fill_ + kIoAlignment - 1) / kIoAlignment * kIoAlignment;
+            std::memset(buffers_[current_] + fill_, 0, length - fill_);
+        }
+        submitCurrent(length);
+    }
+    while (backend_->inFlight() > 0) {
+        if (backend_->waitCompleted() < 0) {
+            failed_ = true;
+        }
+    }
+    bool ok = backend_->finish(finalSize) && !failed_;
+    seconds_ = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+    if (!ok) {
+        std::cerr << "Error: asynchronous write failed.\n";
+    }
+    return ok;
+}
+
+const char* AsyncFileWriter::backendName() const {
+    return backend_ ? backend_->name() : "none";
+}
+
+bool AsyncFileWriter::directIo() const {
+    return backend_ && backend_->direct();
+}
+
+double AsyncFileWriter::megabytesPerSecond() const {
+    return (seconds_ > 0.0) ? static_cast<double>(bytesWritten()) / (1024.0 * 1024.0) / seconds_ : 0.0;
+}
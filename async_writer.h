@@ -0,0 +1,64 @@
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Asynchronous sequential file writer for large outputs.
+//
+// Data is appended into large page-aligned buffers; a full buffer is handed to
+// the I/O backend and the caller continues filling the next one, with up to
+// `buffers` writes in flight. On Linux the backend is io_uring (raw syscalls,
+// no liburing needed), with the file opened O_DIRECT when the filesystem
+// allows it and preallocated with fallocate. Elsewhere, or when io_uring is
+// unavailable, a small pool of pwrite threads is used instead.
+
+struct AsyncWriterOptions {
+    size_t bufferBytes = 4 << 20;  // rounded up to the 4 KiB alignment
+    int buffers = 4;               // buffers (and writes) in flight
+    bool direct = true;            // try O_DIRECT (Linux)
+    bool allowUring = true;        // false forces the pwrite thread pool
+};
+
+class AsyncIoBackend;
+
+class AsyncFileWriter {
+public:
+    AsyncFileWriter();
+    ~AsyncFileWriter();
+
+    AsyncFileWriter(const AsyncFileWriter&) = delete;
+    AsyncFileWriter& operator=(const AsyncFileWriter&) = delete;
+
+    // Create/truncate the file; expectedBytes (0 = unknown) is preallocated
+    bool open(const std::string& path, unsigned long long expectedBytes,
+              const AsyncWriterOptions& options = AsyncWriterOptions());
+
+    // Copy n bytes into the output stream
+    bool append(const char* data, size_t n);
+
+    // Flush, wait for all writes, set the final file size and close
+    bool close();
+
+    const char* backendName() const;
+    bool directIo() const;
+    unsigned long long bytesWritten() const { return offset_ + fill_; }
+    double seconds() const { return seconds_; }
+    double megabytesPerSecond() const;
+
+private:
+    bool submitCurrent(size_t length);
+    bool acquireBuffer();
+
+    std::unique_ptr<AsyncIoBackend> backend_;
+    std::vector<char*> buffers_;
+    std::vector<int> freeBuffers_;
+    size_t bufferBytes_ = 0;
+    int current_ = -1;
+    size_t fill_ = 0;
+    unsigned long long offset_ = 0;
+    bool failed_ = false;
+    std::chrono::steady_clock::time_point start_;
+    double seconds_ = 0.0;
+};
@@ -0,0 +1,135 @@
+#include "benchmark.h"
+
+#include "metrics.h"
+
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <utility>
+#include <vector>
+
+namespace {
+
+struct Benchmark {
+    const char* name;
+    const char* description;
+    // Job file keys; dx is set from the scale
+    std::vector<std::pair<const char*, const char*>> keys;
+};
+
+const std::vector<Benchmark>& benchmarks() {
+    static const std::vector<Benchmark> all = {
+        { "plate_hole", "plate with a central hole in tension",
+          { { "Lx", "200" }, { "Ly", "100" }, { "m", "3" }, { "phi", "0.05" }, { "seed", "101" },
+            { "hole", "100 50 10" },
+            { "dynamics_load", "tension" }, { "dynamics_strain", "1.2e-3" },
+            { "dynamics_critical_stretch", "3e-3" } } },
+        { "kalthoff_winkler", "double edge-notched plate under impact",
+          { { "Lx", "100" }, { "Ly", "200" }, { "m", "3" }, { "phi", "0.05" }, { "seed", "102" },
+            { "notch", "0 74.75 50 74.75" }, { "notch", "0 125.25 50 125.25" },
+            { "dynamics_load", "impact" }, { "dynamics_strain", "5e-3" },
+            { "dynamics_critical_stretch", "1e-3" } } },
+        { "three_point_bend", "notched porous beam in three-point bending",
+          { { "Lx", "400" }, { "Ly", "100" }, { "m", "3" }, { "phi", "0.1" }, { "seed", "103" },
+            { "notch", "200.25 -1 200.25 25" },
+            { "dynamics_load", "bend" }, { "dynamics_strain", "2e-3" },
+            { "dynamics_critical_stretch", "3e-3" } } },
+    };
+    return all;
+}
+
+// Settings shared by every benchmark
+const std::pair<const char*, const char*> kCommonKeys[] = {
+    { "bond_storage", "memory" }, { "compact", "1" }, { "summary", "1" },
+    { "dynamics_steps", "20" },
+};
+
+bool configure(const Benchmark& benchmark, double scale, SimulationConfig& config) {
+    std::ostringstream dx;
+    dx << std::setprecision(17) << 1.0 / scale;
+    bool ok = setConfigValue(config, "dx", dx.str());
+    for (const auto& [key, value] : kCommonKeys) {
+        ok = ok && setConfigValue(config, key, value);
+    }
+    for (const auto& [key, value] : benchmark.keys) {
+        ok = ok && setConfigValue(config, key, value);
+    }
+    ok = ok && setConfigValue(config, "output", std::string("benchmark_") + benchmark.name + ".vtk");
+    return ok && validateConfig(config);
+}
+
+}  // namespace
+
+int runBenchmarks(const std::string& name, double scale, const BenchmarkRunner& run) {
+    std::vector<const Benchmark*> selected;
+    for (const Benchmark& b : benchmarks()) {
+        if (name == "all" || name == b.name) {
+            selected.push_back(&b);
+        }
+    }
+    if (selected.empty() || !(scale > 0.0)) {
+        std::cerr << "Error: usage: --benchmark [all";
+        for (const Benchmark& b : benchmarks()) {
+            std::cerr << " | " << b.name;
+        }
+        std::cerr << "] [scale > 0]\n";
+        return 1;
+    }
+
+    struct Row {
+        const Benchmark* benchmark;
+        bool ok;
+        BenchmarkRun result;
+        unsigned long long peakBytes;
+    };
+    std::vector<Row> rows;
+    for (const Benchmark* b : selected) {
+        std::cout << "\n===== Benchmark " << b->name << ": " << b->description << " (scale " << scale << ") =====\n";
+        SimulationConfig config;
+        BenchmarkRun result;
+        bool ok = configure(*b, scale, config) && run(config, result);
+        // A fracture benchmark that breaks nothing only measured elasticity
+        if (ok && result.dynamics.brokenBonds == 0) {
+            std::cerr << "Error: benchmark " << b->name << " broke no bonds\n";
+            ok = false;
+        }
+        rows.push_back({ b, ok, std::move(result), peakResidentBytes() });
+    }
+
+    std::cout << "\n===== Benchmark results (scale " << scale << ") =====\n";
+    std::cout << std::left << std::setw(18) << "benchmark"
+        << std::right << std::setw(11) << "particles"
+        << std::setw(12) << "bonds"
+        << std::setw(7) << "steps"
+        << std::setw(8) << "broken"
+        << std::setw(11) << "s/step"
+        << std::setw(12) << "Mupdates/s"
+        << std::setw(10) << "graph MB"
+        << std::setw(9) << "peak MB" << "\n";
+    bool allOk = true;
+    for (const Row& row : rows) {
+        std::cout << std::left << std::setw(18) << row.benchmark->name << std::right;
+        if (!row.ok) {
+            std::cout << std::setw(11) << "failed" << "\n";
+            allOk = false;
+            continue;
+        }
+        const BenchmarkRun& r = row.result;
+        const int steps = r.dynamics.steps;
+        const double seconds = r.dynamicsSeconds;
+        std::cout << std::setw(11) << r.particles
+            << std::setw(12) << r.bonds
+            << std::setw(7) << steps
+            << std::setw(8) << r.dynamics.brokenBonds
+            << std::fixed << std::setprecision(3)
+            << std::setw(11) << (steps > 0 ? seconds / steps : 0.0)
+            << std::setprecision(1)
+            << std::setw(12) << (seconds > 0.0 ? r.dynamics.bondUpdates / seconds / 1e6 : 0.0)
+            << std::setw(10) << r.bondBytes / 1048576.0
+            << std::setw(9) << row.peakBytes / 1048576.0 << "\n";
+        std::cout.unsetf(std::ios::floatfield);
+    }
+    std::cout << "\nMupdates/s: directed bonds visited by residuals and failure checks of the dynamics per second\n";
+    std::cout << "peak MB: peak resident memory of the process so far (run one benchmark alone for its own peak)\n";
+    return allOk ? 0 : 1;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "dynamics.h"
+#include "job_config.h"
+
+#include <functional>
+#include <string>
+
+// Canonical fracture benchmarks (Peridynamic --benchmark [name | all] [scale]).
+//
+// Three fixed specimens run through the whole pipeline with fixed seeds and
+// implicit dynamics on the stored bond graph:
+//   plate_hole        plate with a central hole (r = Ly / 10) pulled in x
+//   kalthoff_winkler  two parallel edge notches, impact between them
+//   three_point_bend  notched beam in three-point bending on porous material
+// The geometry is given in physical units; scale divides dx, so scale = 2
+// has four times the particles of the same specimen. Each run writes
+// benchmark_<name>.vtk with its JSON summary, and a table of particles,
+// bonds, steps, time per step, bond updates per second of the dynamics,
+// bond graph size and peak memory is printed at the end, so releases can be
+// compared on the same problems.
+
+struct BenchmarkRun {
+    long long particles = 0;
+    long long bonds = 0;
+    unsigned long long bondBytes = 0;
+    DynamicsResult dynamics;        // without the per-particle fields
+    double dynamicsSeconds = 0.0;
+};
+
+// Runs one configured simulation; false on failure
+using BenchmarkRunner = std::function<bool(const SimulationConfig& config, BenchmarkRun& run)>;
+
+// Returns 0 if every selected benchmark ran and broke bonds, 1 otherwise
+int runBenchmarks(const std::string& name, double scale, const BenchmarkRunner& run);
@@ -0,0 +1,305 @@
+#include "bond_graph.h"
+
+#include "metrics.h"
+#include "parallel.h"
+
+#include <algorithm>
+
+namespace {
+
+// Zigzag code of a signed id difference (small magnitudes, small codes)
+uint64_t zigzag(long long d) {
+    return (static_cast<uint64_t>(d) << 1) ^ static_cast<uint64_t>(d >> 63);
+}
+
+int varintBytes(uint64_t v) {
+    int n = 1;
+    while (v >= 0x80) {
+        v >>= 7;
+        n++;
+    }
+    return n;
+}
+
+uint8_t* writeVarint(uint64_t v, uint8_t* p) {
+    while (v >= 0x80) {
+        *p++ = static_cast<uint8_t>(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = static_cast<uint8_t>(v);
+    return p;
+}
+
+}  // namespace
+
+bool BondGraph::allocate(const std::vector<int>& bondCounts, const BondStorageOptions& options) {
+    const std::string directory = options.mapped ? options.directory : std::string();
+    particles_ = static_cast<long long>(bondCounts.size());
+    if (!offsets.allocate(particles_ + 1, directory)) {
+        return false;
+    }
+    long long sum = 0;
+    for (long long i = 0; i < particles_; ++i) {
+        offsets[i] = sum;
+        sum += bondCounts[i];
+    }
+    offsets[particles_] = sum;
+    bonds_ = sum;
+    packed_ = MappedArray<uint8_t>();
+    packedOffsets_ = MappedArray<long long>();
+
+    if (!neighbor.allocate(bonds_, directory) || !broken.allocate(bonds_, directory)) {
+        return false;
+    }
+    offsets.adviseSequential();
+    neighbor.adviseSequential();
+    broken.adviseSequential();
+    windowBytes_ = static_cast<size_t>(std::max(1, options.windowMegabytes)) << 20;
+    return true;
+}
+
+bool BondGraph::compress(const BondStorageOptions& options) {
+    if (!options.compressed || compressed()) {
+        return true;
+    }
+    const std::string directory = options.mapped ? options.directory : std::string();
+    MappedArray<long long> packedOffsets;
+    if (!packedOffsets.allocate(particles_ + 1, directory)) {
+        return false;
+    }
+    // Encoded length of every list, then their offsets
+    forEachBlock([&](long long first, long long last) {
+        for (long long id = first; id < last; ++id) {
+            long long previous = id;
+            long long n = 0;
+            for (long long b = offsets[id]; b < offsets[id + 1]; ++b) {
+                n += varintBytes(zigzag(neighbor[b] - previous));
+                previous = neighbor[b];
+            }
+            packedOffsets[id + 1] = n;
+        }
+    });
+    packedOffsets[0] = 0;
+    for (long long i = 0; i < particles_; ++i) {
+        packedOffsets[i + 1] += packedOffsets[i];
+    }
+
+    MappedArray<uint8_t> packed;
+    if (!packed.allocate(static_cast<size_t>(packedOffsets[particles_]), directory)) {
+        return false;
+    }
+    forEachBlock([&](long long first, long long last) {
+        for (long long id = first; id < last; ++id) {
+            uint8_t* p = packed.data() + packedOffsets[id];
+            long long previous = id;
+            for (long long b = offsets[id]; b < offsets[id + 1]; ++b) {
+                p = writeVarint(zigzag(neighbor[b] - previous), p);
+                previous = neighbor[b];
+            }
+        }
+    });
+    packedOffsets.adviseSequential();
+    packed.adviseSequential();
+    packedOffsets_ = std::move(packedOffsets);
+    packed_ = std::move(packed);
+    neighbor = MappedArray<int>();
+    return true;
+}
+
+void BondGraph::forEachBlock(const std::function<void(long long, long long)>& body) const {
+    if (particles_ == 0) {
+        return;
+    }
+    // Window size in particles from the average bond count, but at least
+    // four windows per worker so small graphs still spread over the pool
+    const double bondsPerParticle = std::max(1.0, static_cast<double>(bonds_) / particles_);
+    const double bytesPerBond = (bonds_ > 0)
+        ? static_cast<double>(neighbor.bytes() + broken.bytes() + packed_.bytes()) / bonds_ : 1.0;
+    const long long balanced = (particles_ + 4LL * workerThreads() - 1) / (4LL * workerThreads());
+    const long long window = std::max(1024LL, std::min(balanced,
+        static_cast<long long>(windowBytes_ / (bytesPerBond * bondsPerParticle))));
+    const long long windows = (particles_ + window - 1) / window;
+
+    auto bondRange = [&](long long w, long long& first, long long& last) {
+        first = w * window;
+        last = std::min(particles_, first + window);
+    };
+    auto prefetch = [&](long long w) {
+        long long first, last;
+        bondRange(w, first, last);
+        offsets.prefetch(first, last + 1);
+        neighbor.prefetch(offsets[first], offsets[last]);
+        broken.prefetch(offsets[first], offsets[last]);
+        if (compressed()) {
+            packedOffsets_.prefetch(first, last + 1);
+            packed_.prefetch(packedOffsets_[first], packedOffsets_[last]);
+        }
+    };
+
+    // Each worker streams through a contiguous run of windows, prefetching
+    // window w + 1 while it processes window w
+    const long long runs = std::min<long long>(windows, 4LL * workerThreads());
+    parallelBlocks(runs, [&](long long r, int) {
+        long long w0 = windows * r / runs;
+        long long w1 = windows * (r + 1) / runs;
+        if (w0 < w1) {
+            prefetch(w0);
+        }
+        for (long long w = w0; w < w1; ++w) {
+            if (w + 1 < w1) {
+                prefetch(w + 1);
+            }
+            long long first, last;
+            bondRange(w, first, last);
+            body(first, last);
+            metricsCountParticles(last - first);
+            metricsCountBonds(offsets[last] - offsets[first]);
+            neighbor.release(offsets[first], offsets[last]);
+            broken.release(offsets[first], offsets[last]);
+            if (compressed()) {
+                packed_.release(packedOffsets_[first], packedOffsets_[last]);
+            }
+        }
+    });
+}
+
+bool buildBondGraph(int Nx, int Ny, const BondStencil& stencil, const CouplingZone* coupling,
+                    const LatticeJitter* jitter,
+                    const std::vector<int>& N_total, const MappedArray<uint8_t>& halfState,
+                    const BondStorageOptions& options, BondGraph& graph) {
+    if (!graph.allocate(N_total, options)) {
+        return false;
+    }
+
+    // Every full-stencil offset is either a half-stencil offset k (the
+    // decision is stored at this particle) or the negation of one (stored at
+    // the neighbor)
+    const int H = static_cast<int>(stencil.half.size());
+    std::vector<int> halfIndex(stencil.full.size(), -1);
+    std::vector<char> forward(stencil.full.size(), 0);
+    for (size_t f = 0; f < stencil.full.size(); ++f) {
+        const StencilOffset& o = stencil.full[f];
+        for (int k = 0; k < H; ++k) {
+            const StencilOffset& h = stencil.half[k];
+            if (h.di == o.di && h.dj == o.dj) {
+                halfIndex[f] = k;
+                forward[f] = 1;
+            }
+            else if (h.di == -o.di && h.dj == -o.dj) {
+                halfIndex[f] = k;
+            }
+        }
+    }
+
+    // A particle reads its own slots and those of up to `reach` rows behind it
+    const uint8_t* state = halfState.data();
+    const long long lookBack = static_cast<long long>(stencil.reach) * Nx + stencil.reach;
+    graph.forEachBlock([&](long long first, long long last) {
+        halfState.prefetch(std::max(0LL, first - lookBack) * H, last * H);
+        long long b = graph.offsets[first];
+        for (long long id = first; id < last; ++id) {
+            int i = static_cast<int>(id % Nx);
+            int j = static_cast<int>(id / Nx);
+            // Outside the columns around the region of interest only
+            // nearest-neighbor bonds exist; no midpoint test needed there
+            bool nonlocal = true;
+            if (coupling != nullptr) {
+                int spanFirst = 0;
+                int spanLast = 0;
+                coupling->nonlocalSpan(j, stencil.reach, Nx, spanFirst, spanLast);
+                nonlocal = (i >= spanFirst && i < spanLast);
+            }
+            for (size_t f = 0; f < stencil.full.size(); ++f) {
+                int ni = i + stencil.full[f].di;
+                int nj = j + stencil.full[f].dj;
+                if (ni < 0 || ni >= Nx || nj < 0 || nj >= Ny) {
+                    continue;
+                }
+                if (coupling != nullptr && !(nonlocal ? coupling->hasBond(i, j, stencil.full[f].di, stencil.full[f].dj)
+                                                      : CouplingZone::nearestNeighbor(stencil.full[f].di,
+                                                                                      stencil.full[f].dj))) {
+                    continue;
+                }
+                long long nid = static_cast<long long>(nj) * Nx + ni;
+                if (jitter != nullptr && !jitter->hasBond(id, nid, stencil.full[f].di, stencil.full[f].dj)) {
+                    continue;
+                }
+                long long slot = (forward[f] ? id : nid) * H + halfIndex[f];
+                graph.neighbor[b] = static_cast<int>(nid);
+                graph.broken[b] = state[slot];
+                b++;
+            }
+        }
+    });
+    return graph.compress(options);
+}
+
+void bondGraphDamage(const BondGraph& graph, std::vector<double>& damage) {
+    damage.assign(graph.particles(), 0.0);
+    graph.forEachBlock([&](long long first, long long last) {
+        for (long long id = first; id < last; ++id) {
+            long long b0 = graph.offsets[id];
+            long long b1 = graph.offsets[id + 1];
+            int brokenCount = 0;
+            for (long long b = b0; b < b1; ++b) {
+                brokenCount += graph.broken[b];
+            }
+            // isolated points (no bonds) keep d = 0
+            if (b1 > b0) {
+                damage[id] = static_cast<double>(brokenCount) / static_cast<double>(b1 - b0);
+            }
+        }
+    });
+}
+
+bool compactBondGraph(const BondGraph& full, const Compaction& compaction, const BondStorageOptions& options,
+                      BondGraph& graph) {
+    const long long kept = compaction.kept();
+    auto keptBond = [&](long long b, long long nid) {
+        return !full.broken[b] && compaction.compactId[nid] >= 0;
+    };
+
+    std::vector<int> bondCounts(kept, 0);
+    parallelFor(kept, 4096, [&](long long k0, long long k1) {
+        for (long long k = k0; k < k1; ++k) {
+            full.forEachBond(compaction.originalId[k], [&](long long b, long long nid) {
+                bondCounts[k] += keptBond(b, nid) ? 1 : 0;
+            });
+        }
+    });
+    if (!graph.allocate(bondCounts, options)) {
+        return false;
+    }
+    std::vector<long long> gridIds(kept);
+    for (long long k = 0; k < kept; ++k) {
+        gridIds[k] = full.gridId(compaction.originalId[k]);
+    }
+    graph.setGridIds(std::move(gridIds));
+
+    graph.forEachBlock([&](long long first, long long last) {
+        long long c = graph.offsets[first];
+        for (long long k = first; k < last; ++k) {
+            full.forEachBond(compaction.originalId[k], [&](long long b, long long nid) {
+                if (keptBond(b, nid)) {
+                    graph.neighbor[c] = static_cast<int>(compaction.compactId[nid]);
+                    graph.broken[c] = 0;
+                    c++;
+                }
+            });
+        }
+    });
+    return graph.compress(options);
+}
+
+void compactedGraphDamage(const BondGraph& graph, const std::vector<int>& N_total, std::vector<double>& damage) {
+    graph.forEachBlock([&](long long first, long long last) {
+        for (long long id = first; id < last; ++id) {
+            int intact = 0;
+            for (long long b = graph.offsets[id]; b < graph.offsets[id + 1]; ++b) {
+                intact += graph.broken[b] ? 0 : 1;
+            }
+            long long cell = graph.gridId(id);
+            damage[cell] = 1.0 - static_cast<double>(intact) / static_cast<double>(N_total[cell]);
+        }
+    });
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include "compaction.h"
+#include "coupling.h"
+#include "lattice.h"
+#include "lattice_jitter.h"
+#include "mapped_array.h"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Explicit per-bond data of a run, in compressed sparse row (CSR) order:
+// the bonds of particle i are [offsets[i], offsets[i + 1]), so every bond is
+// stored at both of its particles and a sweep over particles reads the bond
+// arrays strictly front to back.
+//
+// The arrays live either on the heap or in memory-mapped scratch files on
+// local disk (bond_storage = mapped). In the mapped case the OS pages the
+// arrays in and out; forEachBlock() drives it with sequential access hints,
+// prefetches the next window of bonds while the current one is processed and
+// drops windows that are done, so resident memory stays at a few windows per
+// thread no matter how large the graph is.
+//
+// With bond_compression = 1 the neighbor ids are packed once the graph is
+// built: the ids of each particle become zigzag varints of the difference to
+// the previous id (the first to the particle itself). Builders emit the
+// neighbors in grid order, so most differences are 1 within a stencil row
+// and about Nx between rows, one or two bytes instead of four. The bond
+// loops decode the ids on the fly through forEachBond(); random access by
+// bond index is not available then (refinement needs it). It is off by
+// default: the graph only shrinks about 1.9x (flags and offsets are not
+// packed) and decoding slows the bond loops by about 10%.
+
+struct BondStorageOptions {
+    bool mapped = false;            // memory-mapped scratch files instead of heap memory
+    std::string directory = ".";    // where the scratch files go (local NVMe)
+    int windowMegabytes = 64;       // prefetch window per thread
+    bool compressed = false;        // delta-varint neighbor lists
+};
+
+class BondGraph {
+public:
+    long long particles() const { return particles_; }
+    long long bonds() const { return bonds_; }  // directed: each bond counts twice
+    bool mapped() const { return offsets.fileBacked(); }
+    bool compressed() const { return packedOffsets_.size() > 0; }
+    unsigned long long bytes() const {
+        return offsets.bytes() + neighbor.bytes() + broken.bytes() + packed_.bytes() + packedOffsets_.bytes();
+    }
+
+    // Allocate storage for the given bond counts per particle and fill offsets
+    bool allocate(const std::vector<int>& bondCounts, const BondStorageOptions& options);
+
+    // Packs the filled neighbor array into delta varints and frees it if
+    // options ask for compression (a no-op otherwise). Prints an error and
+    // returns false on failure.
+    bool compress(const BondStorageOptions& options);
+
+    // Calls body(b, nid) for every bond b of particle id in storage order,
+    // nid being the particle at its other end
+    template <typename Body>
+    void forEachBond(long long id, Body&& body) const {
+        const long long b0 = offsets[id];
+        const long long b1 = offsets[id + 1];
+        if (!compressed()) {
+            for (long long b = b0; b < b1; ++b) {
+                body(b, static_cast<long long>(neighbor[b]));
+            }
+            return;
+        }
+        const uint8_t* p = packed_.data() + packedOffsets_[id];
+        long long nid = id;
+        for (long long b = b0; b < b1; ++b) {
+            uint64_t v = *p++;
+            if (v >= 0x80) {
+                v &= 0x7f;
+                int shift = 7;
+                uint8_t byte;
+                do {
+                    byte = *p++;
+                    v |= static_cast<uint64_t>(byte & 0x7f) << shift;
+                    shift += 7;
+                } while (byte >= 0x80);
+            }
+            nid += static_cast<long long>(v >> 1) ^ -static_cast<long long>(v & 1);
+            body(b, nid);
+        }
+    }
+
+    // Run body(first, last) over consecutive particle ranges in parallel.
+    // Each range covers about one prefetch window of bond data.
+    void forEachBlock(const std::function<void(long long, long long)>& body) const;
+
+    // Lattice index of a particle (particles are renumbered by compaction
+    // and refinement, which set the indices)
+    long long gridId(long long id) const { return gridIds_.empty() ? id : gridIds_[id]; }
+    void setGridIds(std::vector<long long> gridIds) { gridIds_ = std::move(gridIds); }
+
+    MappedArray<long long> offsets;  // particles + 1 entries
+    MappedArray<int> neighbor;       // particle at the other end of each bond (empty when compressed)
+    MappedArray<uint8_t> broken;     // 1 = broken by the pre-damage step
+
+private:
+    long long particles_ = 0;
+    long long bonds_ = 0;
+    size_t windowBytes_ = 0;
+    std::vector<long long> gridIds_;  // renumbered graphs: lattice index of every particle
+    MappedArray<uint8_t> packed_;           // compressed neighbor lists
+    MappedArray<long long> packedOffsets_;  // particles + 1 byte offsets into packed_
+};
+
+// Build the graph of the Nx x Ny lattice. halfState holds the pre-damage
+// decision of every half-stencil slot (see PreDamageSetup::bondState).
+// coupling and jitter (may be nullptr) remove bonds as in N_total.
+bool buildBondGraph(int Nx, int Ny, const BondStencil& stencil, const CouplingZone* coupling,
+                    const LatticeJitter* jitter,
+                    const std::vector<int>& N_total, const MappedArray<uint8_t>& halfState,
+                    const BondStorageOptions& options, BondGraph& graph);
+
+// Local damage d(i) = broken / total bonds, computed from the stored bonds
+void bondGraphDamage(const BondGraph& graph, std::vector<double>& damage);
+
+// Graph of the particles kept by compaction, renumbered, with their intact
+// bonds among each other. Bonds to removed particles are all broken, so no
+// load path is lost.
+bool compactBondGraph(const BondGraph& full, const Compaction& compaction, const BondStorageOptions& options,
+                      BondGraph& graph);
+
+// Damage of the particles of a compacted graph, written to their lattice
+// entries of damage: the bonds it dropped count as broken against the bond
+// counts N_total of the full lattice
+void compactedGraphDamage(const BondGraph& graph, const std::vector<int>& N_total, std::vector<double>& damage);
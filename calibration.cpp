@@ -0,0 +1,217 @@
+#include "calibration.h"
+
+#include "job_config.h"
+#include "kernel_tuning.h"
+#include "lattice.h"
+#include "lattice_stages.h"
+#include "parallel.h"
+#include "particle.h"
+#include "porosity_models.h"
+#include "reduction.h"
+#include "vtk_output.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const int kRepeats = 3;
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Lattice and work arrays shared by all micro-runs
+struct CalibrationLattice {
+    int Nx = 0;
+    int Ny = 0;
+    BondStencil stencil;
+    SimulationConfig config;
+    std::vector<Particle> particles;
+    std::vector<int> N_total;
+    std::vector<int> N_broken;
+    std::vector<double> damage;
+    long long brokenBonds = -1;  // result of the first run, every run must match
+};
+
+struct StageTimes {
+    double neighbor = 1e300;
+    double preDamage = 1e300;
+    double damage = 1e300;
+    double write = 0.0;
+    bool consistent = true;
+
+    double total() const { return neighbor + preDamage + damage + write; }
+};
+
+// Best-of-kRepeats time of every stage with the given knobs
+StageTimes timeStages(CalibrationLattice& l, const KernelTuning& tuning, bool withWrite) {
+    setWorkerThreads(tuning.threads);
+    StageTimes times;
+    const PreDamageKernel kernel = findPorosityModel("uniform")->kernel(l.config.rng);
+    const long long N = static_cast<long long>(l.Nx) * l.Ny;
+
+    for (int rep = 0; rep < kRepeats; ++rep) {
+        auto start = std::chrono::steady_clock::now();
+        computeNeighborCounts(l.stencil, nullptr, nullptr, l.Nx, l.Ny, tuning.tileRows, l.N_total);
+        times.neighbor = std::min(times.neighbor, secondsSince(start));
+
+        PreDamageSetup setup;
+        setup.Nx = l.Nx;
+        setup.Ny = l.Ny;
+        setup.dx = 1.0;
+        setup.stencil = &l.stencil;
+        setup.config = &l.config;
+        setup.seed = l.config.seed;
+        setup.tuning = tuning;
+        std::fill(l.N_broken.begin(), l.N_broken.end(), 0);
+        start = std::chrono::steady_clock::now();
+        kernel(setup, l.N_broken);
+        times.preDamage = std::min(times.preDamage, secondsSince(start));
+
+        start = std::chrono::steady_clock::now();
+        computeLocalDamage(l.N_total, l.N_broken, l.Nx, tuning.tileRows, l.damage);
+        times.damage = std::min(times.damage, secondsSince(start));
+
+        // Knobs must never change the result
+        long long broken = exactIntegerSum(N, [&](long long i) { return l.N_broken[i]; }) / 2;
+        if (l.brokenBonds < 0) {
+            l.brokenBonds = broken;
+        }
+        times.consistent = times.consistent && (broken == l.brokenBonds);
+    }
+
+    // Formatting dominates the write stage; only the thread count affects it
+    if (withWrite) {
+        const std::string scratch = "peridynamic_calibrate.vtk";
+        OutputStats stats;
+        if (writeVtkFile(scratch, l.particles, { { "damage", &l.damage } }, OutputOptions(), stats)) {
+            times.write = stats.seconds;
+        }
+        std::remove(scratch.c_str());
+    }
+    return times;
+}
+
+void printRow(const KernelTuning& t, const StageTimes& times) {
+    std::cout << std::right << std::setw(8) << t.threads
+        << std::setw(10) << t.tileRows
+        << std::setw(10) << (t.tileColumns > 0 ? std::to_string(t.tileColumns) : std::string("full"))
+        << std::setw(10) << loopOrderName(t.loopOrder)
+        << std::fixed << std::setprecision(2)
+        << std::setw(11) << times.neighbor * 1e3
+        << std::setw(11) << times.preDamage * 1e3
+        << std::setw(11) << times.damage * 1e3
+        << std::setw(11) << times.write * 1e3
+        << std::setw(11) << times.total() * 1e3
+        << (times.consistent ? "" : "   MISMATCH") << "\n";
+    std::cout.unsetf(std::ios::floatfield);
+}
+
+void printHeader() {
+    std::cout << std::right << std::setw(8) << "threads" << std::setw(10) << "rows"
+        << std::setw(10) << "columns" << std::setw(10) << "order"
+        << std::setw(11) << "nbr ms" << std::setw(11) << "pre ms"
+        << std::setw(11) << "d(i) ms" << std::setw(11) << "write ms"
+        << std::setw(11) << "total ms" << "\n";
+}
+
+}  // namespace
+
+int runCalibration(int gridSize, double m, const std::string& tuningFile) {
+    gridSize = std::max(gridSize, 32);
+    m = std::max(m, 1.0);
+
+    CalibrationLattice l;
+    l.Nx = gridSize;
+    l.Ny = gridSize;
+    l.stencil = buildBondStencil(1.0, m);
+    l.config.phi = 0.1;
+    l.config.seed = 12345;
+    const size_t N = static_cast<size_t>(l.Nx) * l.Ny;
+    l.particles.resize(N);
+    for (int j = 0; j < l.Ny; ++j) {
+        for (int i = 0; i < l.Nx; ++i) {
+            l.particles[static_cast<size_t>(j) * l.Nx + i] = { static_cast<double>(i), static_cast<double>(j) };
+        }
+    }
+    l.N_total.assign(N, 0);
+    l.N_broken.assign(N, 0);
+
+    std::cout << "\n===== Kernel calibration =====\n";
+    std::cout << "Host: " << hostKey() << "\n";
+    std::cout << "Micro-runs on " << gridSize << " x " << gridSize << " (m = " << m
+        << "), best of " << kRepeats << "\n\n";
+    printHeader();
+
+    // Pass 1: thread count with default tiles (including the write stage)
+    int hardware = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    std::vector<int> threadCounts;
+    for (int t = 1; t < hardware; t *= 2) {
+        threadCounts.push_back(t);
+    }
+    threadCounts.push_back(hardware);
+
+    KernelTuning best;
+    best.tileRows = 16;
+    best.tileColumns = 0;
+    best.loopOrder = LoopOrder::ParticleMajor;
+    double bestTime = 1e300;
+    bool consistent = true;
+    for (int threads : threadCounts) {
+        KernelTuning t = best;
+        t.threads = threads;
+        StageTimes times = timeStages(l, t, true);
+        printRow(t, times);
+        consistent = consistent && times.consistent;
+        if (times.total() < bestTime) {
+            bestTime = times.total();
+            best.threads = threads;
+        }
+    }
+    std::cout << "\n";
+
+    // Pass 2: tiles and loop order at that thread count (write stage unaffected)
+    bestTime = 1e300;
+    KernelTuning tileBest = best;
+    for (int rows : { 8, 16, 32, 64, 128 }) {
+        for (int columns : { 0, 256, 1024 }) {
+            if (columns >= l.Nx) {
+                continue;
+            }
+            for (LoopOrder order : { LoopOrder::ParticleMajor, LoopOrder::OffsetMajor }) {
+                KernelTuning t = best;
+                t.tileRows = rows;
+                t.tileColumns = columns;
+                t.loopOrder = order;
+                StageTimes times = timeStages(l, t, false);
+                printRow(t, times);
+                consistent = consistent && times.consistent;
+                if (times.total() < bestTime) {
+                    bestTime = times.total();
+                    tileBest = t;
+                }
+            }
+        }
+    }
+    best = tileBest;
+
+    if (!consistent) {
+        std::cerr << "\nError: results differ between kernel settings; tuning not saved\n";
+        return 1;
+    }
+
+    std::cout << "\nBest: " << best.threads << " threads, tile " << best.tileRows << " rows x "
+        << (best.tileColumns > 0 ? std::to_string(best.tileColumns) : std::string("full"))
+        << " columns, " << loopOrderName(best.loopOrder) << "-major\n";
+    if (!saveTuning(tuningFile, best)) {
+        return 1;
+    }
+    std::cout << "Saved to " << tuningFile << " (used automatically by later runs on this host)\n";
+    return 0;
+}
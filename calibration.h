@@ -0,0 +1,12 @@
+#pragma once
+
+#include <string>
+
+// Kernel auto-tuning (Peridynamic --calibrate [grid size] [m]).
+//
+// Times short micro-runs of the neighbor, pre-damage, damage and write stages
+// on a grid x grid lattice: first over thread counts with default tiles, then
+// over tile rows, tile columns and loop order at the best thread count. The
+// fastest combination (best of three runs each) is stored for this host in
+// tuningFile, where runSimulation picks it up automatically.
+int runCalibration(int gridSize, double m, const std::string& tuningFile);
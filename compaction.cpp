@@ -0,0 +1,51 @@
+#include "compaction.h"
+
+#include "parallel.h"
+
+#include <algorithm>
+
+namespace {
+
+const long long kCompactionGrain = 65536;  // particles per counting block
+
+}  // namespace
+
+void buildCompaction(long long N, const std::function<bool(long long)>& keep, Compaction& compaction) {
+    const long long blocks = (N + kCompactionGrain - 1) / kCompactionGrain;
+    compaction.compactId.assign(N, -1);
+
+    // Pass 1: survivors per block (marked with 0 for now)
+    std::vector<long long> offsets(blocks + 1, 0);
+    parallelBlocks(blocks, [&](long long b, int) {
+        long long first = b * kCompactionGrain;
+        long long last = std::min(N, first + kCompactionGrain);
+        long long count = 0;
+        for (long long id = first; id < last; ++id) {
+            if (keep(id)) {
+                compaction.compactId[id] = 0;
+                count++;
+            }
+        }
+        offsets[b + 1] = count;
+    });
+
+    // Exclusive scan over the blocks
+    for (long long b = 0; b < blocks; ++b) {
+        offsets[b + 1] += offsets[b];
+    }
+
+    // Pass 2: every block numbers its survivors from its offset
+    compaction.originalId.resize(offsets[blocks]);
+    parallelBlocks(blocks, [&](long long b, int) {
+        long long first = b * kCompactionGrain;
+        long long last = std::min(N, first + kCompactionGrain);
+        long long next = offsets[b];
+        for (long long id = first; id < last; ++id) {
+            if (compaction.compactId[id] == 0) {
+                compaction.compactId[id] = next;
+                compaction.originalId[next] = id;
+                next++;
+            }
+        }
+    });
+}
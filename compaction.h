@@ -0,0 +1,44 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+
+// Compaction of dead particles (compact = 1 in the job file).
+//
+// After the damage stage, particles without a single intact bond (fully
+// damaged or isolated) carry no load. Compaction drops them and renumbers
+// the rest in grid order, keeping the map in both directions. The bond graph
+// is compacted with them, so the solvers and the VTK output only touch the
+// reduced set. Grid-structured stages (nonlocal averaging, the Zarr store)
+// scatter the reduced fields back onto the grid.
+
+struct Compaction {
+    std::vector<long long> originalId;  // per kept particle: id in the grid
+    std::vector<long long> compactId;   // per grid particle: id in the reduced set (-1 = removed)
+
+    long long kept() const { return static_cast<long long>(originalId.size()); }
+    long long removed() const { return static_cast<long long>(compactId.size()) - kept(); }
+};
+
+// Parallel stream compaction of the N grid particles for which keep(id) is
+// true: every block counts its survivors, an exclusive scan gives each block
+// its output range, and the blocks then write their ids in order
+void buildCompaction(long long N, const std::function<bool(long long)>& keep, Compaction& compaction);
+
+// Values of the kept particles, in reduced order
+template <typename T>
+std::vector<T> gatherKept(const Compaction& compaction, const std::vector<T>& full) {
+    std::vector<T> reduced(compaction.originalId.size());
+    for (size_t k = 0; k < reduced.size(); ++k) {
+        reduced[k] = full[compaction.originalId[k]];
+    }
+    return reduced;
+}
+
+// Reduced values written back to their grid particles; removed ones keep full
+template <typename T>
+void scatterKept(const Compaction& compaction, const std::vector<T>& reduced, std::vector<T>& full) {
+    for (size_t k = 0; k < reduced.size(); ++k) {
+        full[compaction.originalId[k]] = reduced[k];
+    }
+}
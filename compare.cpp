@@ -0,0 +1,752 @@
+#include "compare.h"
+
+#include "lz4_codec.h"
+#include "mapped_array.h"
+#include "parallel.h"
+#include "reduction.h"
+#include "vtk_output.h"
+#include "zarr_store.h"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <vector>
+
+namespace {
+
+const size_t kParseBlock = size_t(1) << 20;   // bytes of VTK text per parallel task
+const long long kRowGrain = 16;               // lattice rows per parallel task
+const long long kFitSamples = 1 << 20;        // points sampled for the lattice spacing fit
+const int kHistogramBins = 100;
+const double kBinEdgeTolerance = 1e-3;        // fraction of a bin: values this close below an edge count above it
+const int kRegions = 4;                       // regions per side
+const double kSameSpacing = 1e-6;             // relative dx difference treated as equal
+
+const float kAbsent = std::numeric_limits<float>::quiet_NaN();
+
+// Scalar field on the lattice points (i dx, j dx); NaN where the result has
+// no point. Values are float, as in both file formats.
+struct LatticeField {
+    int Nx = 0;
+    int Ny = 0;
+    double dx = 1.0;
+    long long points = 0;   // points present
+    std::vector<float> values;
+};
+
+// ---------------------------------------------------------------------------
+// VTK
+
+// Start and end of one line of the mapped text
+struct TextLine {
+    size_t begin = 0;
+    size_t end = 0;
+};
+
+// Section headers: lines that start with an upper-case letter. Number lines
+// never do ("nan" is lower case).
+std::vector<TextLine> headerLines(const char* text, size_t bytes) {
+    const long long blocks = static_cast<long long>((bytes + kParseBlock - 1) / kParseBlock);
+    std::vector<std::vector<TextLine>> found(blocks);
+    parallelFor(blocks, 1, [&](long long b0, long long b1) {
+        for (long long b = b0; b < b1; ++b) {
+            size_t p = b * kParseBlock;
+            const size_t last = std::min(bytes, p + kParseBlock);
+            if (p > 0) {
+                // Lines starting in this block
+                const void* nl = std::memchr(text + p - 1, '\n', last - p + 1);
+                p = nl ? static_cast<const char*>(nl) - text + 1 : last;
+            }
+            while (p < last) {
+                const void* nl = std::memchr(text + p, '\n', bytes - p);
+                size_t end = nl ? static_cast<const char*>(nl) - text : bytes;
+                if (text[p] >= 'A' && text[p] <= 'Z') {
+                    found[b].push_back({ p, end });
+                }
+                p = end + 1;
+            }
+        }
+    });
+    std::vector<TextLine> lines;
+    for (const std::vector<TextLine>& f : found) {
+        lines.insert(lines.end(), f.begin(), f.end());
+    }
+    return lines;
+}
+
+// Parses the first `columns` numbers of each of the `count` lines in
+// [begin, end) into out[c][line]. Blocks of lines are counted, then parsed,
+// in parallel.
+bool parseLines(const char* text, size_t begin, size_t end, long long count, int columns, float* const* out) {
+    // Block boundaries at line starts
+    std::vector<size_t> starts = { begin };
+    for (size_t p = begin + kParseBlock; p < end; p += kParseBlock) {
+        const void* nl = std::memchr(text + p - 1, '\n', end - p + 1);
+        size_t next = nl ? static_cast<const char*>(nl) - text + 1 : end;
+        if (next >= end) {
+            break;
+        }
+        if (next > starts.back()) {
+            starts.push_back(next);
+        }
+        p = next;
+    }
+    starts.push_back(end);
+    const long long blocks = static_cast<long long>(starts.size()) - 1;
+
+    std::vector<long long> firstLine(blocks + 1, 0);
+    parallelFor(blocks, 1, [&](long long b0, long long b1) {
+        for (long long b = b0; b < b1; ++b) {
+            const char* p = text + starts[b];
+            const char* last = text + starts[b + 1];
+            long long lines = std::count(p, last, '\n');
+            if (last > p && last[-1] != '\n') {
+                ++lines;
+            }
+            firstLine[b + 1] = lines;
+        }
+    });
+    for (long long b = 0; b < blocks; ++b) {
+        firstLine[b + 1] += firstLine[b];
+    }
+    if (firstLine[blocks] != count) {
+        std::cerr << "Error: expected " << count << " lines of values, found " << firstLine[blocks] << "\n";
+        return false;
+    }
+
+    std::vector<char> ok(blocks, 1);
+    parallelFor(blocks, 1, [&](long long b0, long long b1) {
+        for (long long b = b0; b < b1; ++b) {
+            const char* p = text + starts[b];
+            const char* last = text + starts[b + 1];
+            for (long long line = firstLine[b]; line < firstLine[b + 1]; ++line) {
+                for (int c = 0; c < columns; ++c) {
+                    while (p < last && (*p == ' ' || *p == '\t')) {
+                        ++p;
+                    }
+                    float v = 0.0f;
+                    std::from_chars_result r = std::from_chars(p, last, v);
+                    if (r.ec != std::errc()) {
+                        ok[b] = 0;
+                        return;
+                    }
+                    out[c][line] = v;
+                    p = r.ptr;
+                }
+                const void* nl = std::memchr(p, '\n', last - p);
+                p = nl ? static_cast<const char*>(nl) + 1 : last;
+            }
+        }
+    });
+    if (std::find(ok.begin(), ok.end(), 0) != ok.end()) {
+        std::cerr << "Error: malformed number in a VTK data section\n";
+        return false;
+    }
+    return true;
+}
+
+// Lattice spacing of the point coordinates. Points come in row order, so
+// the median positive x step of consecutive points is a first guess. Least
+// squares x = i dx, y = j dx over ever larger index ranges refine it, so
+// rounding stays exact even on large jittered lattices.
+double fitSpacing(const std::vector<float>& x, const std::vector<float>& y) {
+    const long long N = static_cast<long long>(x.size());
+    const long long samples = std::min<long long>(N - 1, kFitSamples);
+    std::vector<double> steps;
+    for (int axis = 0; axis < 2 && steps.empty(); ++axis) {
+        const std::vector<float>& along = axis ? y : x;
+        for (long long s = 0; s < samples; ++s) {
+            long long k = s * (N - 1) / samples;
+            double d = along[k + 1] - along[k];
+            if (d > 0.0) {
+                steps.push_back(d);
+            }
+        }
+    }
+    if (steps.empty()) {
+        return 1.0;
+    }
+    std::nth_element(steps.begin(), steps.begin() + steps.size() / 2, steps.end());
+    double dx = steps[steps.size() / 2];
+
+    const long long fitted = std::min<long long>(N, kFitSamples);
+    const double extent = std::max(*std::max_element(x.begin(), x.end()), *std::max_element(y.begin(), y.end()));
+    for (double limit = 4.0; ; limit *= 16.0) {
+        // Selected by index, not by coordinate, so jitter does not bias the fit
+        const double estimate = dx;
+        auto index = [&](float c) {
+            double i = std::round(c / estimate);
+            return i < limit ? i : 0.0;
+        };
+        double xi = deterministicSum(fitted, [&](long long s) {
+            long long k = s * N / fitted;
+            return index(x[k]) * x[k] + index(y[k]) * y[k];
+        });
+        double ii = deterministicSum(fitted, [&](long long s) {
+            long long k = s * N / fitted;
+            double i = index(x[k]);
+            double j = index(y[k]);
+            return i * i + j * j;
+        });
+        if (ii > 0.0) {
+            dx = xi / ii;
+        }
+        if (limit * estimate > extent) {
+            return dx;
+        }
+    }
+}
+
+bool loadVtk(const std::string& path, const std::string& field, LatticeField& out) {
+    MappedRegion file;
+    if (!file.mapFile(path)) {
+        return false;
+    }
+    file.adviseSequential();
+    const char* text = static_cast<const char*>(file.data());
+    const size_t bytes = file.bytes();
+    std::vector<TextLine> headers = headerLines(text, bytes);
+
+    auto lineText = [&](size_t h) { return std::string(text + headers[h].begin, text + headers[h].end); };
+    auto sectionEnd = [&](size_t h) { return h + 1 < headers.size() ? headers[h + 1].begin : bytes; };
+
+    long long N = -1;
+    std::vector<float> x, y, values;
+    bool foundField = false;
+    std::string available;
+    for (size_t h = 0; h < headers.size(); ++h) {
+        std::istringstream header(lineText(h));
+        std::string keyword;
+        header >> keyword;
+        if (keyword == "POINTS") {
+            header >> N;
+            if (!header || N < 0) {
+                break;
+            }
+            x.resize(N);
+            y.resize(N);
+            float* columns[2] = { x.data(), y.data() };
+            if (!parseLines(text, headers[h].end + 1, sectionEnd(h), N, 2, columns)) {
+                return false;
+            }
+        }
+        else if (keyword == "SCALARS" && N >= 0) {
+            std::string name;
+            header >> name;
+            available += (available.empty() ? "" : ", ") + name;
+            if (name != field || h + 1 >= headers.size()) {
+                continue;
+            }
+            // Values follow the LOOKUP_TABLE line
+            values.resize(N);
+            float* columns[1] = { values.data() };
+            if (!parseLines(text, headers[h + 1].end + 1, sectionEnd(h + 1), N, 1, columns)) {
+                return false;
+            }
+            foundField = true;
+        }
+    }
+    if (N < 0) {
+        std::cerr << "Error: " << path << " has no POINTS section\n";
+        return false;
+    }
+    if (!foundField) {
+        std::cerr << "Error: " << path << " has no field " << field << " (fields: " << available << ")\n";
+        return false;
+    }
+
+    // Lattice indices of the points
+    out.dx = fitSpacing(x, y);
+    std::vector<int> gi(N), gj(N);
+    const long long blocks = (N + kReductionLeaf - 1) / kReductionLeaf;
+    std::vector<int> maxI(blocks, -1), maxJ(blocks, -1);
+    std::vector<char> inside(blocks, 1);
+    parallelFor(blocks, 1, [&](long long b0, long long b1) {
+        for (long long b = b0; b < b1; ++b) {
+            for (long long k = b * kReductionLeaf; k < std::min(N, (b + 1) * kReductionLeaf); ++k) {
+                double i = std::round(x[k] / out.dx);
+                double j = std::round(y[k] / out.dx);
+                if (!(i >= 0.0 && j >= 0.0 && i < 1e9 && j < 1e9)) {
+                    inside[b] = 0;
+                    continue;
+                }
+                gi[k] = static_cast<int>(i);
+                gj[k] = static_cast<int>(j);
+                maxI[b] = std::max(maxI[b], gi[k]);
+                maxJ[b] = std::max(maxJ[b], gj[k]);
+            }
+        }
+    });
+    if (std::find(inside.begin(), inside.end(), 0) != inside.end()) {
+        std::cerr << "Error: points of " << path << " lie outside the lattice of spacing " << out.dx << "\n";
+        return false;
+    }
+    out.Nx = *std::max_element(maxI.begin(), maxI.end()) + 1;
+    out.Ny = *std::max_element(maxJ.begin(), maxJ.end()) + 1;
+
+    // Scatter; two points on one lattice site mean the points are no lattice
+    const long long cells = static_cast<long long>(out.Nx) * out.Ny;
+    out.values.assign(cells, kAbsent);
+    std::vector<uint8_t> present(cells, 0);
+    parallelFor(N, kReductionLeaf, [&](long long k0, long long k1) {
+        for (long long k = k0; k < k1; ++k) {
+            long long cell = static_cast<long long>(gj[k]) * out.Nx + gi[k];
+            out.values[cell] = values[k];
+            present[cell] = 1;
+        }
+    });
+    out.points = exactIntegerSum(cells, [&](long long c) { return present[c]; });
+    if (out.points != N) {
+        std::cerr << "Error: the points of " << path << " do not lie on a lattice (dx = " << out.dx << ")\n";
+        return false;
+    }
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Zarr
+
+bool readFile(const std::filesystem::path& path, std::string& contents) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        return false;
+    }
+    std::ostringstream buffer;
+    buffer << in.rdbuf();
+    contents = buffer.str();
+    return true;
+}
+
+// Text after "key": in a flat JSON object (empty if the key is missing)
+std::string jsonValue(const std::string& json, const std::string& key) {
+    size_t p = json.find("\"" + key + "\"");
+    if (p == std::string::npos || (p = json.find(':', p)) == std::string::npos) {
+        return std::string();
+    }
+    return json.substr(p + 1);
+}
+
+// The two integers of "key": [a, b]
+bool jsonPair(const std::string& json, const std::string& key, long long& a, long long& b) {
+    std::string value = jsonValue(json, key);
+    std::replace(value.begin(), value.end(), ',', ' ');
+    std::istringstream in(value);
+    char bracket = 0;
+    in >> bracket >> a >> b;
+    return in && bracket == '[';
+}
+
+bool loadZarr(const std::string& path, const std::string& field, LatticeField& out) {
+    namespace fs = std::filesystem;
+    const fs::path arrayDir = fs::path(path) / field;
+    std::string meta, attrs;
+    if (!readFile(arrayDir / ".zarray", meta)) {
+        std::cerr << "Error: " << path << " has no array " << field << "\n";
+        return false;
+    }
+    long long Ny = 0, Nx = 0, chunkY = 0, chunkX = 0;
+    std::string dtype = jsonValue(meta, "dtype");
+    const bool integer = dtype.find("<i4") != std::string::npos;
+    if (!jsonPair(meta, "shape", Ny, Nx) || !jsonPair(meta, "chunks", chunkY, chunkX) ||
+        Nx <= 0 || Ny <= 0 || chunkX <= 0 || chunkY <= 0 ||
+        (!integer && dtype.find("<f4") == std::string::npos) ||
+        meta.find("\"shuffle\"") == std::string::npos || meta.find("\"lz4\"") == std::string::npos) {
+        std::cerr << "Error: " << path << "/" << field << " is not a float32/int32 array with shuffle + lz4\n";
+        return false;
+    }
+    out.Nx = static_cast<int>(Nx);
+    out.Ny = static_cast<int>(Ny);
+    out.dx = 1.0;
+    if (readFile(fs::path(path) / ".zattrs", attrs)) {
+        std::istringstream in(jsonValue(attrs, "dx"));
+        double dx = 0.0;
+        if (in >> dx && dx > 0.0) {
+            out.dx = dx;
+        }
+    }
+
+    // Missing chunks hold the fill value 0
+    out.values.assign(Nx * Ny, 0.0f);
+    const long long chunksX = (Nx + chunkX - 1) / chunkX;
+    const long long chunksY = (Ny + chunkY - 1) / chunkY;
+    const size_t chunkBytes = static_cast<size_t>(chunkX * chunkY * 4);
+    std::vector<char> ok(chunksX * chunksY, 1);
+    parallelFor(chunksX * chunksY, 1, [&](long long c0, long long c1) {
+        std::string encoded;
+        std::vector<uint8_t> shuffled, raw(chunkBytes);
+        for (long long c = c0; c < c1; ++c) {
+            long long cy = c / chunksX;
+            long long cx = c % chunksX;
+            if (!readFile(arrayDir / (std::to_string(cy) + "." + std::to_string(cx)), encoded)) {
+                continue;
+            }
+            if (!lz4Decompress(reinterpret_cast<const uint8_t*>(encoded.data()), encoded.size(), shuffled) ||
+                shuffled.size() != chunkBytes) {
+                ok[c] = 0;
+                continue;
+            }
+            byteUnshuffle(shuffled.data(), raw.data(), chunkBytes / 4, 4);
+            long long j1 = std::min(Ny, (cy + 1) * chunkY);
+            long long i1 = std::min(Nx, (cx + 1) * chunkX);
+            for (long long j = cy * chunkY; j < j1; ++j) {
+                const uint8_t* row = &raw[static_cast<size_t>((j - cy * chunkY) * chunkX * 4)];
+                for (long long i = cx * chunkX; i < i1; ++i) {
+                    const uint8_t* e = row + (i - cx * chunkX) * 4;
+                    uint32_t bits = e[0] | (e[1] << 8) | (e[2] << 16) | (static_cast<uint32_t>(e[3]) << 24);
+                    float v;
+                    if (integer) {
+                        int32_t n;
+                        std::memcpy(&n, &bits, 4);
+                        v = static_cast<float>(n);
+                    }
+                    else {
+                        std::memcpy(&v, &bits, 4);
+                    }
+                    out.values[j * Nx + i] = v;
+                }
+            }
+        }
+    });
+    if (std::find(ok.begin(), ok.end(), 0) != ok.end()) {
+        std::cerr << "Error: corrupt chunks in " << path << "/" << field << "\n";
+        return false;
+    }
+    out.points = Nx * Ny;
+    return true;
+}
+
+bool loadResult(const std::string& path, const std::string& field, LatticeField& out, double& seconds) {
+    auto start = std::chrono::steady_clock::now();
+    std::error_code ec;
+    bool ok = std::filesystem::is_directory(path, ec) ? loadZarr(path, field, out) : loadVtk(path, field, out);
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return ok;
+}
+
+// ---------------------------------------------------------------------------
+// Comparison
+
+// Value of a field at the points (i h, j h) of the common lattice: a direct
+// lookup on its own lattice, else bilinear interpolation over the present
+// corners of the enclosing cell
+struct Sampler {
+    const LatticeField* field = nullptr;
+    double ratio = 1.0;   // h / field->dx
+    bool direct = true;
+
+    float at(int i, int j) const {
+        const LatticeField& f = *field;
+        if (direct) {
+            return f.values[static_cast<long long>(j) * f.Nx + i];
+        }
+        double u = i * ratio;
+        double v = j * ratio;
+        int i0 = std::min(static_cast<int>(u), std::max(0, f.Nx - 2));
+        int j0 = std::min(static_cast<int>(v), std::max(0, f.Ny - 2));
+        double tu = u - i0;
+        double tv = v - j0;
+        double sum = 0.0;
+        double weight = 0.0;
+        for (int c = 0; c < 4; ++c) {
+            int i1 = std::min(i0 + (c & 1), f.Nx - 1);
+            int j1 = std::min(j0 + (c >> 1), f.Ny - 1);
+            double w = ((c & 1) ? tu : 1.0 - tu) * ((c >> 1) ? tv : 1.0 - tv);
+            float value = f.values[static_cast<long long>(j1) * f.Nx + i1];
+            if (w > 0.0 && !std::isnan(value)) {
+                sum += w * value;
+                weight += w;
+            }
+        }
+        return weight > 0.0 ? static_cast<float>(sum / weight) : kAbsent;
+    }
+};
+
+// Difference statistics of a set of points
+struct ErrorStats {
+    long long count = 0;
+    long long onlyFirst = 0;
+    long long onlySecond = 0;
+    double sumFirst = 0.0;
+    double sumSecond = 0.0;
+    double sumAbs = 0.0;
+    double sumSq = 0.0;
+    double sumSqFirst = 0.0;
+    double maxAbs = 0.0;
+    long long maxAt = -1;
+    double lo = std::numeric_limits<double>::infinity();
+    double hi = -std::numeric_limits<double>::infinity();
+
+    void add(float a, float b, long long at) {
+        const bool hasA = !std::isnan(a);
+        const bool hasB = !std::isnan(b);
+        if (!hasA || !hasB) {
+            onlyFirst += hasA;
+            onlySecond += hasB;
+            return;
+        }
+        double d = static_cast<double>(b) - a;
+        ++count;
+        sumFirst += a;
+        sumSecond += b;
+        sumAbs += std::fabs(d);
+        sumSq += d * d;
+        sumSqFirst += static_cast<double>(a) * a;
+        if (std::fabs(d) > maxAbs || maxAt < 0) {
+            maxAbs = std::fabs(d);
+            maxAt = at;
+        }
+        lo = std::min(lo, static_cast<double>(std::min(a, b)));
+        hi = std::max(hi, static_cast<double>(std::max(a, b)));
+    }
+
+    void merge(const ErrorStats& o) {
+        count += o.count;
+        onlyFirst += o.onlyFirst;
+        onlySecond += o.onlySecond;
+        sumFirst += o.sumFirst;
+        sumSecond += o.sumSecond;
+        sumAbs += o.sumAbs;
+        sumSq += o.sumSq;
+        sumSqFirst += o.sumSqFirst;
+        if (o.maxAt >= 0 && (o.maxAbs > maxAbs || maxAt < 0)) {
+            maxAbs = o.maxAbs;
+            maxAt = o.maxAt;
+        }
+        lo = std::min(lo, o.lo);
+        hi = std::max(hi, o.hi);
+    }
+
+    double l1() const { return count ? sumAbs / count : 0.0; }
+    double l2() const { return count ? std::sqrt(sumSq / count) : 0.0; }
+};
+
+bool writeDifference(const std::string& path, int Nx, int Ny, double h, const Sampler& first,
+                     const Sampler& second) {
+    const long long cells = static_cast<long long>(Nx) * Ny;
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    const bool zarr = std::filesystem::path(path).extension() == ".zarr";
+    std::vector<double> a, b, d;
+    std::vector<Particle> points;
+    if (zarr) {
+        // The full lattice; NaN where a result has no point
+        a.resize(cells);
+        b.resize(cells);
+        d.resize(cells);
+        parallelFor(Ny, kRowGrain, [&](long long j0, long long j1) {
+            for (long long j = j0; j < j1; ++j) {
+                for (int i = 0; i < Nx; ++i) {
+                    long long c = j * Nx + i;
+                    float va = first.at(i, static_cast<int>(j));
+                    float vb = second.at(i, static_cast<int>(j));
+                    a[c] = std::isnan(va) ? nan : va;
+                    b[c] = std::isnan(vb) ? nan : vb;
+                    d[c] = (std::isnan(va) || std::isnan(vb)) ? nan : static_cast<double>(vb) - va;
+                }
+            }
+        });
+        std::vector<ZarrField> fields = { { "first", &a, nullptr }, { "second", &b, nullptr },
+                                          { "difference", &d, nullptr } };
+        ZarrStats stats;
+        if (!writeZarrStore(path, Nx, Ny, 64, fields, { { "dx", h } }, stats)) {
+            return false;
+        }
+    }
+    else {
+        // The points present in both results
+        for (int j = 0; j < Ny; ++j) {
+            for (int i = 0; i < Nx; ++i) {
+                float va = first.at(i, j);
+                float vb = second.at(i, j);
+                if (!std::isnan(va) && !std::isnan(vb)) {
+                    points.push_back({ i * h, j * h });
+                    a.push_back(va);
+                    b.push_back(vb);
+                    d.push_back(static_cast<double>(vb) - va);
+                }
+            }
+        }
+        std::vector<VtkField> fields = { { "first", &a }, { "second", &b }, { "difference", &d } };
+        OutputStats stats;
+        if (!writeVtkFile(path, points, fields, OutputOptions(), stats)) {
+            return false;
+        }
+    }
+    std::cout << "Difference field written to: " << path << "\n";
+    return true;
+}
+
+void describe(const char* label, const std::string& path, const LatticeField& f, double seconds) {
+    std::cout << label << path << "  (" << f.Nx << " x " << f.Ny << ", dx = " << f.dx << ", "
+        << f.points << " points, read in " << std::fixed << std::setprecision(3) << seconds << " s)\n";
+    std::cout.unsetf(std::ios::floatfield);
+    std::cout << std::setprecision(6);
+}
+
+}  // namespace
+
+int runComparison(const std::string& first, const std::string& second, const std::string& field,
+                  const std::string& differenceOutput) {
+    LatticeField fa, fb;
+    double secondsA = 0.0, secondsB = 0.0;
+    if (!loadResult(first, field, fa, secondsA) || !loadResult(second, field, fb, secondsB)) {
+        return 1;
+    }
+    auto start = std::chrono::steady_clock::now();
+
+    std::cout << "\n===== Field comparison: " << field << " =====\n";
+    describe("first:  ", first, fa, secondsA);
+    describe("second: ", second, fb, secondsB);
+
+    // Common lattice: the coarser one, over the extent both cover
+    Sampler sa, sb;
+    sa.field = &fa;
+    sb.field = &fb;
+    int Nx = std::min(fa.Nx, fb.Nx);
+    int Ny = std::min(fa.Ny, fb.Ny);
+    double h = fa.dx;
+    if (std::fabs(fa.dx - fb.dx) > kSameSpacing * std::max(fa.dx, fb.dx)) {
+        const bool firstCoarse = fa.dx > fb.dx;
+        const LatticeField& coarse = firstCoarse ? fa : fb;
+        const LatticeField& fine = firstCoarse ? fb : fa;
+        Sampler& resampled = firstCoarse ? sb : sa;
+        h = coarse.dx;
+        resampled.direct = false;
+        resampled.ratio = h / fine.dx;
+        Nx = std::min(coarse.Nx, static_cast<int>(std::floor((fine.Nx - 1) / resampled.ratio + 1e-9)) + 1);
+        Ny = std::min(coarse.Ny, static_cast<int>(std::floor((fine.Ny - 1) / resampled.ratio + 1e-9)) + 1);
+        std::cout << "Spacings differ: the " << (firstCoarse ? "second" : "first")
+            << " field is interpolated bilinearly onto the lattice of the other\n";
+    }
+    else if (fa.Nx != fb.Nx || fa.Ny != fb.Ny) {
+        std::cout << "Lattices differ in size: comparing the common " << Nx << " x " << Ny << " points\n";
+    }
+
+    // Per-row statistics of each region column, merged in row order so the
+    // result does not depend on the thread count
+    std::vector<ErrorStats> rows(static_cast<size_t>(Ny) * kRegions);
+    parallelFor(Ny, kRowGrain, [&](long long j0, long long j1) {
+        for (long long j = j0; j < j1; ++j) {
+            for (int r = 0; r < kRegions; ++r) {
+                ErrorStats& s = rows[j * kRegions + r];
+                int i1 = static_cast<int>(static_cast<long long>(Nx) * (r + 1) / kRegions);
+                for (int i = static_cast<int>(static_cast<long long>(Nx) * r / kRegions); i < i1; ++i) {
+                    s.add(sa.at(i, static_cast<int>(j)), sb.at(i, static_cast<int>(j)), j * Nx + i);
+                }
+            }
+        }
+    });
+    ErrorStats total;
+    std::vector<ErrorStats> regions(kRegions * kRegions);
+    for (int j = 0; j < Ny; ++j) {
+        int ry = static_cast<int>(static_cast<long long>(j) * kRegions / Ny);
+        for (int r = 0; r < kRegions; ++r) {
+            regions[ry * kRegions + r].merge(rows[static_cast<size_t>(j) * kRegions + r]);
+            total.merge(rows[static_cast<size_t>(j) * kRegions + r]);
+        }
+    }
+    if (total.count == 0) {
+        std::cerr << "Error: the results have no points in common\n";
+        return 1;
+    }
+
+    // Value histograms of both fields on their common range. Lattice values
+    // such as damage k / N fall on bin edges, and the float rounding of one
+    // format must not move them to the bin below.
+    const double lo = total.lo;
+    const double width = (total.hi > lo) ? (total.hi - lo) / kHistogramBins : 1.0;
+    auto bin = [&](float v) {
+        return std::clamp(static_cast<int>(std::floor((v - lo) / width + kBinEdgeTolerance)), 0, kHistogramBins - 1);
+    };
+    const long long rowBlocks = (Ny + kRowGrain - 1) / kRowGrain;
+    std::vector<long long> counts(static_cast<size_t>(rowBlocks) * 2 * kHistogramBins, 0);
+    std::vector<float> sortedA(static_cast<size_t>(Nx) * Ny, kAbsent);
+    std::vector<float> sortedB(static_cast<size_t>(Nx) * Ny, kAbsent);
+    parallelFor(rowBlocks, 1, [&](long long b0, long long b1) {
+        for (long long b = b0; b < b1; ++b) {
+            long long* histogram = &counts[static_cast<size_t>(b) * 2 * kHistogramBins];
+            for (long long j = b * kRowGrain; j < std::min<long long>(Ny, (b + 1) * kRowGrain); ++j) {
+                for (int i = 0; i < Nx; ++i) {
+                    float va = sa.at(i, static_cast<int>(j));
+                    float vb = sb.at(i, static_cast<int>(j));
+                    if (std::isnan(va) || std::isnan(vb)) {
+                        continue;
+                    }
+                    ++histogram[bin(va)];
+                    ++histogram[kHistogramBins + bin(vb)];
+                    sortedA[j * Nx + i] = va;
+                    sortedB[j * Nx + i] = vb;
+                }
+            }
+        }
+    });
+    double variation = 0.0;
+    for (int k = 0; k < kHistogramBins; ++k) {
+        long long na = 0, nb = 0;
+        for (long long b = 0; b < rowBlocks; ++b) {
+            na += counts[static_cast<size_t>(b) * 2 * kHistogramBins + k];
+            nb += counts[static_cast<size_t>(b) * 2 * kHistogramBins + kHistogramBins + k];
+        }
+        variation += 0.5 * std::fabs(static_cast<double>(na - nb)) / total.count;
+    }
+
+    // Earth mover's distance of the two value distributions, exact: the mean
+    // difference of the sorted values, independent of any binning
+    auto isAbsent = [](float v) { return std::isnan(v); };
+    sortedA.erase(std::remove_if(sortedA.begin(), sortedA.end(), isAbsent), sortedA.end());
+    sortedB.erase(std::remove_if(sortedB.begin(), sortedB.end(), isAbsent), sortedB.end());
+    std::sort(sortedA.begin(), sortedA.end());
+    std::sort(sortedB.begin(), sortedB.end());
+    const long long paired = static_cast<long long>(sortedA.size());
+    const double earthMover = (paired > 0) ? deterministicSum(paired, [&](long long k) {
+        return std::fabs(static_cast<double>(sortedB[k]) - static_cast<double>(sortedA[k]));
+    }) / paired : 0.0;
+
+    std::cout << "Compared on " << Nx << " x " << Ny << " points (dx = " << h << "): " << total.count
+        << " in both, " << total.onlyFirst << " only in the first, " << total.onlySecond << " only in the second\n";
+    std::cout << "Mean " << field << ": first " << total.sumFirst / total.count
+        << ", second " << total.sumSecond / total.count << "\n";
+    std::cout << "Difference (second - first):\n";
+    std::cout << "  L1 (mean |d|)      " << total.l1() << "\n";
+    std::cout << "  L2 (rms d)         " << total.l2() << "\n";
+    if (total.sumSqFirst > 0.0) {
+        std::cout << "  L2 relative        " << std::sqrt(total.sumSq / total.sumSqFirst) << "\n";
+    }
+    std::cout << "  Linf (max |d|)     " << total.maxAbs << " at (" << (total.maxAt % Nx) * h << ", "
+        << (total.maxAt / Nx) * h << ")\n";
+    std::cout << "Histograms (" << kHistogramBins << " bins on [" << lo << ", " << lo + width * kHistogramBins
+        << "]): total variation " << variation << ", earth mover's distance " << earthMover << "\n";
+
+    std::cout << "Per region (" << kRegions << " x " << kRegions << "):\n" << std::left << std::setw(26) << "  x range"
+        << std::setw(24) << "y range" << std::right << std::setw(12) << "points" << std::setw(14) << "L2"
+        << std::setw(14) << "Linf" << "\n";
+    for (int ry = 0; ry < kRegions; ++ry) {
+        for (int rx = 0; rx < kRegions; ++rx) {
+            const ErrorStats& s = regions[ry * kRegions + rx];
+            std::ostringstream xs, ys;
+            xs << "  [" << (static_cast<long long>(Nx) * rx / kRegions) * h << ", "
+               << (static_cast<long long>(Nx) * (rx + 1) / kRegions - 1) * h << "]";
+            ys << "[" << (static_cast<long long>(Ny) * ry / kRegions) * h << ", "
+               << (static_cast<long long>(Ny) * (ry + 1) / kRegions - 1) * h << "]";
+            std::cout << std::left << std::setw(26) << xs.str() << std::setw(24) << ys.str() << std::right
+                << std::setw(12) << s.count << std::setw(14) << s.l2() << std::setw(14) << s.maxAbs << "\n";
+        }
+    }
+    std::cout << "Compared in " << std::fixed << std::setprecision(3)
+        << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << " s\n";
+    std::cout.unsetf(std::ios::floatfield);
+    std::cout << std::setprecision(6);
+
+    if (!differenceOutput.empty() && !writeDifference(differenceOutput, Nx, Ny, h, sa, sb)) {
+        return 1;
+    }
+    return 0;
+}
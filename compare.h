@@ -0,0 +1,25 @@
+#pragma once
+
+#include <string>
+
+// Field comparison of two results
+// (Peridynamic --compare <first> <second> [field] [difference output]).
+//
+// A result is a VTK file written by this program or a Zarr store (a
+// directory). VTK files are memory-mapped and parsed in parallel blocks of
+// lines; Zarr chunks are decoded in parallel. VTK points are placed on their
+// lattice (i dx, j dx) by rounding, with dx fitted to the coordinates, so
+// jittered and compacted outputs work too. Points missing from a result
+// (removed by compaction) are left out of the norms and counted.
+//
+// When the spacings differ, the finer field is interpolated bilinearly at
+// the points of the coarser lattice, over the extent both cover. The report
+// gives the L1, L2 and Linf norms of the difference (second - first), the
+// distance between the value histograms (total variation and earth mover's
+// distance) and the norms per region of a 4 x 4 split of the specimen.
+// A difference output ending in .zarr becomes a Zarr store, anything else a
+// VTK file, with the fields `first`, `second` and `difference`.
+//
+// Returns 0 on success and 1 on failure.
+int runComparison(const std::string& first, const std::string& second, const std::string& field,
+                  const std::string& differenceOutput);
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+
+// Coupling of the peridynamic region of interest to a local far field
+// (coupling_roi = x0 y0 x1 y1 in the job file).
+//
+// Inside the region of interest every particle carries the full m-stencil.
+// Beyond it the lattice keeps only nearest-neighbor bonds (offsets with
+// |di|, |dj| <= 1), a local continuum on the same grid. In a blending zone
+// of width coupling_blend around the region the nonlocal bonds fade out:
+// the weight beta falls linearly from 1 at the region to 0 at the outer
+// edge. A bond longer than nearest-neighbor exists when beta at its midpoint
+// is positive. Midpoints are exact in floating point, so both ends of a
+// bond agree on it.
+//
+// Stiffness (fatigue solver) follows the morphing approach: nonlocal bonds
+// are scaled by beta, and nearest-neighbor bonds by beta + (1 - beta) * s.
+// The factor s gives the nearest-neighbor lattice the uniaxial stiffness
+// of the full stencil.
+
+struct CouplingOptions {
+    bool enabled = false;
+    double x0 = 0.0, y0 = 0.0, x1 = 0.0, y1 = 0.0;  // region of interest
+    double blend = -1.0;                            // blending width (-1 = horizon)
+};
+
+class CouplingZone {
+public:
+    // Region and width in physical units, converted to grid cells of size dx
+    CouplingZone(const CouplingOptions& options, double dx, double delta)
+        : i0_(options.x0 / dx), j0_(options.y0 / dx), i1_(options.x1 / dx), j1_(options.y1 / dx),
+          blend_((options.blend >= 0.0 ? options.blend : delta) / dx) {}
+
+    // Weight of the nonlocal model at grid coordinates (x, y)
+    double weight(double x, double y) const {
+        double ox = std::max({ i0_ - x, 0.0, x - i1_ });
+        double oy = std::max({ j0_ - y, 0.0, y - j1_ });
+        if (ox == 0.0 && oy == 0.0) {
+            return 1.0;
+        }
+        if (blend_ <= 0.0) {
+            return 0.0;
+        }
+        return std::max(0.0, 1.0 - std::sqrt(ox * ox + oy * oy) / blend_);
+    }
+
+    static bool nearestNeighbor(int di, int dj) {
+        return std::abs(di) <= 1 && std::abs(dj) <= 1;
+    }
+
+    // Columns [first, last) of row j that may hold bonds longer than
+    // nearest-neighbor with a stencil of the given reach (in cells); the rest
+    // of the row keeps only nearest-neighbor bonds. Midpoints lie within
+    // reach / 2 of a particle, so a margin of blend + reach is safe.
+    void nonlocalSpan(int j, int reach, int Nx, int& first, int& last) const {
+        const double margin = blend_ + reach;
+        if (j < j0_ - margin || j > j1_ + margin) {
+            first = last = 0;
+            return;
+        }
+        first = static_cast<int>(std::clamp(std::floor(i0_ - margin), 0.0, static_cast<double>(Nx)));
+        last = static_cast<int>(std::clamp(std::ceil(i1_ + margin) + 1.0, 0.0, static_cast<double>(Nx)));
+    }
+
+    // Whether the bond from grid point (i, j) along (di, dj) exists
+    bool hasBond(int i, int j, int di, int dj) const {
+        return nearestNeighbor(di, dj) || weight(i + 0.5 * di, j + 0.5 * dj) > 0.0;
+    }
+
+private:
+    double i0_, j0_, i1_, j1_;
+    double blend_;
+};
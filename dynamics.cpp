@@ -0,0 +1,525 @@
+#include "dynamics.h"
+
+#include "parallel.h"
+#include "reduction.h"
+#include "refinement.h"
+#include "tension_problem.h"
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+
+namespace {
+
+const double kBeta = 0.25;                 // Newmark average acceleration
+const double kGamma = 0.5;
+const double kNewtonTolerance = 1e-6;      // residual relative to the force of the final strain
+const int kMaxNewtonIterations = 25;       // per solve of one bond set
+const int kMaxFailureRounds = 16;          // re-solves of a step while bonds fail at its solution
+const double kForcingTerm = 1e-3;          // GMRES stops at this fraction of the Newton residual
+const int kRestart = 30;                   // GMRES basis size
+const int kMaxKrylovIterations = 2000;     // per Newton iteration
+const double kDifferenceStep = 1e-7;       // finite-difference step of J v (about sqrt of double epsilon)
+const double kSufficientDecrease = 1e-4;   // line search: |R| must fall by this fraction of the step
+const double kMinLineSearch = 1.0 / 64.0;  // shortest accepted fraction of a Newton step
+const long long kVectorGrain = 16384;
+
+// y += a * x
+void axpy(double a, const std::vector<double>& x, std::vector<double>& y) {
+    parallelFor(static_cast<long long>(y.size()), kVectorGrain, [&](long long i0, long long i1) {
+        for (long long i = i0; i < i1; ++i) {
+            y[i] += a * x[i];
+        }
+    });
+}
+
+// Explicit (central difference) stability limit 2 / omega_max, with
+// omega_max^2 bounded by the largest absolute row sum of the intact
+// stiffness over the mass (Gershgorin)
+double explicitStep(const TensionProblem& problem) {
+    const BondGraph& graph = problem.graph;
+    std::vector<double> rowSum(graph.particles(), 0.0);
+    graph.forEachBlock([&](long long first, long long last) {
+        for (long long id = first; id < last; ++id) {
+            double sx = 0.0;
+            double sy = 0.0;
+            for (long long b = graph.offsets[id]; b < graph.offsets[id + 1]; ++b) {
+                size_t k = problem.bondOffset[b];
+                double w = problem.scale(b);
+                double xy = std::abs(problem.table.xy[k]);
+                sx += w * (problem.table.xx[k] + xy);
+                sy += w * (problem.table.yy[k] + xy);
+            }
+            rowSum[id] = 2.0 * std::max(sx, sy) / problem.massOf(id);
+        }
+    });
+    double largest = rowSum.empty() ? 0.0 : *std::max_element(rowSum.begin(), rowSum.end());
+    return (largest > 0.0) ? 2.0 / std::sqrt(largest) : 1.0;
+}
+
+// Breaks every intact bond stretched beyond criticalStretch by u; returns
+// the number of directed bonds broken
+long long breakOverloaded(const TensionProblem& problem, BondGraph& graph, const std::vector<double>& u,
+                          double criticalStretch) {
+    if (criticalStretch <= 0.0) {
+        return 0;
+    }
+    std::vector<int> perParticle(graph.particles(), 0);
+    graph.forEachBlock([&](long long first, long long last) {
+        for (long long id = first; id < last; ++id) {
+            int n = 0;
+            graph.forEachBond(id, [&](long long b, long long nid) {
+                if (!graph.broken[b] && problem.stretch(problem.table, u, id, nid, b) > criticalStretch) {
+                    graph.broken[b] = 1;
+                    n++;
+                }
+            });
+            perParticle[id] = n;
+        }
+    });
+    return exactIntegerSum(graph.particles(), [&](long long i) { return perParticle[i]; });
+}
+
+// Right-preconditioned restarted GMRES on J d = b from d = 0, with the
+// Jacobi preconditioner invDiag; returns the iteration count, or -1 if
+// |b - J d| > limit after kMaxKrylovIterations
+template <typename Apply>
+int gmres(const TensionProblem& problem, const Apply& applyJ, const std::vector<double>& invDiag,
+          const std::vector<double>& b, double limit, std::vector<double>& d) {
+    const size_t n = b.size();
+    const int m = kRestart;
+    d.assign(n, 0.0);
+    std::vector<std::vector<double>> V(m + 1, std::vector<double>(n));
+    std::vector<double> H(static_cast<size_t>(m + 1) * m), cs(m), sn(m), g(m + 1), y(m);
+    auto h = [&](int i, int k) -> double& { return H[static_cast<size_t>(i) * m + k]; };
+    std::vector<double> r = b;
+    std::vector<double> z(n), w(n);
+    int total = 0;
+    for (;;) {
+        double beta = std::sqrt(problem.dot(r, r));
+        if (beta <= limit) {
+            return total;
+        }
+        if (total >= kMaxKrylovIterations) {
+            return -1;
+        }
+        for (size_t i = 0; i < n; ++i) {
+            V[0][i] = r[i] / beta;
+        }
+        std::fill(g.begin(), g.end(), 0.0);
+        g[0] = beta;
+
+        // Arnoldi with modified Gram-Schmidt; Givens rotations keep the
+        // least-squares residual |g[k]| current
+        int k = 0;
+        while (k < m && total < kMaxKrylovIterations) {
+            for (size_t i = 0; i < n; ++i) {
+                z[i] = invDiag[i] * V[k][i];
+            }
+            applyJ(z, w);
+            for (int i = 0; i <= k; ++i) {
+                h(i, k) = problem.dot(w, V[i]);
+                axpy(-h(i, k), V[i], w);
+            }
+            double next = std::sqrt(problem.dot(w, w));
+            h(k + 1, k) = next;
+            if (next > 0.0) {
+                for (size_t i = 0; i < n; ++i) {
+                    V[k + 1][i] = w[i] / next;
+                }
+            }
+            for (int i = 0; i < k; ++i) {
+                double t = cs[i] * h(i, k) + sn[i] * h(i + 1, k);
+                h(i + 1, k) = -sn[i] * h(i, k) + cs[i] * h(i + 1, k);
+                h(i, k) = t;
+            }
+            double denominator = std::hypot(h(k, k), h(k + 1, k));
+            if (denominator == 0.0) {
+                break;
+            }
+            cs[k] = h(k, k) / denominator;
+            sn[k] = h(k + 1, k) / denominator;
+            h(k, k) = denominator;
+            h(k + 1, k) = 0.0;
+            g[k + 1] = -sn[k] * g[k];
+            g[k] = cs[k] * g[k];
+            ++k;
+            ++total;
+            if (std::abs(g[k]) <= limit || next == 0.0) {
+                break;
+            }
+        }
+        if (k == 0) {
+            return -1;
+        }
+
+        // d += M^-1 V y with H y = g, then the true residual
+        for (int i = k - 1; i >= 0; --i) {
+            double s = g[i];
+            for (int j = i + 1; j < k; ++j) {
+                s -= h(i, j) * y[j];
+            }
+            y[i] = s / h(i, i);
+        }
+        std::fill(w.begin(), w.end(), 0.0);
+        for (int i = 0; i < k; ++i) {
+            axpy(y[i], V[i], w);
+        }
+        for (size_t i = 0; i < n; ++i) {
+            d[i] += invDiag[i] * w[i];
+        }
+        applyJ(d, w);
+        for (size_t i = 0; i < n; ++i) {
+            r[i] = b[i] - w[i];
+        }
+    }
+}
+
+// One implicit step: the Newmark residual around the predictor uPred and
+// its Jacobian-free Newton-Krylov solve
+struct ImplicitStep {
+    const TensionProblem& problem;
+    BondGraph& graph;
+    const std::vector<double>& uPred;
+    double massShift = 0.0;          // 1 / (beta dt^2)
+    double criticalStretch = 0.0;
+    double tolerance = 0.0;
+
+    // R(x) = massShift M (x - uPred) + K x on the free degrees of freedom
+    // over the current bond set; the mass term is the diagonal shift of the
+    // problem
+    void residual(const std::vector<double>& x, std::vector<double>& R) const {
+        problem.apply(x, R);
+        parallelFor(problem.dofs(), kVectorGrain, [&](long long i0, long long i1) {
+            for (long long i = i0; i < i1; ++i) {
+                if (problem.freeDof[i]) {
+                    R[i] -= massShift * problem.massOf(i / 2) * uPred[i];
+                }
+            }
+        });
+    }
+
+    // Newton iterations from u (grip values already set) on a fixed bond
+    // set. Bonds fail only at the converged state, never at the predictor or
+    // an intermediate iterate; while the converged state breaks bonds, the
+    // step is solved again without them. Returns false if Newton does not
+    // converge, the line search cannot reduce the residual or bonds are still
+    // failing after kMaxFailureRounds re-solves.
+    bool solve(std::vector<double>& u, DynamicsStep& step) const {
+        const long long n = problem.dofs();
+        std::vector<double> R(n), minusR(n), Rw(n), trial(n), d(n), invDiag(n);
+        int newton = 0;
+        int rounds = 0;
+        for (;;) {
+            residual(u, R);
+            step.bondUpdates += problem.graph.bonds();
+            double norm = std::sqrt(problem.dot(R, R));
+            if (norm <= tolerance) {
+                if (criticalStretch <= 0.0) {
+                    return true;
+                }
+                long long broken = breakOverloaded(problem, graph, u, criticalStretch);
+                step.brokenBonds += broken;
+                step.bondUpdates += problem.graph.bonds();
+                if (broken == 0) {
+                    return true;
+                }
+                if (++rounds > kMaxFailureRounds) {
+                    return false;
+                }
+                newton = 0;
+                continue;
+            }
+            if (++newton > kMaxNewtonIterations) {
+                return false;
+            }
+            step.newtonIterations++;
+
+            // J v = (R(u + eps v) - R(u)) / eps over the current bond set
+            const double uNorm = std::sqrt(problem.dot(u, u));
+            auto applyJ = [&](const std::vector<double>& v, std::vector<double>& out) {
+                double vNorm = std::sqrt(problem.dot(v, v));
+                if (vNorm == 0.0) {
+                    std::fill(out.begin(), out.end(), 0.0);
+                    return;
+                }
+                double eps = kDifferenceStep * (1.0 + uNorm) / vNorm;
+                parallelFor(n, kVectorGrain, [&](long long i0, long long i1) {
+                    for (long long i = i0; i < i1; ++i) {
+                        trial[i] = u[i] + eps * v[i];
+                    }
+                });
+                residual(trial, Rw);
+                step.bondUpdates += problem.graph.bonds();
+                parallelFor(n, kVectorGrain, [&](long long i0, long long i1) {
+                    for (long long i = i0; i < i1; ++i) {
+                        out[i] = (Rw[i] - R[i]) / eps;
+                    }
+                });
+            };
+            problem.inverseDiagonal(invDiag);
+            for (long long i = 0; i < n; ++i) {
+                minusR[i] = -R[i];
+            }
+            int iterations = gmres(problem, applyJ, invDiag, minusR, std::max(kForcingTerm * norm, 0.5 * tolerance), d);
+            if (iterations < 0) {
+                return false;
+            }
+            step.krylovIterations += iterations;
+
+            // Backtracking on |R|
+            double lambda = 1.0;
+            for (;;) {
+                parallelFor(n, kVectorGrain, [&](long long i0, long long i1) {
+                    for (long long i = i0; i < i1; ++i) {
+                        trial[i] = u[i] + lambda * d[i];
+                    }
+                });
+                residual(trial, Rw);
+                step.bondUpdates += problem.graph.bonds();
+                if (std::sqrt(problem.dot(Rw, Rw)) <= (1.0 - kSufficientDecrease * lambda) * norm) {
+                    u.swap(trial);
+                    break;
+                }
+                lambda *= 0.5;
+                if (lambda < kMinLineSearch) {
+                    return false;
+                }
+            }
+        }
+    }
+};
+
+// Kinetic energy of the velocities v
+double kineticEnergy(const TensionProblem& problem, const std::vector<double>& v) {
+    if (problem.mass.empty()) {
+        return 0.5 * problem.dot(v, v);
+    }
+    return 0.5 * deterministicSum(problem.dofs(), [&](long long i) { return problem.mass[i / 2] * v[i] * v[i]; });
+}
+
+// Refinement flags of an accepted step: an intact bond stretched beyond
+// refineStretch, or bonds lost in the step (broken but not in committed)
+// with the damage above refineDamage
+void activeParticles(const TensionProblem& problem, const std::vector<double>& u, const uint8_t* committed,
+                     const DynamicsOptions& options, std::vector<uint8_t>& active) {
+    const BondGraph& graph = problem.graph;
+    active.assign(graph.particles(), 0);
+    graph.forEachBlock([&](long long first, long long last) {
+        for (long long id = first; id < last; ++id) {
+            long long b0 = graph.offsets[id];
+            long long b1 = graph.offsets[id + 1];
+            int broken = 0;
+            bool lost = false;
+            bool stretched = false;
+            graph.forEachBond(id, [&](long long b, long long nid) {
+                if (graph.broken[b]) {
+                    broken++;
+                    lost = lost || !committed[b];
+                }
+                else if (problem.stretch(problem.table, u, id, nid, b) > options.refineStretch) {
+                    stretched = true;
+                }
+            });
+            bool damaged = lost && b1 > b0 && static_cast<double>(broken) / static_cast<double>(b1 - b0) >= options.refineDamage;
+            active[id] = (stretched || damaged) ? 1 : 0;
+        }
+    });
+}
+
+}  // namespace
+
+bool runDynamics(BondGraph& graph, int Nx, int Ny, const BondStencil& stencil, const CouplingZone* coupling,
+                 const DynamicsOptions& options, const BondStorageOptions& storage, DynamicsResult& result) {
+    result = DynamicsResult();
+    const int reach = stencil.reach;
+    if (Nx < 2 * reach + 1 || Ny < 1) {
+        std::cerr << "Error: the lattice is too small for the grips (" << reach << " columns each)\n";
+        return false;
+    }
+
+    // Refined runs solve on an adaptive copy of the graph
+    const bool adaptive = options.refineStretch > 0.0;
+    std::unique_ptr<AdaptiveLattice> lattice;
+    BondGraph* current = &graph;
+    if (adaptive) {
+        lattice = std::make_unique<AdaptiveLattice>(graph, Nx, Ny, stencil, options.coarsenSteps, storage);
+        if (!lattice->start()) {
+            return false;
+        }
+        current = &lattice->graph();
+    }
+
+    // Problem on the current particle set; rebuilt whenever it changes
+    std::unique_ptr<TensionProblem> problem;
+    auto setUpProblem = [&]() {
+        if (adaptive) {
+            problem = std::make_unique<TensionProblem>(*current, lattice->width(), lattice->height(), reach, false,
+                                                       AdaptiveLattice::kSubdivision);
+            problem->mass = lattice->mass();
+            problem->materialWeight = AdaptiveLattice::bondWeight;
+        }
+        else {
+            problem = std::make_unique<TensionProblem>(*current, Nx, Ny, reach, false);
+        }
+        problem->load = options.load;
+        if (!problem->setUp(stencil, coupling, options.surfaceCorrection, storage)) {
+            return false;
+        }
+        problem->forceScale = options.strain * problem->intactDiagonal * std::sqrt(static_cast<double>(Nx) * Ny);
+        return true;
+    };
+    if (!setUpProblem()) {
+        return false;
+    }
+    result.explicitStep = explicitStep(*problem);
+    const double targetStep = options.timeStep * result.explicitStep;
+    const double endTime = options.steps * targetStep;
+    const double strainRate = options.strain / endTime;
+
+    // Bond state of the last accepted step; a rejected attempt restores it
+    MappedArray<uint8_t> committed;
+    auto copyBroken = [&](const uint8_t* from, uint8_t* to) {
+        current->forEachBlock([&](long long first, long long last) {
+            std::copy(from + current->offsets[first], from + current->offsets[last], to + current->offsets[first]);
+        });
+    };
+    auto commit = [&]() {
+        committed = MappedArray<uint8_t>();
+        if (!committed.allocate(current->bonds(), storage.mapped ? storage.directory : std::string())) {
+            return false;
+        }
+        copyBroken(current->broken.data(), committed.data());
+        return true;
+    };
+    if (!commit()) {
+        return false;
+    }
+
+    // Start from rest in the undeformed state, moving with the grips
+    long long n = problem->dofs();
+    std::vector<double> u(n, 0.0), v(n, 0.0), a(n, 0.0);
+    problem->loadField(strainRate, v);
+    std::vector<double> uPred(n), uNew(n);
+    std::vector<uint8_t> active;
+    result.peakParticles = current->particles();
+
+    double time = 0.0;
+    double dt = targetStep;
+    int attempts = 0;  // cut-backs of the current step
+    while (time < endTime * (1.0 - 1e-12)) {
+        const double h = std::min(dt, endTime - time);
+        const double massShift = 1.0 / (kBeta * h * h);
+        problem->regularization = massShift;
+        parallelFor(n, kVectorGrain, [&](long long i0, long long i1) {
+            for (long long i = i0; i < i1; ++i) {
+                uPred[i] = u[i] + h * v[i] + h * h * (0.5 - kBeta) * a[i];
+                uNew[i] = uPred[i];
+            }
+        });
+        // Grips (impactor, supports) follow the ramp exactly
+        problem->prescribe(strainRate * (time + h), uNew);
+
+        DynamicsStep step;  // brokenBonds counts directed bonds until accepted
+        ImplicitStep implicit{ *problem, *current, uPred, massShift, options.criticalStretch,
+                               kNewtonTolerance * problem->forceScale };
+        bool converged = implicit.solve(uNew, step);
+        result.bondUpdates += step.bondUpdates;
+        if (!converged) {
+            copyBroken(committed.data(), current->broken.data());
+            result.cutbacks++;
+            if (++attempts > options.maxCutbacks) {
+                std::cerr << "Error: implicit step at time " << time << " did not converge after "
+                    << options.maxCutbacks << " cut-backs (step " << h << ")\n";
+                return false;
+            }
+            dt = 0.5 * h;
+            continue;
+        }
+
+        // Accept: Newmark update of acceleration and velocity
+        parallelFor(n, kVectorGrain, [&](long long i0, long long i1) {
+            for (long long i = i0; i < i1; ++i) {
+                double aNew = massShift * (uNew[i] - uPred[i]);
+                v[i] += h * ((1.0 - kGamma) * a[i] + kGamma * aNew);
+                a[i] = aNew;
+            }
+        });
+        u.swap(uNew);
+        time += h;
+        result.brokenBonds += step.brokenBonds / 2;
+        result.steps++;
+        result.krylovIterations += step.krylovIterations;
+        step.time = time;
+        step.timeStep = h;
+        step.cutbacks = attempts;
+        step.brokenBonds = result.brokenBonds;
+        step.kineticEnergy = kineticEnergy(*problem, v);
+        step.strainEnergy = problem->energy(u);
+
+        // Refine at the crack tips, coarsen where the front has passed
+        bool changed = false;
+        if (adaptive) {
+            activeParticles(*problem, u, committed.data(), options, active);
+            if (!lattice->adapt(active, u, { &v, &a }, changed)) {
+                return false;
+            }
+        }
+        if (changed) {
+            if (!setUpProblem() || !commit()) {
+                return false;
+            }
+            n = problem->dofs();
+            uPred.resize(n);
+            uNew.resize(n);
+            result.peakParticles = std::max(result.peakParticles, current->particles());
+        }
+        else {
+            copyBroken(current->broken.data(), committed.data());
+        }
+        step.particles = current->particles();
+        result.history.push_back(step);
+        attempts = 0;
+        dt = std::min(targetStep, 2.0 * h);
+    }
+    result.time = time;
+
+    // Refined runs hand their bond states back to the coarse graph
+    if (adaptive && !lattice->finish(u, { &v, &a })) {
+        return false;
+    }
+    const long long N = graph.particles();
+    result.displacement.assign(N, 0.0);
+    parallelFor(N, kVectorGrain, [&](long long i0, long long i1) {
+        for (long long id = i0; id < i1; ++id) {
+            result.displacement[id] = std::hypot(u[2 * id], u[2 * id + 1]);
+        }
+    });
+    return true;
+}
+
+bool writeDynamicsHistory(const std::string& path, const DynamicsResult& result) {
+    std::ofstream out(path);
+    if (!out) {
+        std::cerr << "Error: could not write dynamics history " << path << "\n";
+        return false;
+    }
+    out.precision(10);
+    out << "time,time_step,newton_iterations,krylov_iterations,cutbacks,broken_bonds,kinetic_energy,strain_energy,"
+        "particles\n";
+    for (const DynamicsStep& step : result.history) {
+        out << step.time << "," << step.timeStep << "," << step.newtonIterations << "," << step.krylovIterations
+            << "," << step.cutbacks << "," << step.brokenBonds << "," << step.kineticEnergy << ","
+            << step.strainEnergy << "," << step.particles << "\n";
+    }
+    return static_cast<bool>(out);
+}
+
+std::string dynamicsHistoryName(const std::string& outputName) {
+    std::filesystem::path p(outputName);
+    p.replace_extension(".dynamics.csv");
+    return p.string();
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "bond_graph.h"
+#include "coupling.h"
+#include "lattice.h"
+#include "tension_problem.h"
+
+#include <string>
+#include <vector>
+
+// Implicit dynamics of the pre-damaged lattice under slow loading
+// (dynamics_steps > 0).
+//
+// The specimen is pulled between the grips of the tension test (see
+// tension_problem.h) with a strain that ramps linearly to `strain` over
+// `steps` steps of `timeStep` times the explicit stability limit. The impact
+// and three-point bending load cases ramp their prescribed displacement
+// (strain times the specimen length) the same way. Particles
+// have unit mass. Bonds are linear springs that break for good once their
+// stretch exceeds criticalStretch.
+//
+// Each step is a Newmark step (average acceleration, beta = 1/4,
+// gamma = 1/2), which is unconditionally stable. Its nonlinear residual
+//
+//     R(u) = (u - u_pred) / (beta dt^2) + f_int(u)
+//
+// is solved by Jacobian-free Newton-Krylov on a fixed bond set. Restarted
+// GMRES solves J d = -R with J v approximated by finite differences of R. It
+// is right-preconditioned with the Jacobi diagonal of mass and stiffness. A
+// backtracking line search on |R| scales the Newton step. Bonds stretched
+// past failure break only at the converged state (the predictor overshoots
+// at large steps), and the step is solved again until no more bonds fail. A
+// step whose Newton iteration or line search fails, or whose bonds keep
+// failing over many re-solves, is retried at half the size (cut back), and
+// the step size grows back after each accepted step.
+
+struct DynamicsOptions {
+    int steps = 0;                  // steps at the target size (0 = off)
+    double timeStep = 100.0;        // target step in units of the explicit stability limit
+    double strain = 1e-3;           // grip strain at the end of the ramp
+    LoadCase load = LoadCase::Tension;
+    double criticalStretch = 0.0;   // bond failure stretch (0 = none)
+    int maxCutbacks = 10;           // halvings of one step before giving up
+    bool surfaceCorrection = false; // scale bonds near edges (see surface_correction.h)
+    double refineStretch = 0.0;     // refine where an intact bond stretches beyond this (0 = off, see refinement.h)
+    double refineDamage = 0.0;      // ... or where bonds broke and the damage exceeds this
+    int coarsenSteps = 5;           // quiet steps before a refined family merges back
+};
+
+struct DynamicsStep {
+    double time = 0.0;            // time at the end of the step
+    double timeStep = 0.0;        // size of the step
+    int newtonIterations = 0;
+    int krylovIterations = 0;     // GMRES iterations over all Newton iterations
+    int cutbacks = 0;             // failed attempts before this step was accepted
+    long long brokenBonds = 0;    // bonds broken by the dynamics so far
+    double kineticEnergy = 0.0;
+    double strainEnergy = 0.0;
+    long long particles = 0;      // particles after the step (refined runs change it)
+    long long bondUpdates = 0;    // directed bonds visited by residuals and failure checks
+};
+
+struct DynamicsResult {
+    double time = 0.0;            // time reached (in units of 1 / sqrt(bond stiffness))
+    double explicitStep = 0.0;    // explicit stability limit of this lattice
+    int steps = 0;                // accepted steps
+    int cutbacks = 0;             // rejected attempts over the whole run
+    int krylovIterations = 0;
+    long long brokenBonds = 0;    // fine bonds count as bonds of their own
+    long long peakParticles = 0;  // largest particle count of a refined run
+    long long bondUpdates = 0;    // over all attempts, rejected ones included
+    std::vector<DynamicsStep> history;
+    std::vector<double> displacement;  // per particle: final displacement magnitude (in dx)
+};
+
+// Runs implicit dynamics on the Nx x Ny lattice graph; coupling is the
+// blending zone of a coupled run (or nullptr). Bonds that fail are marked
+// broken in graph (refined runs merge every family back at the end). Prints an error and returns false on failure (including
+// a step that does not converge after maxCutbacks halvings).
+bool runDynamics(BondGraph& graph, int Nx, int Ny, const BondStencil& stencil, const CouplingZone* coupling,
+                 const DynamicsOptions& options, const BondStorageOptions& storage, DynamicsResult& result);
+
+// Step history as CSV
+bool writeDynamicsHistory(const std::string& path, const DynamicsResult& result);
+
+// History file matching an output name ("a/b.vtk" -> "a/b.dynamics.csv")
+std::string dynamicsHistoryName(const std::string& outputName);
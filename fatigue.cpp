@@ -0,0 +1,243 @@
+#include "fatigue.h"
+
+#include "parallel.h"
+#include "reduction.h"
+#include "tension_problem.h"
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <limits>
+
+namespace {
+
+const int kMaxOverloadRounds = 100;     // re-solves per cycle after static breaks
+const double kWornOut = 1e-9;           // life at which a bond counts as broken
+
+// Life lost per cycle by a bond at peak stretch s
+template <typename Real>
+Real wearRate(Real s, const FatigueOptions& options) {
+    Real range = static_cast<Real>(1.0 - options.loadRatio) * std::max(Real(0), s);
+    if (range <= static_cast<Real>(options.threshold)) {
+        return Real(0);
+    }
+    return static_cast<Real>(options.coefficient) * std::pow(range, static_cast<Real>(options.exponent));
+}
+
+// Wear rate of bond b between particles id and nid in the precision of the
+// problem
+double bondWear(const TensionProblem& problem, const std::vector<double>& u, long long id, long long nid,
+                long long b, const FatigueOptions& options) {
+    return problem.mixed ? wearRate(problem.stretch(problem.narrowTable, u, id, nid, b), options)
+                         : wearRate(problem.stretch(problem.table, u, id, nid, b), options);
+}
+
+long long intactBonds(const BondGraph& graph) {
+    std::vector<int> perParticle(graph.particles(), 0);
+    graph.forEachBlock([&](long long first, long long last) {
+        for (long long id = first; id < last; ++id) {
+            int n = 0;
+            for (long long b = graph.offsets[id]; b < graph.offsets[id + 1]; ++b) {
+                n += graph.broken[b] ? 0 : 1;
+            }
+            perParticle[id] = n;
+        }
+    });
+    return exactIntegerSum(graph.particles(), [&](long long i) { return perParticle[i]; }) / 2;
+}
+
+// Smallest value of a per-particle vector (exact in any order)
+double minimum(const std::vector<double>& values) {
+    double m = std::numeric_limits<double>::infinity();
+    for (double v : values) {
+        m = std::min(m, v);
+    }
+    return m;
+}
+
+}  // namespace
+
+bool runFatigue(BondGraph& graph, int Nx, int Ny, const BondStencil& stencil, const CouplingZone* coupling,
+                const FatigueOptions& options, const BondStorageOptions& storage, FatigueResult& result) {
+    result = FatigueResult();
+    const long long N = graph.particles();
+    const int reach = stencil.reach;
+    if (Nx < 2 * reach + 1 || Ny < 1) {
+        std::cerr << "Error: the lattice is too small for the fatigue grips (" << reach << " columns each)\n";
+        return false;
+    }
+
+    // Grips: the left `reach` columns are clamped, the right ones are pulled
+    // to u_x = strain * x and may contract in y
+    TensionProblem problem(graph, Nx, Ny, reach, options.mixedPrecision);
+    if (!problem.setUp(stencil, coupling, options.surfaceCorrection, storage)) {
+        return false;
+    }
+    std::vector<double> u;
+    problem.homogeneousField(options.strain, u);  // homogeneous start
+    problem.forceScale = options.strain * problem.intactDiagonal * std::sqrt(static_cast<double>(Nx) * Ny);
+
+    // Remaining life of every directed bond; both copies of a bond see the
+    // same stretch and therefore evolve identically
+    MappedArray<float> life;
+    if (!life.allocate(graph.bonds(), storage.mapped ? storage.directory : std::string())) {
+        return false;
+    }
+    graph.forEachBlock([&](long long first, long long last) {
+        for (long long b = graph.offsets[first]; b < graph.offsets[last]; ++b) {
+            life[b] = graph.broken[b] ? 0.0f : 1.0f;
+        }
+    });
+    const long long initialIntact = intactBonds(graph);
+
+    std::vector<double> perParticle(N);
+    double cycle = 0.0;
+    double jump = 0.0;
+    double referenceEnergy = -1.0;
+    bool warned = false;
+    bool warnedOverload = false;
+    for (;;) {
+        // Resolve the cycle at peak load; overloaded bonds break at once
+        int iterations = 0;
+        bool settled = false;
+        for (int round = 0; round < kMaxOverloadRounds && !settled; ++round) {
+            int it = problem.solve(u);
+            if (it < 0 && !warned) {
+                std::cerr << "Warning: fatigue solver did not converge at cycle " << cycle << "\n";
+                warned = true;
+            }
+            iterations += std::max(it, 0);
+            if (referenceEnergy < 0.0) {
+                referenceEnergy = problem.energy(u);
+            }
+            if (options.criticalStretch <= 0.0) {
+                settled = true;
+                break;
+            }
+            graph.forEachBlock([&](long long first, long long last) {
+                for (long long id = first; id < last; ++id) {
+                    int n = 0;
+                    graph.forEachBond(id, [&](long long b, long long nid) {
+                        if (!graph.broken[b] && problem.stretch(u, id, nid, b) > options.criticalStretch) {
+                            graph.broken[b] = 1;
+                            life[b] = 0.0f;
+                            n++;
+                        }
+                    });
+                    perParticle[id] = n;
+                }
+            });
+            settled = (deterministicSum(perParticle) == 0.0);
+        }
+        if (!settled) {
+            // The cascade outlasted the re-solves: go on from the equilibrium
+            // of the bonds left, which may still hold overloaded ones
+            iterations += std::max(problem.solve(u), 0);
+            if (!warnedOverload) {
+                std::cerr << "Warning: overloaded bonds were still breaking after " << kMaxOverloadRounds
+                    << " re-solves at cycle " << cycle << "\n";
+                warnedOverload = true;
+            }
+        }
+
+        double energy = problem.energy(u);
+        double stiffness = (referenceEnergy > 0.0) ? energy / referenceEnergy : 0.0;
+        long long broken = initialIntact - intactBonds(graph);
+        result.history.push_back({ cycle, jump, broken, stiffness, iterations });
+        result.cycles = cycle;
+        result.brokenBonds = broken;
+        result.stiffness = stiffness;
+        result.energy = energy;
+        if (stiffness < options.failureStiffness) {
+            result.failed = true;
+            break;
+        }
+        if (cycle >= options.cycles) {
+            break;
+        }
+        if (result.resolvedCycles >= options.maxJumps) {
+            std::cerr << "Warning: fatigue stopped after " << options.maxJumps << " resolved cycles at cycle "
+                << cycle << " (fatigue_max_jumps)\n";
+            break;
+        }
+
+        // Longest jump in which no bond loses more than maxLifeIncrement;
+        // bonds whose life runs out within it break at its end
+        graph.forEachBlock([&](long long first, long long last) {
+            for (long long id = first; id < last; ++id) {
+                double limit = std::numeric_limits<double>::infinity();
+                graph.forEachBond(id, [&](long long b, long long nid) {
+                    if (graph.broken[b]) {
+                        return;
+                    }
+                    double rate = bondWear(problem, u, id, nid, b, options);
+                    if (rate > 0.0) {
+                        limit = std::min(limit, options.maxLifeIncrement / rate);
+                    }
+                });
+                perParticle[id] = limit;
+            }
+        });
+        // At least one whole cycle per resolved cycle; no wear at all means
+        // the specimen runs out
+        jump = std::min(options.cycles - cycle, std::max(1.0, minimum(perParticle)));
+
+        graph.forEachBlock([&](long long first, long long last) {
+            for (long long id = first; id < last; ++id) {
+                graph.forEachBond(id, [&](long long b, long long nid) {
+                    if (graph.broken[b]) {
+                        return;
+                    }
+                    double remaining = life[b] - bondWear(problem, u, id, nid, b, options) * jump;
+                    if (remaining <= kWornOut) {
+                        graph.broken[b] = 1;
+                        remaining = 0.0;
+                    }
+                    life[b] = static_cast<float>(remaining);
+                });
+            }
+        });
+        cycle += jump;
+        result.resolvedCycles++;
+    }
+
+    // Per particle: the weakest intact bond (0 once all are broken)
+    result.life.assign(N, 0.0);
+    graph.forEachBlock([&](long long first, long long last) {
+        for (long long id = first; id < last; ++id) {
+            double weakest = 1.0;
+            bool any = false;
+            for (long long b = graph.offsets[id]; b < graph.offsets[id + 1]; ++b) {
+                if (!graph.broken[b]) {
+                    weakest = std::min(weakest, static_cast<double>(life[b]));
+                    any = true;
+                }
+            }
+            result.life[id] = any ? weakest : 0.0;
+        }
+    });
+    return true;
+}
+
+bool writeFatigueHistory(const std::string& path, const FatigueResult& result) {
+    std::ofstream out(path);
+    if (!out) {
+        std::cerr << "Error: could not write fatigue history " << path << "\n";
+        return false;
+    }
+    out.precision(10);
+    out << "cycle,jump,broken_bonds,stiffness,solver_iterations\n";
+    for (const FatigueStep& step : result.history) {
+        out << step.cycle << "," << step.jump << "," << step.brokenBonds << "," << step.stiffness << ","
+            << step.solverIterations << "\n";
+    }
+    return static_cast<bool>(out);
+}
+
+std::string fatigueHistoryName(const std::string& outputName) {
+    std::filesystem::path p(outputName);
+    p.replace_extension(".fatigue.csv");
+    return p.string();
+}
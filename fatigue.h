@@ -0,0 +1,83 @@
+#pragma once
+
+#include "bond_graph.h"
+#include "coupling.h"
+#include "lattice.h"
+
+#include <string>
+#include <vector>
+
+// Fatigue loading of the pre-damaged lattice (fatigue_cycles > 0).
+//
+// The specimen is pulled in x between two grips (the outer `reach` columns)
+// with a cyclic strain between loadRatio * strain and strain. Each intact
+// bond carries a remaining life lambda in [0, 1] that decays with the cyclic
+// bond stretch range ds (Silling & Askari):
+//
+//     d lambda / dN = -A * ds^exponent     (ds > threshold, else 0)
+//
+// and the bond breaks at lambda = 0. The stretch field comes from a
+// quasi-static, linearized bond-based solve (preconditioned conjugate
+// gradients over the stored bond graph). Because the response is linear,
+// the stretch at the minimum load is loadRatio times that at the maximum
+// load, so one solve resolves a whole cycle.
+//
+// Cycle jump: between resolved cycles the stretch field is held fixed and
+// the life of every bond is extrapolated over many cycles at once. The jump
+// is as long as possible while no bond loses more than maxLifeIncrement of
+// life; bonds whose life runs out within it break at its end. The field is
+// then solved again (warm-started), so the number of solves follows the
+// damage evolution instead of the cycle count.
+//
+// precision = mixed evaluates the per-bond terms (stiffness products,
+// stretches, wear rates) in float and keeps the per-particle sums, global
+// reductions and displacements in double. Solves are refined against the
+// double residual, so they meet the same tolerance as the double path.
+
+struct FatigueOptions {
+    double cycles = 0.0;            // load cycles to simulate (0 = off)
+    double strain = 1e-3;           // peak applied strain in x
+    double loadRatio = 0.0;         // R = minimum / maximum load (< 1)
+    double coefficient = 1e4;       // A of the life law
+    double exponent = 3.0;          // exponent of the life law
+    double threshold = 0.0;         // stretch range below which bonds do not wear
+    double criticalStretch = 0.0;   // static failure stretch (0 = none)
+    double maxLifeIncrement = 0.1;  // life any bond may lose in one jump
+    double failureStiffness = 0.5;  // failed when the stiffness drops below this fraction
+    int maxJumps = 100000;          // limit on resolved cycles, i.e. on the solves
+    bool mixedPrecision = false;    // float bond kernels (precision = mixed)
+    bool surfaceCorrection = false; // scale bonds near edges (see surface_correction.h)
+};
+
+struct FatigueStep {
+    double cycle = 0.0;       // cycles applied after this jump
+    double jump = 0.0;        // cycles extrapolated by this jump
+    long long brokenBonds = 0;  // bonds broken by fatigue so far
+    double stiffness = 1.0;   // secant stiffness relative to the start
+    int solverIterations = 0;
+};
+
+struct FatigueResult {
+    double cycles = 0.0;          // cycles applied (to failure, or all of them)
+    bool failed = false;          // stiffness fell below failureStiffness
+    int resolvedCycles = 0;       // quasi-static solves that advanced the cycle count
+    long long brokenBonds = 0;    // bonds broken by fatigue or overload
+    double stiffness = 1.0;
+    double energy = 0.0;          // elastic energy of the last resolved cycle
+    std::vector<FatigueStep> history;
+    std::vector<double> life;     // per particle: minimum life of its intact bonds
+};
+
+// Runs the fatigue simulation on the Nx x Ny lattice graph; coupling is the
+// blending zone of a coupled run (or nullptr). Bonds that fail are marked
+// broken in graph. The per-bond lives use the storage of graph (mapped
+// scratch files when storage.mapped). Prints an error and returns false on
+// failure.
+bool runFatigue(BondGraph& graph, int Nx, int Ny, const BondStencil& stencil, const CouplingZone* coupling,
+                const FatigueOptions& options, const BondStorageOptions& storage, FatigueResult& result);
+
+// Jump history as CSV
+bool writeFatigueHistory(const std::string& path, const FatigueResult& result);
+
+// History file matching an output name ("a/b.vtk" -> "a/b.fatigue.csv")
+std::string fatigueHistoryName(const std::string& outputName);
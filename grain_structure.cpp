@@ -0,0 +1,128 @@
+#include "grain_structure.h"
+
+#include "parallel.h"
+#include "rng.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+GrainStructure::GrainStructure(int Nx, int Ny, double dx, double grainSize, unsigned long long seed) {
+    const long long N = static_cast<long long>(Nx) * Ny;
+    const double expected = std::round(static_cast<double>(N) * (dx / grainSize) * (dx / grainSize));
+    const double most = static_cast<double>(std::min<long long>(N, std::numeric_limits<int>::max()));
+    grains_ = static_cast<int>(std::clamp(expected, 1.0, most));
+
+    // Seed positions in grid units, uniform over the cells of the lattice;
+    // x and y side by side, so a distance test touches one cache line
+    struct Seed {
+        double x;
+        double y;
+    };
+    std::vector<Seed> seeds(grains_);
+    parallelFor(grains_, 16384, [&](long long g0, long long g1) {
+        for (long long g = g0; g < g1; ++g) {
+            SplitMixEngine rng = SplitMixEngine::forStream(seed, static_cast<uint64_t>(g));
+            double ux = static_cast<double>(rng.next() >> 11) * 0x1.0p-53;
+            double uy = static_cast<double>(rng.next() >> 11) * 0x1.0p-53;
+            seeds[g] = { ux * Nx - 0.5, uy * Ny - 0.5 };
+        }
+    });
+
+    auto distance = [&](int i, int j, int g) {
+        double ex = i - seeds[g].x;
+        double ey = j - seeds[g].y;
+        return ex * ex + ey * ey;
+    };
+    // Whether seed g is nearer to (i, j) than seed best (-1 = none)
+    auto nearer = [&](int i, int j, int g, int best) {
+        if (best < 0) {
+            return true;
+        }
+        double d = distance(i, j, g);
+        double bestD = distance(i, j, best);
+        return d < bestD || (d == bestD && g < best);
+    };
+
+    // Every seed marks the cell it falls into
+    std::vector<int> current(N, -1);
+    for (int g = 0; g < grains_; ++g) {
+        int i = std::clamp(static_cast<int>(std::lround(seeds[g].x)), 0, Nx - 1);
+        int j = std::clamp(static_cast<int>(std::lround(seeds[g].y)), 0, Ny - 1);
+        long long id = static_cast<long long>(j) * Nx + i;
+        if (nearer(i, j, g, current[id])) {
+            current[id] = g;
+        }
+    }
+
+    std::vector<int> next(N);
+    auto pass = [&](int step) {
+        parallelFor(Ny, 8, [&](long long j0, long long j1) {
+            for (int j = static_cast<int>(j0); j < j1; ++j) {
+                for (int i = 0; i < Nx; ++i) {
+                    int best = current[static_cast<long long>(j) * Nx + i];
+                    double bestD = (best >= 0) ? distance(i, j, best) : std::numeric_limits<double>::infinity();
+                    for (int dj = -step; dj <= step; dj += step) {
+                        int nj = j + dj;
+                        if (nj < 0 || nj >= Ny) {
+                            continue;
+                        }
+                        for (int di = -step; di <= step; di += step) {
+                            int ni = i + di;
+                            if (ni < 0 || ni >= Nx) {
+                                continue;
+                            }
+                            // Neighbors mostly share the seed already held
+                            int g = current[static_cast<long long>(nj) * Nx + ni];
+                            if (g < 0 || g == best) {
+                                continue;
+                            }
+                            double d = distance(i, j, g);
+                            if (d < bestD || (d == bestD && g < best)) {
+                                best = g;
+                                bestD = d;
+                            }
+                        }
+                    }
+                    next[static_cast<long long>(j) * Nx + i] = best;
+                }
+            }
+        });
+        current.swap(next);
+        passes_++;
+    };
+
+    // A cell's nearest seed is rarely more than a few grain sizes away, and
+    // the halving steps reach up to twice the first one, so the flood starts
+    // at the power of two above 4 grain sizes instead of half the grid
+    const int longest = std::max(Nx, Ny);
+    const double reach = std::min(4.0 * grainSize / dx, static_cast<double>(longest));
+    int step = 1;
+    while (step < reach && 2 * step < longest) {
+        step *= 2;
+    }
+    for (; step >= 1; step /= 2) {
+        pass(step);
+    }
+    pass(2);
+    pass(1);
+
+    // Cells no seed reached (a void wider than the first step) search all seeds
+    parallelFor(Ny, 8, [&](long long j0, long long j1) {
+        for (int j = static_cast<int>(j0); j < j1; ++j) {
+            for (int i = 0; i < Nx; ++i) {
+                int& best = current[static_cast<long long>(j) * Nx + i];
+                if (best >= 0) {
+                    continue;
+                }
+                for (int g = 0; g < grains_; ++g) {
+                    if (nearer(i, j, g, best)) {
+                        best = g;
+                    }
+                }
+            }
+        }
+    });
+    grain_ = std::move(current);
+}
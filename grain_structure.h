@@ -0,0 +1,39 @@
+#pragma once
+
+#include <vector>
+
+// Voronoi grain structure of a polycrystal (porosity_model = grains).
+//
+// Grain seeds are scattered uniformly over the specimen, one per
+// grain_size^2 of area on average, each drawn from its own random stream of
+// grain_seed. Every lattice particle belongs to the grain of its nearest
+// seed. The map is built by jump flooding instead of a seed search per
+// particle: each cell starts with the seed that falls into it, and passes
+// with steps of S, S/2, ..., 1 cells let every cell adopt the nearer seed of
+// its eight neighbors at the step distance. S is the power of two above
+// 4 grain sizes (at most half the larger grid side), which is farther than
+// nearest seeds lie in practice; cells no pass reached search all seeds.
+// Each pass is a parallel sweep over the grid into a second buffer. Two
+// extra passes with steps 2 and 1 fix most cells jump flooding assigns to
+// a farther seed, but the map is an approximation of the Voronoi diagram:
+// about 0.1% of the cells differ at grain_size = 20 dx, more for smaller
+// grains, where seeds that share a cell are lost. Ties go to the lower seed
+// index, so the map is the same for any thread count.
+
+class GrainStructure {
+public:
+    // Grains of the Nx x Ny lattice with spacing dx; grainSize is the square
+    // root of the mean grain area (physical units)
+    GrainStructure(int Nx, int Ny, double dx, double grainSize, unsigned long long seed);
+
+    int grains() const { return grains_; }
+    int passes() const { return passes_; }
+
+    // Grain of particle id (grid index)
+    int grain(long long id) const { return grain_[id]; }
+
+private:
+    int grains_ = 0;
+    int passes_ = 0;
+    std::vector<int> grain_;
+};
@@ -0,0 +1,326 @@
+#include "job_config.h"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace {
+
+template <typename T>
+bool parseNumber(const std::string& key, const std::string& value, T& out) {
+    std::istringstream in(value);
+    T v{};
+    if (!(in >> v) || !(in >> std::ws).eof()) {
+        std::cerr << "Invalid value for " << key << ": " << value << "\n";
+        return false;
+    }
+    out = v;
+    return true;
+}
+
+}  // namespace
+
+bool setConfigValue(SimulationConfig& config, const std::string& key, const std::string& value) {
+    if (key == "Lx") return parseNumber(key, value, config.Lx);
+    if (key == "Ly") return parseNumber(key, value, config.Ly);
+    if (key == "dx") return parseNumber(key, value, config.dx);
+    if (key == "m") return parseNumber(key, value, config.m);
+    if (key == "lattice_jitter") return parseNumber(key, value, config.latticeJitter);
+    if (key == "lattice_jitter_seed") return parseNumber(key, value, config.latticeJitterSeed);
+    if (key == "phi") return parseNumber(key, value, config.phi);
+    if (key == "phi_end") return parseNumber(key, value, config.phiEnd);
+    if (key == "anisotropy") return parseNumber(key, value, config.anisotropy);
+    if (key == "anisotropy_angle") return parseNumber(key, value, config.anisotropyAngle);
+    if (key == "grain_size") return parseNumber(key, value, config.grainSize);
+    if (key == "grain_boundary_factor") return parseNumber(key, value, config.grainBoundaryFactor);
+    if (key == "grain_seed") return parseNumber(key, value, config.grainSeed);
+    if (key == "seed") return parseNumber(key, value, config.seed);
+    if (key == "nonlocal_radius") return parseNumber(key, value, config.nonlocalRadius);
+    if (key == "threads") return parseNumber(key, value, config.tuning.threads);
+    if (key == "tile_rows") return parseNumber(key, value, config.tuning.tileRows);
+    if (key == "tile_columns") return parseNumber(key, value, config.tuning.tileColumns);
+    if (key == "porosity_model") {
+        config.porosityModel = value;
+        return true;
+    }
+    if (key == "nonlocal_kernel") {
+        if (!parseNonlocalKernel(value, config.nonlocalKernel)) {
+            std::cerr << "Unknown averaging kernel: " << value << "\n";
+            return false;
+        }
+        return true;
+    }
+    if (key == "compact") return parseNumber(key, value, config.compact);
+    if (key == "loop_order") {
+        if (!parseLoopOrder(value, config.tuning.loopOrder)) {
+            std::cerr << "Unknown loop order: " << value << "\n";
+            return false;
+        }
+        return true;
+    }
+    if (key == "tuning_file") {
+        config.tuningFile = (value == "none") ? std::string() : value;
+        return true;
+    }
+    if (key == "rng") {
+        if (!parseRngEngine(value, config.rng)) {
+            std::cerr << "Unknown random engine: " << value << "\n";
+            return false;
+        }
+        return true;
+    }
+    if (key == "output_backend") {
+        if (!parseOutputBackend(value, config.output.backend)) {
+            std::cerr << "Unknown output backend: " << value << "\n";
+            return false;
+        }
+        return true;
+    }
+    if (key == "output_buffers") return parseNumber(key, value, config.output.buffers);
+    if (key == "output_buffer_mb") return parseNumber(key, value, config.output.bufferMegabytes);
+    if (key == "output_direct") return parseNumber(key, value, config.output.direct);
+    if (key == "output_format") {
+        if (value != "vtk" && value != "zarr" && value != "both") {
+            std::cerr << "Unknown output format: " << value << "\n";
+            return false;
+        }
+        config.writeVtk = (value != "zarr");
+        config.writeZarr = (value != "vtk");
+        return true;
+    }
+    if (key == "zarr_chunk") return parseNumber(key, value, config.zarrChunk);
+    if (key == "summary") return parseNumber(key, value, config.writeSummary);
+    if (key == "roofline") return parseNumber(key, value, config.roofline);
+    if (key == "metrics_port") return parseNumber(key, value, config.metricsPort);
+    if (key == "time_budget") return parseNumber(key, value, config.timeBudget);
+    if (key == "time_reserve") return parseNumber(key, value, config.timeReserve);
+    if (key == "resume") return parseNumber(key, value, config.resume);
+    if (key == "bond_storage") {
+        if (value != "none" && value != "memory" && value != "mapped") {
+            std::cerr << "Unknown bond storage: " << value << "\n";
+            return false;
+        }
+        config.keepBonds = (value != "none");
+        config.bondStorage.mapped = (value == "mapped");
+        return true;
+    }
+    if (key == "bond_dir") {
+        config.bondStorage.directory = value;
+        return true;
+    }
+    if (key == "coupling_roi") {
+        std::istringstream in(value);
+        CouplingOptions& c = config.coupling;
+        if (!(in >> c.x0 >> c.y0 >> c.x1 >> c.y1) || !(in >> std::ws).eof()) {
+            std::cerr << "Invalid value for coupling_roi (x0 y0 x1 y1): " << value << "\n";
+            return false;
+        }
+        c.enabled = true;
+        return true;
+    }
+    if (key == "coupling_blend") return parseNumber(key, value, config.coupling.blend);
+    if (key == "hole") {
+        SpecimenShape::Hole hole;
+        if (!parseHole(value, hole)) {
+            std::cerr << "Invalid value for hole (cx cy r): " << value << "\n";
+            return false;
+        }
+        config.shape.holes.push_back(hole);
+        return true;
+    }
+    if (key == "notch") {
+        SpecimenShape::Notch notch;
+        if (!parseNotch(value, notch)) {
+            std::cerr << "Invalid value for notch (x0 y0 x1 y1): " << value << "\n";
+            return false;
+        }
+        config.shape.notches.push_back(notch);
+        return true;
+    }
+    if (key == "bond_window_mb") return parseNumber(key, value, config.bondStorage.windowMegabytes);
+    if (key == "bond_compression") return parseNumber(key, value, config.bondStorage.compressed);
+    if (key == "partitions") return parseNumber(key, value, config.partitions);
+    if (key == "partition_method") {
+        if (!parsePartitionMethod(value, config.partitionMethod)) {
+            std::cerr << "Unknown partition method: " << value << " (coordinate or inertial)\n";
+            return false;
+        }
+        return true;
+    }
+    if (key == "fatigue_cycles") return parseNumber(key, value, config.fatigue.cycles);
+    if (key == "fatigue_strain") return parseNumber(key, value, config.fatigue.strain);
+    if (key == "fatigue_ratio") return parseNumber(key, value, config.fatigue.loadRatio);
+    if (key == "fatigue_A") return parseNumber(key, value, config.fatigue.coefficient);
+    if (key == "fatigue_exponent") return parseNumber(key, value, config.fatigue.exponent);
+    if (key == "fatigue_threshold") return parseNumber(key, value, config.fatigue.threshold);
+    if (key == "fatigue_critical_stretch") return parseNumber(key, value, config.fatigue.criticalStretch);
+    if (key == "fatigue_max_increment") return parseNumber(key, value, config.fatigue.maxLifeIncrement);
+    if (key == "fatigue_failure_stiffness") return parseNumber(key, value, config.fatigue.failureStiffness);
+    if (key == "fatigue_max_jumps") return parseNumber(key, value, config.fatigue.maxJumps);
+    if (key == "surface_correction") {
+        if (!parseNumber(key, value, config.fatigue.surfaceCorrection)) {
+            return false;
+        }
+        config.dynamics.surfaceCorrection = config.fatigue.surfaceCorrection;
+        return true;
+    }
+    if (key == "dynamics_steps") return parseNumber(key, value, config.dynamics.steps);
+    if (key == "dynamics_dt") return parseNumber(key, value, config.dynamics.timeStep);
+    if (key == "dynamics_strain") return parseNumber(key, value, config.dynamics.strain);
+    if (key == "dynamics_load") {
+        if (!parseLoadCase(value, config.dynamics.load)) {
+            std::cerr << "Unknown load case: " << value << " (tension, impact or bend)\n";
+            return false;
+        }
+        return true;
+    }
+    if (key == "dynamics_critical_stretch") return parseNumber(key, value, config.dynamics.criticalStretch);
+    if (key == "dynamics_max_cutbacks") return parseNumber(key, value, config.dynamics.maxCutbacks);
+    if (key == "dynamics_refine_stretch") return parseNumber(key, value, config.dynamics.refineStretch);
+    if (key == "dynamics_refine_damage") return parseNumber(key, value, config.dynamics.refineDamage);
+    if (key == "dynamics_coarsen_steps") return parseNumber(key, value, config.dynamics.coarsenSteps);
+    if (key == "precision") {
+        if (value != "double" && value != "mixed") {
+            std::cerr << "Unknown precision: " << value << "\n";
+            return false;
+        }
+        config.fatigue.mixedPrecision = (value == "mixed");
+        return true;
+    }
+    if (key == "output") {
+        config.outputFile = value;
+        return true;
+    }
+    std::cerr << "Unknown job parameter: " << key << "\n";
+    return false;
+}
+
+bool loadJobConfig(const std::string& path, SimulationConfig& config) {
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "Error: could not open job file " << path << "\n";
+        return false;
+    }
+
+    std::string line;
+    int lineNo = 0;
+    while (std::getline(in, line)) {
+        lineNo++;
+        size_t hash = line.find('#');
+        if (hash != std::string::npos) {
+            line.erase(hash);
+        }
+        line = trim(line);
+        if (line.empty()) {
+            continue;
+        }
+        size_t eq = line.find('=');
+        if (eq == std::string::npos) {
+            std::cerr << path << ":" << lineNo << ": expected key = value\n";
+            return false;
+        }
+        if (!setConfigValue(config, trim(line.substr(0, eq)), trim(line.substr(eq + 1)))) {
+            std::cerr << path << ":" << lineNo << ": invalid entry\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+bool validateConfig(const SimulationConfig& config) {
+    if (config.dx <= 0.0 || config.Lx <= 0.0 || config.Ly <= 0.0 ||
+        config.phi < 0.0 || config.phi > 1.0 || config.m <= 0.0 ||
+        config.nonlocalRadius < 0.0 || config.phiEnd < 0.0 || config.phiEnd > 1.0 ||
+        config.anisotropy < 0.0 || config.anisotropy > 1.0 || config.zarrChunk <= 0 ||
+        config.bondStorage.windowMegabytes <= 0 || config.metricsPort < 0 || config.metricsPort > 65535 ||
+        config.output.buffers <= 0 || config.output.bufferMegabytes <= 0 ||
+        config.tuning.threads < 0 || config.tuning.tileRows < 0 || config.tuning.tileColumns < -1) {
+        std::cerr << "Invalid input parameters.\n";
+        return false;
+    }
+    // The bond graph needs every decision of the run, which the state file
+    // does not keep
+    if (config.keepBonds && (config.timeBudget > 0.0 || config.resume)) {
+        std::cerr << "time_budget and resume cannot be combined with bond_storage.\n";
+        return false;
+    }
+    if (config.porosityModel == "grains" && (config.grainSize <= 0.0 || config.grainBoundaryFactor < 0.0)) {
+        std::cerr << "porosity_model = grains needs grain_size > 0 and grain_boundary_factor >= 0.\n";
+        return false;
+    }
+    if (config.latticeJitter < 0.0 || config.latticeJitter >= 0.5) {
+        std::cerr << "lattice_jitter must be in [0, 0.5).\n";
+        return false;
+    }
+    if (config.latticeJitter > 0.0 && (config.fatigue.cycles > 0.0 || config.dynamics.steps > 0)) {
+        std::cerr << "lattice_jitter cannot be combined with fatigue or dynamics (their bond solver assumes lattice geometry).\n";
+        return false;
+    }
+    if (config.coupling.enabled &&
+        (config.coupling.x1 <= config.coupling.x0 || config.coupling.y1 <= config.coupling.y0)) {
+        std::cerr << "coupling_roi needs x0 < x1 and y0 < y1.\n";
+        return false;
+    }
+    // Refinement looks bonds up by index, which packed lists cannot do
+    if (config.bondStorage.compressed && (!config.keepBonds || config.dynamics.refineStretch > 0.0)) {
+        std::cerr << "bond_compression needs the bond graph and cannot be combined with dynamics_refine_stretch.\n";
+        return false;
+    }
+    if (config.partitions < 0 || (config.partitions > 0 && !config.keepBonds)) {
+        std::cerr << "partitions must be >= 0 and needs the bond graph (bond_storage = memory or mapped).\n";
+        return false;
+    }
+    // The shape is cut from the stored graph; the correction and refinement
+    // assume the plain rectangle
+    if (!config.shape.empty()) {
+        if (!config.keepBonds) {
+            std::cerr << "hole and notch need the bond graph (bond_storage = memory or mapped).\n";
+            return false;
+        }
+        if (config.fatigue.surfaceCorrection || config.dynamics.refineStretch > 0.0) {
+            std::cerr << "hole and notch cannot be combined with surface_correction or dynamics_refine_stretch.\n";
+            return false;
+        }
+    }
+    if (config.fatigue.cycles > 0.0) {
+        const FatigueOptions& f = config.fatigue;
+        if (!config.keepBonds) {
+            std::cerr << "fatigue_cycles needs the bond graph (bond_storage = memory or mapped).\n";
+            return false;
+        }
+        if (f.strain <= 0.0 || f.loadRatio >= 1.0 || f.coefficient < 0.0 || f.exponent <= 0.0 ||
+            f.threshold < 0.0 || f.criticalStretch < 0.0 || f.maxLifeIncrement <= 0.0 ||
+            f.maxLifeIncrement > 1.0 || f.failureStiffness < 0.0 || f.maxJumps < 0) {
+            std::cerr << "Invalid fatigue parameters.\n";
+            return false;
+        }
+    }
+    if (config.dynamics.steps > 0) {
+        const DynamicsOptions& d = config.dynamics;
+        if (!config.keepBonds) {
+            std::cerr << "dynamics_steps needs the bond graph (bond_storage = memory or mapped).\n";
+            return false;
+        }
+        if (config.fatigue.cycles > 0.0) {
+            std::cerr << "dynamics_steps and fatigue_cycles cannot be combined.\n";
+            return false;
+        }
+        if (d.timeStep <= 0.0 || d.strain <= 0.0 || d.criticalStretch < 0.0 || d.maxCutbacks < 0 ||
+            d.refineStretch < 0.0 || d.refineDamage < 0.0 || d.refineDamage > 1.0 || d.coarsenSteps < 1) {
+            std::cerr << "Invalid dynamics parameters.\n";
+            return false;
+        }
+        // Refined particles leave the lattice the blending and correction
+        // factors are defined on
+        if (d.refineStretch > 0.0 && (config.coupling.enabled || d.surfaceCorrection)) {
+            std::cerr << "dynamics_refine_stretch cannot be combined with coupling_roi or surface_correction.\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string defaultOutputName(const SimulationConfig& config) {
+    return "porosity_Lx" + std::to_string(static_cast<int>(config.Lx))
+         + "_phi" + std::to_string(static_cast<int>(config.phi * 100)) + ".vtk";
+}
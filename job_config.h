@@ -0,0 +1,94 @@
+#pragma once
+
+#include "bond_graph.h"
+#include "coupling.h"
+#include "dynamics.h"
+#include "fatigue.h"
+#include "kernel_tuning.h"
+#include "nonlocal.h"
+#include "partition.h"
+#include "rng.h"
+#include "specimen.h"
+#include "vtk_output.h"
+
+#include <string>
+
+// All parameters of one simulation run. Filled either interactively or from a
+// job file of "key = value" lines ('#' starts a comment).
+struct SimulationConfig {
+    // Geometry and discretization
+    double Lx = 0.0;            // Domain size in x
+    double Ly = 0.0;            // Domain size in y
+    double dx = 0.0;            // Discretization size
+    double m = 0.0;             // Horizon factor (delta = m * dx)
+    double latticeJitter = 0.0;             // particle jitter in units of dx (see lattice_jitter.h)
+    unsigned long long latticeJitterSeed = 1;  // stream of the jitter (fixed geometry by default)
+
+    // Porosity model (see porosity_models.h)
+    std::string porosityModel = "uniform";
+    double phi = 0.0;               // Target porosity ratio (0..1)
+    double phiEnd = 0.0;            // gradient: porosity at x = Lx
+    double anisotropy = 0.0;        // anisotropic: amplitude a in [0, 1]
+    double anisotropyAngle = 0.0;   // anisotropic: preferred bond angle (degrees)
+    double grainSize = 0.0;         // grains: square root of the mean grain area
+    double grainBoundaryFactor = 3.0;  // grains: break probability factor across grain boundaries
+    unsigned long long grainSeed = 1;  // grains: stream of the grain seeds
+    unsigned long long seed = 0;    // 0 = nondeterministic seed
+    RngEngine rng = RngEngine::Xoshiro256pp;
+
+    // Local far field with a blending zone (see coupling.h)
+    CouplingOptions coupling;
+
+    // Holes and notches cut from the bond graph (see specimen.h)
+    SpecimenShape shape;
+
+    // Nonlocal averaged damage (0 = off)
+    double nonlocalRadius = 0.0;
+    NonlocalKernel nonlocalKernel = NonlocalKernel::Gaussian;
+
+    // Drop particles without an intact bond after the damage stage (see compaction.h)
+    bool compact = false;
+
+    // Execution
+    KernelTuning tuning;        // threads, tile size, loop order (auto = tuned)
+    std::string tuningFile = kTuningFile;  // empty = ignore tuned values
+    std::string outputFile;     // empty = porosity_Lx<Lx>_phi<phi>.vtk
+    OutputOptions output;       // VTK writer backend and buffering
+    bool writeVtk = true;       // output_format = vtk | zarr | both
+    bool writeZarr = false;
+    int zarrChunk = 256;        // Zarr chunk edge (particles)
+    bool writeSummary = false;  // JSON run summary next to the output
+    bool roofline = false;      // measure ceilings, add the roofline report to the summary
+    int metricsPort = 0;        // Prometheus endpoint on 127.0.0.1 (0 = off)
+
+    // Time budget (see run_state.h)
+    double timeBudget = 0.0;    // wall-clock seconds for the whole run (0 = unlimited)
+    double timeReserve = -1.0;  // seconds kept for output (-1 = 10% of the budget)
+    bool resume = false;        // continue from the state file of an earlier run
+
+    // Explicit bond graph (bond_storage = none | memory | mapped)
+    bool keepBonds = false;
+    BondStorageOptions bondStorage;
+
+    // Domain decomposition of the bond graph (see partition.h)
+    int partitions = 0;         // parts (0 = off)
+    PartitionMethod partitionMethod = PartitionMethod::Coordinate;
+
+    // Fatigue loading on the bond graph (see fatigue.h)
+    FatigueOptions fatigue;
+
+    // Implicit dynamics on the bond graph (see dynamics.h)
+    DynamicsOptions dynamics;
+};
+
+// Set one parameter by key; prints an error and returns false on bad input
+bool setConfigValue(SimulationConfig& config, const std::string& key, const std::string& value);
+
+// Read a job file; prints an error and returns false on failure
+bool loadJobConfig(const std::string& path, SimulationConfig& config);
+
+// Range checks shared by the interactive and job-file front ends
+bool validateConfig(const SimulationConfig& config);
+
+// Default VTK file name derived from the parameters
+std::string defaultOutputName(const SimulationConfig& config);
@@ -0,0 +1,196 @@
+#include "kernel_tuning.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#ifdef _WIN32
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #ifndef WIN32_LEAN_AND_MEAN
+        #define WIN32_LEAN_AND_MEAN
+    #endif
+    #include <windows.h>
+#else
+    #include <unistd.h>
+#endif
+
+namespace {
+
+std::string cpuModel() {
+#ifdef _WIN32
+    char model[256] = {};
+    DWORD size = sizeof(model);
+    if (RegGetValueA(HKEY_LOCAL_MACHINE, "HARDWARE\\DESCRIPTION\\System\\CentralProcessor\\0",
+                     "ProcessorNameString", RRF_RT_REG_SZ, nullptr, model, &size) == ERROR_SUCCESS) {
+        return trim(model);
+    }
+#else
+    std::ifstream cpuinfo("/proc/cpuinfo");
+    std::string line;
+    while (std::getline(cpuinfo, line)) {
+        // "model name" on x86, "Model" / "CPU part" elsewhere
+        if (line.rfind("model name", 0) == 0 || line.rfind("Model", 0) == 0) {
+            size_t colon = line.find(':');
+            if (colon != std::string::npos) {
+                return trim(line.substr(colon + 1));
+            }
+        }
+    }
+#endif
+    return "unknown CPU";
+}
+
+// One "[host key]" section of the tuning file
+struct TuningEntry {
+    std::string host;
+    KernelTuning tuning;
+};
+
+bool setTuningValue(KernelTuning& t, const std::string& key, const std::string& value) {
+    std::istringstream in(value);
+    if (key == "threads") return static_cast<bool>(in >> t.threads);
+    if (key == "tile_rows") return static_cast<bool>(in >> t.tileRows);
+    if (key == "tile_columns") return static_cast<bool>(in >> t.tileColumns);
+    if (key == "loop_order") return parseLoopOrder(value, t.loopOrder);
+    return false;
+}
+
+std::vector<TuningEntry> readTuningFile(const std::string& path) {
+    std::vector<TuningEntry> entries;
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line)) {
+        size_t hash = line.find('#');
+        if (hash != std::string::npos) {
+            line.erase(hash);
+        }
+        line = trim(line);
+        if (line.empty()) {
+            continue;
+        }
+        if (line.front() == '[' && line.back() == ']') {
+            entries.push_back({ trim(line.substr(1, line.size() - 2)), KernelTuning() });
+            continue;
+        }
+        size_t eq = line.find('=');
+        if (entries.empty() || eq == std::string::npos ||
+            !setTuningValue(entries.back().tuning, trim(line.substr(0, eq)), trim(line.substr(eq + 1)))) {
+            std::cerr << "Warning: ignoring line in " << path << ": " << line << "\n";
+        }
+    }
+    return entries;
+}
+
+}  // namespace
+
+std::string trim(const std::string& s) {
+    size_t b = s.find_first_not_of(" \t\r\n");
+    if (b == std::string::npos) {
+        return "";
+    }
+    size_t e = s.find_last_not_of(" \t\r\n");
+    return s.substr(b, e - b + 1);
+}
+
+bool parseLoopOrder(const std::string& name, LoopOrder& order) {
+    if (name == "auto") order = LoopOrder::Auto;
+    else if (name == "particle") order = LoopOrder::ParticleMajor;
+    else if (name == "offset") order = LoopOrder::OffsetMajor;
+    else return false;
+    return true;
+}
+
+const char* loopOrderName(LoopOrder order) {
+    switch (order) {
+    case LoopOrder::Auto: return "auto";
+    case LoopOrder::ParticleMajor: return "particle";
+    case LoopOrder::OffsetMajor: return "offset";
+    }
+    return "unknown";
+}
+
+std::string hostName() {
+#ifdef _WIN32
+    char name[MAX_COMPUTERNAME_LENGTH + 1];
+    DWORD size = sizeof(name);
+    if (GetComputerNameA(name, &size)) {
+        return std::string(name, size);
+    }
+#else
+    char name[256] = {};
+    if (gethostname(name, sizeof(name) - 1) == 0) {
+        return name;
+    }
+#endif
+    return "unknown-host";
+}
+
+std::string hostKey() {
+    return hostName() + " | " + cpuModel();
+}
+
+KernelTuning resolveTuning(const KernelTuning& requested, const std::string& path, bool& fromFile) {
+    KernelTuning stored;
+    fromFile = false;
+    const std::string host = hostKey();
+    for (const TuningEntry& entry : readTuningFile(path)) {
+        if (entry.host == host) {
+            stored = entry.tuning;
+            fromFile = true;
+        }
+    }
+
+    KernelTuning t = requested;
+    if (t.threads == 0) t.threads = stored.threads;
+    if (t.tileRows <= 0) t.tileRows = (stored.tileRows > 0) ? stored.tileRows : 16;
+    if (t.tileColumns < 0) t.tileColumns = (stored.tileColumns >= 0) ? stored.tileColumns : 0;
+    if (t.loopOrder == LoopOrder::Auto) {
+        t.loopOrder = (stored.loopOrder != LoopOrder::Auto) ? stored.loopOrder : LoopOrder::ParticleMajor;
+    }
+    return t;
+}
+
+bool saveTuning(const std::string& path, const KernelTuning& tuning) {
+    std::vector<TuningEntry> entries = readTuningFile(path);
+    const std::string host = hostKey();
+    bool replaced = false;
+    for (TuningEntry& entry : entries) {
+        if (entry.host == host) {
+            entry.tuning = tuning;
+            replaced = true;
+        }
+    }
+    if (!replaced) {
+        entries.push_back({ host, tuning });
+    }
+
+    // Write a temporary file and rename it over the old one
+    const std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp);
+        out << "# Lattice kernel tuning per host, written by Peridynamic --calibrate\n";
+        for (const TuningEntry& entry : entries) {
+            out << "\n[" << entry.host << "]\n"
+                << "threads = " << entry.tuning.threads << "\n"
+                << "tile_rows = " << entry.tuning.tileRows << "\n"
+                << "tile_columns = " << entry.tuning.tileColumns << "\n"
+                << "loop_order = " << loopOrderName(entry.tuning.loopOrder) << "\n";
+        }
+        if (!out) {
+            std::cerr << "Error: could not write " << tmp << "\n";
+            return false;
+        }
+    }
+#ifdef _WIN32
+    std::remove(path.c_str());  // rename does not replace existing files here
+#endif
+    if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+        std::cerr << "Error: could not replace " << path << "\n";
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <string>
+
+// Machine-dependent knobs of the lattice kernels.
+//
+// The best values differ between node types, so `Peridynamic --calibrate`
+// measures them and stores the winner per host / CPU model in a local tuning
+// file. Later runs on the same host load it automatically; any knob given in
+// the job file takes precedence.
+
+// Traversal order inside a tile of the pre-damage kernel
+enum class LoopOrder {
+    Auto,           // tuned value, else ParticleMajor
+    ParticleMajor,  // for each particle: every stencil offset
+    OffsetMajor     // for each stencil offset: every particle of the tile row
+};
+
+bool parseLoopOrder(const std::string& name, LoopOrder& order);
+const char* loopOrderName(LoopOrder order);
+
+struct KernelTuning {
+    int threads = 0;        // 0 = hardware concurrency
+    int tileRows = 0;       // rows per parallel task (0 = auto, default 16)
+    int tileColumns = -1;   // columns per tile (-1 = auto, 0 = whole rows)
+    LoopOrder loopOrder = LoopOrder::Auto;
+};
+
+// Default tuning file, in the working directory
+const char* const kTuningFile = "peridynamic_tuning.cfg";
+
+// s without leading and trailing whitespace (shared by the job and tuning file parsers)
+std::string trim(const std::string& s);
+
+// Name of this machine
+std::string hostName();
+
+// "hostname | CPU model" identifying the machine in the tuning file
+std::string hostKey();
+
+// Replace the automatic fields of requested with the tuned values stored for
+// this host (or the built-in defaults). Sets fromFile if an entry was used.
+KernelTuning resolveTuning(const KernelTuning& requested, const std::string& path, bool& fromFile);
+
+// Store tuning as the entry of this host, keeping the entries of other hosts
+bool saveTuning(const std::string& path, const KernelTuning& tuning);
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Integer neighbor stencil of the regular particle grid.
+// On the lattice, particle (i, j) is bonded to (i + di, j + dj) whenever the
+// offset lies inside the horizon, so bond discovery is O(N * stencil size)
+// instead of the all-pairs O(N^2) search.
+
+struct StencilOffset {
+    int di;
+    int dj;
+};
+
+struct BondStencil {
+    std::vector<StencilOffset> full;  // every offset inside the horizon
+    std::vector<StencilOffset> half;  // each bond once: dj > 0, or dj == 0 and di > 0
+    int reach = 0;                    // max |di| (= max |dj|)
+};
+
+// Offsets with |(di, dj)| * dx <= delta. A relative tolerance keeps offsets
+// that lie exactly on the horizon (e.g. (m, 0) for integer m) inside.
+inline BondStencil buildBondStencil(double dx, double delta) {
+    BondStencil s;
+    double limit = (delta / dx) * (delta / dx) * (1.0 + 1e-12);
+    s.reach = static_cast<int>(std::floor(delta / dx + 1e-12));
+    for (int dj = -s.reach; dj <= s.reach; ++dj) {
+        for (int di = -s.reach; di <= s.reach; ++di) {
+            if (di == 0 && dj == 0) {
+                continue;
+            }
+            if (static_cast<double>(di * di + dj * dj) <= limit) {
+                s.full.push_back({ di, dj });
+                if (dj > 0 || (dj == 0 && di > 0)) {
+                    s.half.push_back({ di, dj });
+                }
+            }
+        }
+    }
+    return s;
+}
+
+// Number of stencil neighbors of (i, j) that fall inside the Nx x Ny grid
+inline int countLatticeNeighbors(const BondStencil& s, int i, int j, int Nx, int Ny) {
+    // Interior particles see the whole stencil
+    if (i >= s.reach && i < Nx - s.reach && j >= s.reach && j < Ny - s.reach) {
+        return static_cast<int>(s.full.size());
+    }
+    int count = 0;
+    for (const StencilOffset& o : s.full) {
+        int ni = i + o.di;
+        int nj = j + o.dj;
+        if (ni >= 0 && ni < Nx && nj >= 0 && nj < Ny) {
+            count++;
+        }
+    }
+    return count;
+}
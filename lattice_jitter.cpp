@@ -0,0 +1,28 @@
+#include "lattice_jitter.h"
+
+#include "parallel.h"
+#include "rng.h"
+
+#include <cmath>
+
+LatticeJitter::LatticeJitter(int Nx, int Ny, double amplitude, unsigned long long seed, double dx, double delta)
+    : Nx_(Nx), limit_((delta / dx) * (delta / dx) * (1.0 + 1e-12)) {
+    const long long N = static_cast<long long>(Nx) * Ny;
+    x_.resize(N);
+    y_.resize(N);
+    parallelFor(N, 16384, [&](long long i0, long long i1) {
+        for (long long id = i0; id < i1; ++id) {
+            SplitMixEngine rng = SplitMixEngine::forStream(seed, static_cast<uint64_t>(id));
+            // 53-bit uniforms in [0, 1) mapped to [-a, a]
+            double ux = static_cast<double>(rng.next() >> 11) * 0x1.0p-53;
+            double uy = static_cast<double>(rng.next() >> 11) * 0x1.0p-53;
+            x_[id] = static_cast<float>(amplitude * (2.0 * ux - 1.0));
+            y_[id] = static_cast<float>(amplitude * (2.0 * uy - 1.0));
+        }
+    });
+}
+
+BondStencil LatticeJitter::candidateStencil(double dx, double delta, double amplitude) {
+    // Float offsets may exceed a by a rounding step; the margin covers it
+    return buildBondStencil(dx, delta + (2.0 * std::sqrt(2.0) * amplitude + 1e-6) * dx);
+}
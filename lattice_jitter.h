@@ -0,0 +1,60 @@
+#pragma once
+
+#include "lattice.h"
+
+#include <cstdint>
+#include <vector>
+
+// Jittered lattice (lattice_jitter = a in the job file, 0 <= a < 0.5).
+//
+// Particle (i, j) sits at ((i + xi_x) dx, (j + xi_y) dx) with xi_x, xi_y
+// uniform in [-a, a], drawn from its own random stream. Storage, indexing
+// and traversal stay those of the regular grid. Bond discovery runs over a
+// candidate stencil enlarged by the largest relative jitter (2 sqrt(2) a),
+// and an exact distance test decides which candidates are bonds. Both ends
+// evaluate the test on the same numbers (the float difference of the offsets
+// negates exactly), so they always agree on a bond.
+
+class LatticeJitter {
+public:
+    // Offsets of all Nx x Ny particles; delta and dx give the exact horizon
+    LatticeJitter(int Nx, int Ny, double amplitude, unsigned long long seed, double dx, double delta);
+
+    // Candidate stencil: every lattice offset that can come within the
+    // horizon once both ends are jittered
+    static BondStencil candidateStencil(double dx, double delta, double amplitude);
+
+    // Offset of particle id from its grid point (in units of dx)
+    double offsetX(long long id) const { return x_[id]; }
+    double offsetY(long long id) const { return y_[id]; }
+
+    // Whether particle id and its lattice neighbor nid = id + (di, dj) are
+    // within the horizon
+    bool hasBond(long long id, long long nid, int di, int dj) const {
+        double ex = di + static_cast<double>(x_[nid] - x_[id]);
+        double ey = dj + static_cast<double>(y_[nid] - y_[id]);
+        return ex * ex + ey * ey <= limit_;
+    }
+
+    // keep[i - first] = whether (i, j) has its bond along o, for grid columns
+    // i in [first, last) whose neighbor lies in the grid (branch-free, so the
+    // loop vectorizes)
+    void filterRow(int j, const StencilOffset& o, int first, int last, uint8_t* keep) const {
+        const float* xi = x_.data() + static_cast<long long>(j) * Nx_;
+        const float* yi = y_.data() + static_cast<long long>(j) * Nx_;
+        const float* xn = xi + static_cast<long long>(o.dj) * Nx_ + o.di;
+        const float* yn = yi + static_cast<long long>(o.dj) * Nx_ + o.di;
+        const double di = o.di;
+        const double dj = o.dj;
+        for (int i = first; i < last; ++i) {
+            double ex = di + static_cast<double>(xn[i] - xi[i]);
+            double ey = dj + static_cast<double>(yn[i] - yi[i]);
+            keep[i - first] = static_cast<uint8_t>(ex * ex + ey * ey <= limit_);
+        }
+    }
+
+private:
+    int Nx_ = 0;
+    std::vector<float> x_, y_;
+    double limit_ = 0.0;  // squared horizon in grid units
+};
@@ -0,0 +1,95 @@
+#include "lattice_stages.h"
+
+#include "metrics.h"
+#include "parallel.h"
+
+#include <algorithm>
+
+void computeNeighborCounts(const BondStencil& stencil, const CouplingZone* coupling, const LatticeJitter* jitter,
+                           int Nx, int Ny, int tileRows, std::vector<int>& N_total) {
+    // Coupled runs visit the longer offsets only in the columns around the
+    // region of interest
+    BondStencil nearest;
+    for (const StencilOffset& o : stencil.full) {
+        if (CouplingZone::nearestNeighbor(o.di, o.dj)) {
+            nearest.full.push_back(o);
+            nearest.reach = 1;
+        }
+    }
+
+    // Each particle only writes its own count, so rows run in parallel
+    N_total.assign(static_cast<size_t>(Nx) * Ny, 0);
+    parallelFor(Ny, tileRows, [&](long long j0, long long j1) {
+        std::vector<uint8_t> keep(jitter != nullptr ? Nx : 0);
+        for (int j = static_cast<int>(j0); j < j1; ++j) {
+            int* counts = &N_total[static_cast<size_t>(j) * Nx];
+            int spanFirst = 0;
+            int spanLast = Nx;
+            if (coupling != nullptr) {
+                coupling->nonlocalSpan(j, stencil.reach, Nx, spanFirst, spanLast);
+            }
+            if (jitter != nullptr) {
+                // Offset by offset over the row: the distance filter vectorizes
+                for (const StencilOffset& o : stencil.full) {
+                    int nj = j + o.dj;
+                    if (nj < 0 || nj >= Ny) {
+                        continue;
+                    }
+                    int first = std::max(0, -o.di);
+                    int last = std::min(Nx, Nx - o.di);
+                    if (!CouplingZone::nearestNeighbor(o.di, o.dj)) {
+                        first = std::max(first, spanFirst);
+                        last = std::min(last, spanLast);
+                    }
+                    if (first >= last) {
+                        continue;
+                    }
+                    jitter->filterRow(j, o, first, last, keep.data());
+                    for (int i = first; i < last; ++i) {
+                        bool kept = keep[i - first] && (coupling == nullptr || coupling->hasBond(i, j, o.di, o.dj));
+                        counts[i] += kept ? 1 : 0;
+                    }
+                }
+                continue;
+            }
+            for (int i = 0; i < Nx; ++i) {
+                if (coupling == nullptr) {
+                    N_total[j * Nx + i] = countLatticeNeighbors(stencil, i, j, Nx, Ny);
+                    continue;
+                }
+                if (i < spanFirst || i >= spanLast) {
+                    N_total[j * Nx + i] = countLatticeNeighbors(nearest, i, j, Nx, Ny);
+                    continue;
+                }
+                int count = 0;
+                for (const StencilOffset& o : stencil.full) {
+                    int ni = i + o.di;
+                    int nj = j + o.dj;
+                    if (ni >= 0 && ni < Nx && nj >= 0 && nj < Ny && coupling->hasBond(i, j, o.di, o.dj)) {
+                        count++;
+                    }
+                }
+                N_total[j * Nx + i] = count;
+            }
+        }
+        metricsCountParticles((j1 - j0) * Nx);
+    });
+}
+
+void computeLocalDamage(const std::vector<int>& N_total, const std::vector<int>& N_broken,
+                        int Nx, int tileRows, std::vector<double>& damage) {
+    const long long N = static_cast<long long>(N_total.size());
+    damage.assign(N, 0.0);
+    parallelFor(N, static_cast<long long>(tileRows) * Nx, [&](long long i0, long long i1) {
+        for (long long i = i0; i < i1; ++i) {
+            if (N_total[i] > 0) {
+                damage[i] = static_cast<double>(N_broken[i]) /
+                    static_cast<double>(N_total[i]);
+            }
+            else {
+                damage[i] = 0.0;  // isolated point, no neighbors
+            }
+        }
+        metricsCountParticles(i1 - i0);
+    });
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "coupling.h"
+#include "lattice.h"
+#include "lattice_jitter.h"
+
+#include <vector>
+
+// Per-particle stages of runSimulation that only depend on the lattice, shared
+// with the calibration micro-runs. tileRows is the number of grid rows per
+// parallel task.
+
+// Step 3: N(i), the number of bonds of every particle. With a coupling zone
+// (nullptr = full stencil everywhere) only the bonds it keeps are counted;
+// on a jittered lattice (nullptr = regular) only candidates in the horizon.
+void computeNeighborCounts(const BondStencil& stencil, const CouplingZone* coupling, const LatticeJitter* jitter,
+                           int Nx, int Ny, int tileRows, std::vector<int>& N_total);
+
+// Step 5: local damage d(i) = Nb(i) / N(i) (0 for isolated points)
+void computeLocalDamage(const std::vector<int>& N_total, const std::vector<int>& N_broken,
+                        int Nx, int tileRows, std::vector<double>& damage);
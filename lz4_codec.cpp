@@ -0,0 +1,162 @@
+#include "lz4_codec.h"
+
+#include <cstring>
+
+namespace {
+
+// LZ4 block format constants
+const size_t kMinMatch = 4;
+const size_t kLastLiterals = 5;   // the last 5 bytes are always literals
+const size_t kMatchFindLimit = 12;  // a match must start >= 12 bytes before the end
+const int kHashBits = 13;
+const size_t kMaxOffset = 65535;
+
+inline uint32_t read32(const uint8_t* p) {
+    uint32_t v;
+    std::memcpy(&v, p, 4);
+    return v;
+}
+
+inline uint32_t hash4(uint32_t seq) {
+    return (seq * 2654435761U) >> (32 - kHashBits);
+}
+
+// LZ4 length extension: runs of 255 followed by the remainder
+void putLength(std::vector<uint8_t>& out, size_t len) {
+    while (len >= 255) {
+        out.push_back(255);
+        len -= 255;
+    }
+    out.push_back(static_cast<uint8_t>(len));
+}
+
+void putSequence(std::vector<uint8_t>& out, const uint8_t* literals, size_t litLen,
+                 size_t offset, size_t matchLen) {
+    size_t m = (matchLen > 0) ? matchLen - kMinMatch : 0;
+    uint8_t token = static_cast<uint8_t>(((litLen >= 15 ? 15 : litLen) << 4) | (m >= 15 ? 15 : m));
+    out.push_back(token);
+    if (litLen >= 15) {
+        putLength(out, litLen - 15);
+    }
+    out.insert(out.end(), literals, literals + litLen);
+    if (matchLen == 0) {
+        return;  // final literal-only sequence
+    }
+    out.push_back(static_cast<uint8_t>(offset & 0xFF));
+    out.push_back(static_cast<uint8_t>(offset >> 8));
+    if (m >= 15) {
+        putLength(out, m - 15);
+    }
+}
+
+}  // namespace
+
+void byteShuffle(const uint8_t* src, uint8_t* dst, size_t count, size_t elementSize) {
+    for (size_t i = 0; i < count; ++i) {
+        for (size_t b = 0; b < elementSize; ++b) {
+            dst[b * count + i] = src[i * elementSize + b];
+        }
+    }
+}
+
+void byteUnshuffle(const uint8_t* src, uint8_t* dst, size_t count, size_t elementSize) {
+    for (size_t i = 0; i < count; ++i) {
+        for (size_t b = 0; b < elementSize; ++b) {
+            dst[i * elementSize + b] = src[b * count + i];
+        }
+    }
+}
+
+// Greedy single-pass LZ4 compressor with an 8K-entry hash table of 4-byte sequences
+size_t lz4Compress(const uint8_t* src, size_t n, std::vector<uint8_t>& out) {
+    out.clear();
+    out.reserve(n + n / 255 + 16 + 4);
+    for (int b = 0; b < 4; ++b) {
+        out.push_back(static_cast<uint8_t>(n >> (8 * b)));
+    }
+
+    size_t anchor = 0;
+    if (n > kMatchFindLimit) {
+        // Positions are stored + 1 so that 0 means "empty"
+        std::vector<uint32_t> table(static_cast<size_t>(1) << kHashBits, 0);
+        const size_t matchStartLimit = n - kMatchFindLimit;
+        const size_t matchEndLimit = n - kLastLiterals;
+        size_t ip = 0;
+        while (ip < matchStartLimit) {
+            uint32_t seq = read32(src + ip);
+            uint32_t h = hash4(seq);
+            size_t stored = table[h];
+            table[h] = static_cast<uint32_t>(ip + 1);
+            if (stored == 0 || ip - (stored - 1) > kMaxOffset || read32(src + stored - 1) != seq) {
+                ip++;
+                continue;
+            }
+            size_t r = stored - 1;
+            size_t len = kMinMatch;
+            while (ip + len < matchEndLimit && src[r + len] == src[ip + len]) {
+                len++;
+            }
+            putSequence(out, src + anchor, ip - anchor, ip - r, len);
+            ip += len;
+            anchor = ip;
+        }
+    }
+    putSequence(out, src + anchor, n - anchor, 0, 0);
+    return out.size();
+}
+
+bool lz4Decompress(const uint8_t* src, size_t n, std::vector<uint8_t>& out) {
+    if (n < 4) {
+        return false;
+    }
+    size_t size = static_cast<size_t>(src[0]) | (static_cast<size_t>(src[1]) << 8) |
+                  (static_cast<size_t>(src[2]) << 16) | (static_cast<size_t>(src[3]) << 24);
+    out.assign(size, 0);
+    size_t ip = 4;
+    size_t op = 0;
+    while (ip < n) {
+        uint8_t token = src[ip++];
+        size_t litLen = token >> 4;
+        if (litLen == 15) {
+            uint8_t b;
+            do {
+                if (ip >= n) return false;
+                b = src[ip++];
+                litLen += b;
+            } while (b == 255);
+        }
+        if (ip + litLen > n || op + litLen > size) {
+            return false;
+        }
+        std::memcpy(out.data() + op, src + ip, litLen);
+        ip += litLen;
+        op += litLen;
+        if (ip == n) {
+            break;  // last sequence has no match part
+        }
+        if (ip + 2 > n) {
+            return false;
+        }
+        size_t offset = static_cast<size_t>(src[ip]) | (static_cast<size_t>(src[ip + 1]) << 8);
+        ip += 2;
+        size_t matchLen = (token & 15);
+        if (matchLen == 15) {
+            uint8_t b;
+            do {
+                if (ip >= n) return false;
+                b = src[ip++];
+                matchLen += b;
+            } while (b == 255);
+        }
+        matchLen += kMinMatch;
+        if (offset == 0 || offset > op || op + matchLen > size) {
+            return false;
+        }
+        // Byte-wise copy: the source may overlap the destination
+        for (size_t k = 0; k < matchLen; ++k) {
+            out[op + k] = out[op - offset + k];
+        }
+        op += matchLen;
+    }
+    return op == size;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// In-tree chunk codec: byte shuffle followed by LZ4 block compression.
+//
+// Both stages produce the exact formats of the numcodecs "shuffle" filter and
+// "lz4" compressor (LZ4 block prefixed by the little-endian uint32
+// uncompressed size), so Zarr readers decode the chunks without plugins.
+
+// Transpose the bytes of count elements of elementSize bytes each
+// (all first bytes, then all second bytes, ...)
+void byteShuffle(const uint8_t* src, uint8_t* dst, size_t count, size_t elementSize);
+void byteUnshuffle(const uint8_t* src, uint8_t* dst, size_t count, size_t elementSize);
+
+// Compress n bytes into out (numcodecs lz4 framing); returns the encoded size
+size_t lz4Compress(const uint8_t* src, size_t n, std::vector<uint8_t>& out);
+
+// Decode numcodecs lz4 framing; returns false on malformed input
+bool lz4Decompress(const uint8_t* src, size_t n, std::vector<uint8_t>& out);
@@ -3,9 +3,40 @@
 #include <cmath>
 #include <random>
 #include <fstream>
-#include <iomanip>
 #include <string>
 #include <cstdlib>
+#include <chrono>
+#include <filesystem>
+#include <memory>
+
+#include "benchmark.h"
+#include "bond_graph.h"
+#include "calibration.h"
+#include "compare.h"
+#include "compaction.h"
+#include "dynamics.h"
+#include "fatigue.h"
+#include "grain_structure.h"
+#include "job_config.h"
+#include "lattice.h"
+#include "lattice_jitter.h"
+#include "lattice_stages.h"
+#include "metrics.h"
+#include "particle.h"
+#include "nonlocal.h"
+#include "parallel.h"
+#include "partition.h"
+#include "porosity_models.h"
+#include "precision_check.h"
+#include "reduction.h"
+#include "rng_benchmark.h"
+#include "roofline.h"
+#include "run_state.h"
+#include "run_summary.h"
+#include "specimen.h"
+#include "sweep.h"
+#include "vtk_output.h"
+#include "zarr_store.h"
 
 #ifdef _WIN32
     #include <direct.h>  // For _getcwd on Windows
@@ -13,19 +44,6 @@
     #include <unistd.h>  // For getcwd on Linux/macOS
 #endif
 
-// Simple 2D particle representation
-struct Particle {
-    double x;
-    double y;
-};
-
-// Helper: squared distance between two particles
-double dist2(const Particle& a, const Particle& b) {
-    double dx = a.x - b.x;
-    double dy = a.y - b.y;
-    return dx * dx + dy * dy;
-}
-
 // Function to open VTK file with ParaView
 void openVTKFile(const std::string& filename) {
     // Get absolute path
@@ -93,35 +111,113 @@ void openVTKFile(const std::string& filename) {
     std::cout << "3. Navigate to the file above and select it\n";
 }
 
-// Main simulation function
-void runSimulation() {
-    // -----------------------------
-    // 1. Read user input
-    // -----------------------------
-    double Lx, Ly;       // Domain size in x and y
-    double dx;           // Discretization size
-    double phi;          // Target porosity ratio (0..1)
-    double m;            // Horizon factor (delta = m * dx)
+// Summary of one finished run
+struct RunResult {
+    std::string outputFile;
+    long long totalBonds = 0;
+    long long brokenBonds = 0;
+    double realizedPorosity = 0.0;
+    double meanDamage = 0.0;
+    bool partial = false;   // stopped by the time budget (resumable)
+    int completeRows = 0;   // rows of the grid in the output
+    long long particles = 0;            // particles the solvers ran on
+    unsigned long long bondBytes = 0;   // bond graph storage
+    DynamicsResult dynamics;            // without the per-particle fields
+    double dynamicsSeconds = 0.0;
+};
 
+// Ask for the run parameters on the console
+bool readInteractiveConfig(SimulationConfig& config) {
     std::cout << "\n===== Peridynamic Porosity Simulation =====\n";
     std::cout << "Enter domain length in x (Lx): ";
-    std::cin >> Lx;
+    std::cin >> config.Lx;
     std::cout << "Enter domain length in y (Ly): ";
-    std::cin >> Ly;
+    std::cin >> config.Ly;
     std::cout << "Enter discretization size (dx): ";
-    std::cin >> dx;
+    std::cin >> config.dx;
     std::cout << "Enter porosity ratio phi (0.1): ";
-    std::cin >> phi;
+    std::cin >> config.phi;
     std::cout << "Enter horizon factor m (delta = m*dx): ";
-    std::cin >> m;
+    std::cin >> config.m;
+    std::cout << "Enter nonlocal averaging radius (0 to skip): ";
+    std::cin >> config.nonlocalRadius;
+    if (config.nonlocalRadius > 0.0) {
+        std::string kernelName;
+        std::cout << "Enter averaging kernel (gaussian/tophat): ";
+        std::cin >> kernelName;
+        if (!parseNonlocalKernel(kernelName, config.nonlocalKernel)) {
+            std::cerr << "Unknown averaging kernel: " << kernelName << "\n";
+            return false;
+        }
+    }
+    return true;
+}
 
-    if (dx <= 0.0 || Lx <= 0.0 || Ly <= 0.0 || phi < 0.0 || phi > 1.0 || m <= 0.0) {
-        std::cerr << "Invalid input parameters.\n";
-        return;
+// Main simulation function
+bool runSimulation(const SimulationConfig& config, RunResult& result) {
+    // -----------------------------
+    // 1. Validate parameters
+    // -----------------------------
+    if (!validateConfig(config)) {
+        return false;
     }
+    // Compute stages stop early enough to leave time_reserve for the output
+    const double reserve = (config.timeReserve >= 0.0) ? config.timeReserve : 0.1 * config.timeBudget;
+    const Deadline deadline(config.timeBudget > 0.0 ? std::max(1e-3, config.timeBudget - reserve) : 0.0);
+
+    const PorosityModelInfo* model = findPorosityModel(config.porosityModel);
+    if (model == nullptr) {
+        std::cerr << "Unknown porosity model: " << config.porosityModel << "\n";
+        std::cerr << "Available models:\n";
+        listPorosityModels(std::cerr);
+        return false;
+    }
+
+    const double Lx = config.Lx;
+    const double Ly = config.Ly;
+    const double dx = config.dx;
+    const double m = config.m;
 
-    // Pre-damage index d_phi = phi / phi_c, with phi_c = 1.0
-    double d_phi = phi;  // since phi_c = 1.0
+    // Live telemetry for the whole run
+    MetricsServer metricsServer;
+    if (config.metricsPort > 0 && !metricsServer.start(config.metricsPort)) {
+        return false;
+    }
+
+    // Knobs left on auto come from this host's calibration, if any
+    bool tuned = false;
+    const KernelTuning tuning = resolveTuning(config.tuning, config.tuningFile, tuned);
+    setWorkerThreads(tuning.threads);
+    if (tuned) {
+        std::cout << "Using tuned kernels from " << config.tuningFile << ": " << workerThreads()
+            << " threads, tile " << tuning.tileRows << " rows x "
+            << (tuning.tileColumns > 0 ? std::to_string(tuning.tileColumns) : std::string("full"))
+            << " columns, " << loopOrderName(tuning.loopOrder) << "-major\n";
+    }
+
+    // Startup micro-benchmarks for the roofline report
+    RunSummary summary;
+    if (config.roofline) {
+        summary.ceilings = measureCeilings();
+        summary.hasRoofline = true;
+        std::cout << "Machine ceilings (" << summary.ceilings.threads << " threads): "
+            << summary.ceilings.bytesPerSecond / 1e9 << " GB/s STREAM triad, "
+            << summary.ceilings.opsPerSecond / 1e9 << " Gop/s multiply-add\n";
+    }
+    auto stageStart = std::chrono::steady_clock::now();
+    auto beginStage = [&](const char* name) {
+        metricsSetStage(name);
+        stageStart = std::chrono::steady_clock::now();
+    };
+    auto endStage = [&](const char* name, double bytes, double ops) {
+        auto now = std::chrono::steady_clock::now();
+        StageWork stage{ name };
+        stage.seconds = std::chrono::duration<double>(now - stageStart).count();
+        stage.bytes = bytes;
+        stage.ops = ops;
+        summary.stages.push_back(stage);
+        stageStart = now;
+    };
 
     // -----------------------------
     // 2. Build regular grid of particles
@@ -136,67 +232,214 @@ void runSimulation() {
 
     std::vector<Particle> particles(N);
 
+    // Jittered lattices move every particle off its grid point by up to
+    // latticeJitter * dx in x and y; storage and traversal stay regular
+    const double delta = m * dx;
+    std::unique_ptr<LatticeJitter> jitter;
+    if (config.latticeJitter > 0.0) {
+        jitter = std::make_unique<LatticeJitter>(Nx, Ny, config.latticeJitter, config.latticeJitterSeed, dx, delta);
+    }
+
     // Fill grid (row-major: j = y-direction, i = x-direction)
     for (int j = 0; j < Ny; ++j) {
         for (int i = 0; i < Nx; ++i) {
             int id = j * Nx + i;
             particles[id].x = i * dx;
             particles[id].y = j * dx;
+            if (jitter) {
+                particles[id].x += jitter->offsetX(id) * dx;
+                particles[id].y += jitter->offsetY(id) * dx;
+            }
         }
     }
 
     // -----------------------------
     // 3. Compute neighbor counts N(i)
     // -----------------------------
-    double delta = m * dx;
-    double delta2 = delta * delta;
+    // On a jittered lattice the stencil holds the candidates of the exact
+    // distance test
+    BondStencil stencil = jitter ? LatticeJitter::candidateStencil(dx, delta, config.latticeJitter)
+                                 : buildBondStencil(dx, delta);
+
+    // Coupled runs keep the full stencil only around the region of interest
+    const CouplingZone couplingZone(config.coupling, dx, delta);
+    const CouplingZone* coupling = config.coupling.enabled ? &couplingZone : nullptr;
 
     std::vector<int> N_total(N, 0);   // N(i): total number of bonds for each particle
     std::vector<int> N_broken(N, 0);  // Nb(i): number of broken bonds for each particle
 
     // First pass: determine total number of bonds per particle
-    // (no damage applied yet)
+    // (no damage applied yet).
     std::cout << "Computing neighbors (N(i))...\n";
-    for (int i = 0; i < N; ++i) {
-        for (int j = i + 1; j < N; ++j) {
-            if (dist2(particles[i], particles[j]) <= delta2) {
-                // i and j are neighbors -> one bond
-                N_total[i]++;
-                N_total[j]++;
-            }
+    beginStage("neighbor");
+    computeNeighborCounts(stencil, coupling, jitter.get(), Nx, Ny, tuning.tileRows, N_total);
+    {
+        // Interior particles take the fast path; boundary ones test every offset
+        long long interior = static_cast<long long>(std::max(0, Nx - 2 * stencil.reach)) *
+                             std::max(0, Ny - 2 * stencil.reach);
+        endStage("neighbor", 4.0 * N,
+                 4.0 * N + 4.0 * static_cast<double>(N - interior) * stencil.full.size());
+    }
+
+    // Global bond total: every bond is counted at both of its particles
+    long long totalBonds = exactIntegerSum(N, [&](long long i) { return N_total[i]; }) / 2;
+    if (coupling != nullptr) {
+        // Bonds of the full stencil everywhere: each half offset fits
+        // (Nx - |di|) * (Ny - |dj|) times
+        long long fullBonds = 0;
+        for (const StencilOffset& o : stencil.half) {
+            fullBonds += static_cast<long long>(std::max(0, Nx - std::abs(o.di))) * std::max(0, Ny - std::abs(o.dj));
         }
+        std::cout << "Coupled run: " << totalBonds << " bonds instead of " << fullBonds << " ("
+            << (totalBonds > 0 ? static_cast<double>(fullBonds) / totalBonds : 0.0) << "x fewer)\n";
+    }
+
+    // Grain map of the polycrystal model, built once for all bands
+    std::unique_ptr<GrainStructure> grains;
+    if (config.porosityModel == "grains") {
+        beginStage("grains");
+        grains = std::make_unique<GrainStructure>(Nx, Ny, dx, config.grainSize, config.grainSeed);
+        // Every pass reads nine entries and writes one per particle
+        endStage("grains", grains->passes() * 40.0 * N, grains->passes() * 9.0 * N);
+        std::cout << "Grains: " << grains->grains() << " Voronoi grains of size " << config.grainSize << " ("
+            << grains->passes() << " jump flooding passes)\n";
     }
 
     // -----------------------------
-    // 4. Apply pre-damage algorithm (uniform porosity)
+    // 4. Apply pre-damage algorithm (porosity model)
     // -----------------------------
-    std::cout << "Applying pre-damage (uniform porosity)...\n";
-
-    // Random number in [0,1)
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_real_distribution<> uniform01(0.0, 1.0);
-
-    int totalBonds = 0;
-    int brokenBonds = 0;
-
-    for (int i = 0; i < N; ++i) {
-        for (int j = i + 1; j < N; ++j) {
-            if (dist2(particles[i], particles[j]) <= delta2) {
-                totalBonds++;
-                double r = uniform01(gen);
-
-                // Uniform porosity: d_phi(i) is same for all i
-                if (r < d_phi) {
-                    // break bond (i,j)
-                    N_broken[i]++;
-                    N_broken[j]++;
-                    brokenBonds++;
-                }
+    std::cout << "Applying pre-damage (" << model->name << " porosity, "
+        << rngEngineName(config.rng) << ")...\n";
+
+    PreDamageSetup setup;
+    setup.Nx = Nx;
+    setup.Ny = Ny;
+    setup.dx = dx;
+    setup.stencil = &stencil;
+    setup.config = &config;
+    setup.seed = config.seed;
+    setup.tuning = tuning;
+    setup.coupling = coupling;
+    setup.jitter = jitter.get();
+    setup.grains = grains.get();
+    if (setup.seed == 0) {
+        std::random_device rd;
+        setup.seed = (static_cast<unsigned long long>(rd()) << 32) | rd();
+    }
+
+    // Per-bond decisions are recorded when the run keeps an explicit bond graph
+    MappedArray<uint8_t> halfState;
+    if (config.keepBonds) {
+        std::string scratch = config.bondStorage.mapped ? config.bondStorage.directory : std::string();
+        if (!halfState.allocate(static_cast<size_t>(N) * stencil.half.size(), scratch)) {
+            return false;
+        }
+        setup.bondState = halfState.data();
+    }
+
+    // Continue an interrupted run: restore its seed and the counts of the
+    // rows it finished (plus the partial counts of the next `reach` rows)
+    const std::string stateFile =
+        runStateName(config.outputFile.empty() ? defaultOutputName(config) : config.outputFile);
+    int firstRow = 0;
+    if (config.resume) {
+        RunState state;
+        if (!loadRunState(stateFile, state)) {
+            return false;
+        }
+        if (state.fingerprint != runFingerprint(config) || (config.seed != 0 && config.seed != state.seed) ||
+            state.completeRows > Ny || state.N_broken.size() > N_broken.size()) {
+            std::cerr << "Error: " << stateFile << " belongs to a different job\n";
+            return false;
+        }
+        setup.seed = state.seed;
+        firstRow = state.completeRows;
+        std::copy(state.N_broken.begin(), state.N_broken.end(), N_broken.begin());
+        std::cout << "Resuming at row " << firstRow << " of " << Ny << "\n";
+    }
+
+    // With a time budget the kernel runs in bands of rows, checking the
+    // deadline in between; rows before the current band are final.
+    int completeRows = Ny;
+    const int bandRows = (config.timeBudget > 0.0)
+        ? std::max(16, stencil.reach) * 4 * workerThreads()
+        : std::max(1, Ny - firstRow);
+    beginStage("pre_damage");
+    for (int j = firstRow; j < Ny; j += bandRows) {
+        // The first band always runs so every resume makes progress
+        if (j > firstRow && deadline.expired()) {
+            completeRows = j;
+            break;
+        }
+        setup.rowBegin = j;
+        setup.rowEnd = std::min(Ny, j + bandRows);
+        model->kernel(config.rng)(setup, N_broken);
+    }
+    const double halfSlots = static_cast<double>(N) * stencil.half.size();
+    // One draw per bond; Nb(i) is read and written once per particle
+    endStage("pre_damage", 8.0 * N + (config.keepBonds ? halfSlots : 0.0),
+             opsPerBondDraw(config.rng) * static_cast<double>(totalBonds));
+
+    BondGraph bonds;
+    if (config.keepBonds) {
+        metricsSetStage("bond_graph");
+        if (!buildBondGraph(Nx, Ny, stencil, coupling, jitter.get(), N_total, halfState, config.bondStorage, bonds)) {
+            return false;
+        }
+        halfState = MappedArray<uint8_t>();
+        // Reads the decisions, writes neighbor index and state of every directed bond
+        endStage("bond_graph", halfSlots + 8.0 * N + 5.0 * bonds.bonds(), 4.0 * bonds.bonds());
+        std::cout << "Bond graph: " << bonds.bonds() / 2 << " bonds, "
+            << bonds.bytes() / (1024.0 * 1024.0) << " MB "
+            << (bonds.mapped() ? "memory-mapped in " + config.bondStorage.directory : std::string("in memory"))
+            << (bonds.compressed() ? ", compressed" : "") << "\n";
+
+        // Holes and notches: the bonds they cut stop existing
+        if (!config.shape.empty()) {
+            beginStage("specimen");
+            long long cutBonds = 0;
+            const long long bondsBefore = bonds.bonds();
+            if (!cutSpecimen(config.shape, Nx, dx, config.bondStorage, bonds, N_total, N_broken, cutBonds)) {
+                return false;
             }
+            totalBonds = exactIntegerSum(N, [&](long long i) { return N_total[i]; }) / 2;
+            // Reads every bond, writes the remaining ones
+            endStage("specimen", 5.0 * bondsBefore + 5.0 * bonds.bonds() + 12.0 * N, 1.0 * bondsBefore);
+            std::cout << "Specimen: " << config.shape.holes.size() << " hole(s), " << config.shape.notches.size()
+                << " notch(es), " << cutBonds << " bonds cut\n";
+        }
+    }
+
+    // Out of time: the finished rows become the output of this slot, and the
+    // state needed to continue is saved next to it
+    const bool partial = completeRows < Ny;
+    if (partial) {
+        RunState state;
+        state.fingerprint = runFingerprint(config);
+        state.seed = setup.seed;
+        state.completeRows = completeRows;
+        const int savedRows = std::min(Ny, completeRows + stencil.reach);
+        state.N_broken.assign(N_broken.begin(), N_broken.begin() + static_cast<size_t>(savedRows) * Nx);
+        if (!saveRunState(stateFile, state)) {
+            return false;
         }
+        std::cout << "Time budget reached: rows 0.." << completeRows << " of " << Ny
+            << " are complete; state saved to " << stateFile << " (resume = 1 continues)\n";
+
+        Ny = completeRows;
+        N = Nx * Ny;
+        particles.resize(N);
+        N_total.resize(N);
+        N_broken.resize(N);
+        totalBonds = exactIntegerSum(N, [&](long long i) { return N_total[i]; }) / 2;
+    }
+    else if (config.resume) {
+        std::error_code ec;
+        std::filesystem::remove(stateFile, ec);
     }
 
+    long long brokenBonds = exactIntegerSum(N, [&](long long i) { return N_broken[i]; }) / 2;
+
     double realizedPorosity = 0.0;
     if (totalBonds > 0) {
         realizedPorosity = static_cast<double>(brokenBonds) / static_cast<double>(totalBonds);
@@ -205,81 +448,493 @@ void runSimulation() {
     std::cout << "Total bonds (before damage): " << totalBonds << "\n";
     std::cout << "Broken bonds (after damage): " << brokenBonds << "\n";
     std::cout << "Realized global porosity (bond-based) ~ " << realizedPorosity << "\n";
+    if (partial) {
+        // Per-particle counts of the last complete rows still include their
+        // bonds across the cut, so those bonds count half
+        std::cout << "(approximate: bonds across row " << completeRows << " count half until the run is resumed)\n";
+    }
 
     // -----------------------------
     // 5. Compute local damage d(i) = Nb(i) / N(i)
     // -----------------------------
     std::vector<double> damage(N, 0.0);
-    for (int i = 0; i < N; ++i) {
-        if (N_total[i] > 0) {
-            damage[i] = static_cast<double>(N_broken[i]) /
-                static_cast<double>(N_total[i]);
+    beginStage("damage");
+    if (config.keepBonds) {
+        // Streams through the stored bonds (out-of-core when mapped)
+        bondGraphDamage(bonds, damage);
+        endStage("damage", 16.0 * N + 5.0 * bonds.bonds(), 2.0 * bonds.bonds() + N);
+    }
+    else {
+        computeLocalDamage(N_total, N_broken, Nx, tuning.tileRows, damage);
+        endStage("damage", 16.0 * N, 1.0 * N);
+    }
+
+    // Compaction: particles without an intact bond are dropped, so the
+    // solvers and the VTK output only see the survivors
+    Compaction compaction;
+    if (config.compact) {
+        beginStage("compaction");
+        buildCompaction(N, [&](long long id) { return N_total[id] > 0 && damage[id] < 1.0; }, compaction);
+        double compactionBytes = 12.0 * N + 8.0 * compaction.kept();
+        if (config.keepBonds) {
+            BondGraph compacted;
+            if (!compactBondGraph(bonds, compaction, config.bondStorage, compacted)) {
+                return false;
+            }
+            // Reads every bond of the kept particles twice, writes the intact ones
+            compactionBytes += 10.0 * bonds.bonds() + 5.0 * compacted.bonds();
+            bonds = std::move(compacted);
+        }
+        endStage("compaction", compactionBytes, 2.0 * N);
+        std::cout << "Compaction: " << compaction.kept() << " particles kept, " << compaction.removed()
+            << " removed";
+        if (config.keepBonds) {
+            std::cout << " (" << bonds.bonds() / 2 << " intact bonds left)";
+        }
+        std::cout << "\n";
+    }
+
+    // Domain decomposition of the graph the solvers run on
+    Partition partition;
+    std::vector<double> partitionField;
+    if (config.partitions > 0) {
+        beginStage("partition");
+        if (!partitionGraph(bonds, Nx, config.partitions, config.partitionMethod, partition)) {
+            return false;
+        }
+        partitionField.assign(N, -1.0);
+        for (long long id = 0; id < bonds.particles(); ++id) {
+            partitionField[bonds.gridId(id)] = partition.owner[id];
+        }
+        // A few passes over the particles per level, two over the bonds
+        double levels = std::ceil(std::log2(static_cast<double>(config.partitions))) + 1.0;
+        endStage("partition", levels * 48.0 * bonds.particles() + 10.0 * bonds.bonds(),
+                 levels * 10.0 * bonds.particles() + 2.0 * bonds.bonds());
+        std::cout << "Partition: " << config.partitions << " parts (" << partitionMethodName(config.partitionMethod)
+            << "), " << partition.stats.cutBonds << " bonds cut, imbalance " << partition.stats.imbalance
+            << " (row blocks: " << partition.rowBlocks.cutBonds << " cut, imbalance "
+            << partition.rowBlocks.imbalance << ")\n";
+    }
+
+    // Fatigue loading of the pre-damaged specimen; worn-out bonds are marked
+    // broken in the graph and so show up in the damage update below
+    FatigueResult fatigue;
+    if (config.fatigue.cycles > 0.0) {
+        std::cout << "Fatigue: up to " << config.fatigue.cycles << " cycles at peak strain "
+            << config.fatigue.strain << ", R = " << config.fatigue.loadRatio << "...\n";
+        beginStage("fatigue");
+        if (!runFatigue(bonds, Nx, Ny, stencil, coupling, config.fatigue, config.bondStorage, fatigue)) {
+            return false;
+        }
+        double solverIterations = 0.0;
+        for (const FatigueStep& step : fatigue.history) {
+            solverIterations += step.solverIterations;
+        }
+        // Every solver iteration streams the graph and six displacement-sized vectors
+        endStage("fatigue", solverIterations * (5.0 * bonds.bonds() + 96.0 * bonds.particles()),
+                 solverIterations * 10.0 * bonds.bonds());
+        std::cout << "Fatigue: " << (fatigue.failed ? "failed after " : "ran out at ") << fatigue.cycles
+            << " cycles (" << fatigue.resolvedCycles << " resolved), " << fatigue.brokenBonds
+            << " bonds broken, stiffness " << fatigue.stiffness << "\n";
+    }
+
+    // Implicit dynamics under slow loading; failed bonds are marked broken
+    // in the graph as well
+    DynamicsResult dynamics;
+    if (config.dynamics.steps > 0) {
+        std::cout << "Dynamics: " << config.dynamics.steps << " implicit steps of " << config.dynamics.timeStep
+            << " x the explicit limit to strain " << config.dynamics.strain << "...\n";
+        beginStage("dynamics");
+        if (!runDynamics(bonds, Nx, Ny, stencil, coupling, config.dynamics, config.bondStorage, dynamics)) {
+            return false;
+        }
+        // Every Krylov iteration is one residual evaluation over the graph
+        // plus Gram-Schmidt over about 15 basis vectors of 2N doubles
+        double krylov = dynamics.krylovIterations;
+        result.dynamicsSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - stageStart).count();
+        endStage("dynamics", krylov * (5.0 * bonds.bonds() + 15.0 * 16.0 * bonds.particles()),
+                 krylov * (10.0 * bonds.bonds() + 15.0 * 4.0 * bonds.particles()));
+        std::cout << "Dynamics: t = " << dynamics.time << " in " << dynamics.steps << " steps ("
+            << dynamics.cutbacks << " cut back, explicit limit " << dynamics.explicitStep << "), "
+            << dynamics.krylovIterations << " GMRES iterations, " << dynamics.brokenBonds << " bonds broken";
+        if (config.dynamics.refineStretch > 0.0) {
+            std::cout << ", at most " << dynamics.peakParticles << " particles";
+        }
+        std::cout << "\n";
+    }
+
+    // Bonds broken by the solvers raise the damage of their particles
+    if (!fatigue.history.empty() || !dynamics.history.empty()) {
+        beginStage("damage_update");
+        if (config.compact) {
+            compactedGraphDamage(bonds, N_total, damage);
+            // Solver fields back on the lattice; removed particles carry no bonds
+            std::vector<double> full;
+            if (!fatigue.life.empty()) {
+                full.assign(N, 0.0);
+                scatterKept(compaction, fatigue.life, full);
+                fatigue.life.swap(full);
+            }
+            if (!dynamics.displacement.empty()) {
+                full.assign(N, 0.0);
+                scatterKept(compaction, dynamics.displacement, full);
+                dynamics.displacement.swap(full);
+            }
         }
         else {
-            damage[i] = 0.0;  // isolated point, no neighbors
+            bondGraphDamage(bonds, damage);
         }
+        endStage("damage_update", 16.0 * N + 5.0 * bonds.bonds(), 2.0 * bonds.bonds() + N);
+    }
+
+    // Mean local damage (site-based porosity estimate), reproducible for any thread count
+    double meanDamage = (N > 0) ? deterministicSum(damage) / N : 0.0;
+    std::cout << "Mean local damage ~ " << meanDamage << "\n";
+
+    // Grain of every particle (grains model)
+    std::vector<double> grainField;
+    if (grains) {
+        grainField.resize(N);
+        parallelFor(N, 16384, [&](long long i0, long long i1) {
+            for (long long id = i0; id < i1; ++id) {
+                grainField[id] = grains->grain(id);
+            }
+        });
+    }
+
+    // Nonlocal averaged damage (second output field)
+    std::vector<double> damageNonlocal;
+    if (config.nonlocalRadius > 0.0 && N > 0) {
+        std::cout << "Computing nonlocal damage (" << nonlocalKernelName(config.nonlocalKernel)
+            << ", radius " << config.nonlocalRadius << ")...\n";
+        nonlocalAverage(damage, Nx, Ny, dx, config.nonlocalRadius, config.nonlocalKernel, damageNonlocal);
     }
 
     // -----------------------------
     // 6. Write VTK file for visualization
     // -----------------------------
-    // Generate unique filename based on parameters
-    std::string filename = "porosity_Lx" + std::to_string(static_cast<int>(Lx)) 
-                         + "_phi" + std::to_string(static_cast<int>(phi * 100)) + ".vtk";
-    std::ofstream vtk(filename);
-    if (!vtk) {
-        std::cerr << "Error: could not open " << filename << " for writing.\n";
-        return;
-    }
-
-    vtk << "# vtk DataFile Version 3.0\n";
-    vtk << "Peridynamic porous pre-damage\n";
-    vtk << "ASCII\n";
-    vtk << "DATASET POLYDATA\n";
-
-    // Write points
-    vtk << "POINTS " << N << " float\n";
-    vtk << std::fixed << std::setprecision(6);
-    for (int i = 0; i < N; ++i) {
-        vtk << particles[i].x << " "
-            << particles[i].y << " "
-            << 0.0 << "\n";  // z = 0 for 2D surface
-    }
-
-    // Each point as a separate vertex cell
-    vtk << "VERTICES " << N << " " << 2 * N << "\n";
-    for (int i = 0; i < N; ++i) {
-        vtk << "1 " << i << "\n";
-    }
-
-    // Point data
-    vtk << "POINT_DATA " << N << "\n";
-    vtk << "SCALARS damage float 1\n";
-    vtk << "LOOKUP_TABLE default\n";
-    for (int i = 0; i < N; ++i) {
-        vtk << damage[i] << "\n";
-    }
-
-    vtk.close();
-    std::cout << "\nVTK file written to: " << filename << "\n";
-
-    // Offer to open the VTK file
-    std::cout << "\nWould you like to visualize the results? (y/n): ";
-    char visualize;
-    std::cin >> visualize;
-    
-    if (visualize == 'y' || visualize == 'Y') {
-        openVTKFile(filename);
-        std::cout << "If the file didn't open automatically, you can open it manually with ParaView.\n";
-        std::cout << "ParaView (free): https://www.paraview.org/download/\n";
+    // Generate unique filename based on parameters (unless the job names one)
+    std::string filename = config.outputFile.empty() ? defaultOutputName(config) : config.outputFile;
+    beginStage("output");
+    double outputBytes = 0.0;
+    double outputOps = 0.0;
+
+    if (config.writeVtk) {
+        std::vector<VtkField> fields = { { "damage", &damage } };
+        if (!damageNonlocal.empty()) {
+            fields.push_back({ "damage_nonlocal", &damageNonlocal });
+        }
+        if (!fatigue.life.empty()) {
+            fields.push_back({ "fatigue_life", &fatigue.life });
+        }
+        if (!dynamics.displacement.empty()) {
+            fields.push_back({ "displacement", &dynamics.displacement });
+        }
+        if (!partitionField.empty()) {
+            fields.push_back({ "partition", &partitionField });
+        }
+        if (!grainField.empty()) {
+            fields.push_back({ "grain", &grainField });
+        }
+        // Compacted runs write the kept particles only, with their lattice index
+        const std::vector<Particle>* points = &particles;
+        std::vector<Particle> keptParticles;
+        std::vector<std::vector<double>> keptValues;
+        if (config.compact) {
+            keptParticles = gatherKept(compaction, particles);
+            keptValues.reserve(fields.size() + 1);
+            for (VtkField& field : fields) {
+                keptValues.push_back(gatherKept(compaction, *field.values));
+                field.values = &keptValues.back();
+            }
+            keptValues.emplace_back(compaction.originalId.begin(), compaction.originalId.end());
+            fields.push_back({ "original_id", &keptValues.back() });
+            points = &keptParticles;
+        }
+        OutputStats outputStats;
+        if (!writeVtkFile(filename, *points, fields, config.output, outputStats)) {
+            return false;
+        }
+        std::cout << "\nVTK file written to: " << filename << "\n";
+        if (config.output.backend != OutputBackend::Stream) {
+            std::cout << "Output: " << outputStats.bytes / (1024.0 * 1024.0) << " MB via "
+                << outputStats.backend << (outputStats.direct ? " (O_DIRECT)" : "")
+                << ", " << outputStats.megabytesPerSecond << " MB/s\n";
+        }
+        // Coordinates and fields are read once; every character is formatted
+        outputBytes += 8.0 * points->size() * (2 + fields.size()) + outputStats.bytes;
+        outputOps += static_cast<double>(outputStats.bytes);
+    }
+
+    // Chunked, compressed Zarr store of the per-particle arrays
+    if (config.writeZarr) {
+        std::string store = zarrStoreName(filename);
+        std::vector<ZarrField> zarrFields = { { "damage", &damage, nullptr },
+                                              { "N_total", nullptr, &N_total },
+                                              { "N_broken", nullptr, &N_broken } };
+        if (!damageNonlocal.empty()) {
+            zarrFields.push_back({ "damage_nonlocal", &damageNonlocal, nullptr });
+        }
+        if (!fatigue.life.empty()) {
+            zarrFields.push_back({ "fatigue_life", &fatigue.life, nullptr });
+        }
+        if (!dynamics.displacement.empty()) {
+            zarrFields.push_back({ "displacement", &dynamics.displacement, nullptr });
+        }
+        if (!partitionField.empty()) {
+            zarrFields.push_back({ "partition", &partitionField, nullptr });
+        }
+        if (!grainField.empty()) {
+            zarrFields.push_back({ "grain", &grainField, nullptr });
+        }
+        std::vector<std::pair<std::string, double>> attributes = {
+            { "dx", dx }, { "Lx", Lx }, { "Ly", Ly }, { "m", m }, { "phi", config.phi } };
+        ZarrStats zarrStats;
+        if (!writeZarrStore(store, Nx, Ny, config.zarrChunk, zarrFields, attributes, zarrStats)) {
+            return false;
+        }
+        std::cout << "Zarr store written to: " << store << " (" << zarrStats.chunks << " chunks, "
+            << zarrStats.rawBytes / (1024.0 * 1024.0) << " MB -> "
+            << zarrStats.storedBytes / (1024.0 * 1024.0) << " MB)\n";
+        outputBytes += 2.0 * zarrStats.rawBytes + zarrStats.storedBytes;
+        outputOps += static_cast<double>(zarrStats.rawBytes);  // shuffle + LZ4 per input byte
+        if (!config.writeVtk) {
+            filename = store;
+        }
+    }
+    endStage("output", outputBytes, outputOps);
+
+    if (!fatigue.history.empty()) {
+        std::string historyFile = fatigueHistoryName(filename);
+        if (!writeFatigueHistory(historyFile, fatigue)) {
+            return false;
+        }
+        std::cout << "Fatigue history written to: " << historyFile << "\n";
+    }
+    if (config.partitions > 0) {
+        std::string table = partitionTableName(filename);
+        if (!writePartition(table, partitionHaloName(filename), bonds, partition)) {
+            return false;
+        }
+        std::cout << "Partition written to: " << table << " (halo lists in " << partitionHaloName(filename) << ")\n";
+    }
+    if (!dynamics.history.empty()) {
+        std::string historyFile = dynamicsHistoryName(filename);
+        if (!writeDynamicsHistory(historyFile, dynamics)) {
+            return false;
+        }
+        std::cout << "Dynamics history written to: " << historyFile << "\n";
+    }
+
+    // Machine-readable run summary (with the roofline report if measured)
+    if (config.writeSummary || config.roofline) {
+        summary.parameters = {
+            { "Lx", jsonNumber(Lx) }, { "Ly", jsonNumber(Ly) }, { "dx", jsonNumber(dx) },
+            { "m", jsonNumber(m) }, { "phi", jsonNumber(config.phi) },
+            { "porosity_model", jsonString(config.porosityModel) },
+            { "rng", jsonString(rngEngineName(config.rng)) },
+            { "seed", std::to_string(setup.seed) },
+            { "threads", std::to_string(workerThreads()) },
+            { "tile_rows", std::to_string(tuning.tileRows) },
+            { "tile_columns", std::to_string(tuning.tileColumns) },
+            { "loop_order", jsonString(loopOrderName(tuning.loopOrder)) } };
+        if (grains) {
+            summary.parameters.push_back({ "grain_size", jsonNumber(config.grainSize) });
+            summary.parameters.push_back({ "grain_boundary_factor", jsonNumber(config.grainBoundaryFactor) });
+            summary.parameters.push_back({ "grain_seed", std::to_string(config.grainSeed) });
+        }
+        if (jitter) {
+            summary.parameters.push_back({ "lattice_jitter", jsonNumber(config.latticeJitter) });
+            summary.parameters.push_back({ "lattice_jitter_seed", std::to_string(config.latticeJitterSeed) });
+        }
+        if (coupling != nullptr) {
+            const CouplingOptions& c = config.coupling;
+            summary.parameters.push_back({ "coupling_roi", "[" + jsonNumber(c.x0) + ", " + jsonNumber(c.y0) + ", " +
+                                                           jsonNumber(c.x1) + ", " + jsonNumber(c.y1) + "]" });
+            summary.parameters.push_back({ "coupling_blend", jsonNumber(c.blend >= 0.0 ? c.blend : delta) });
+        }
+        if (config.fatigue.cycles > 0.0) {
+            summary.parameters.push_back({ "precision", jsonString(config.fatigue.mixedPrecision ? "mixed" : "double") });
+        }
+        if (config.fatigue.cycles > 0.0 || config.dynamics.steps > 0) {
+            summary.parameters.push_back({ "surface_correction", config.fatigue.surfaceCorrection ? "true" : "false" });
+        }
+        if (config.dynamics.steps > 0) {
+            summary.parameters.push_back({ "dynamics_load", jsonString(loadCaseName(config.dynamics.load)) });
+        }
+        if (config.keepBonds) {
+            summary.parameters.push_back({ "bond_compression", config.bondStorage.compressed ? "true" : "false" });
+        }
+        if (config.partitions > 0) {
+            summary.parameters.push_back({ "partitions", std::to_string(config.partitions) });
+            summary.parameters.push_back({ "partition_method", jsonString(partitionMethodName(config.partitionMethod)) });
+        }
+        if (!config.shape.empty()) {
+            summary.parameters.push_back({ "holes", std::to_string(config.shape.holes.size()) });
+            summary.parameters.push_back({ "notches", std::to_string(config.shape.notches.size()) });
+        }
+        summary.results = {
+            { "particles", std::to_string(N) }, { "total_bonds", std::to_string(totalBonds) },
+            { "broken_bonds", std::to_string(brokenBonds) },
+            { "realized_porosity", jsonNumber(realizedPorosity) },
+            { "mean_damage", jsonNumber(meanDamage) },
+            { "partial", partial ? "true" : "false" },
+            { "bond_counts_approximate", partial ? "true" : "false" },
+            { "complete_rows", std::to_string(completeRows) },
+            { "particles_kept", std::to_string(config.compact ? compaction.kept() : N) },
+            { "output", jsonString(filename) } };
+        if (config.keepBonds) {
+            summary.results.push_back({ "bond_graph_bytes", std::to_string(bonds.bytes()) });
+        }
+        if (grains) {
+            summary.results.push_back({ "grains", std::to_string(grains->grains()) });
+        }
+        if (config.partitions > 0) {
+            summary.results.push_back({ "partition_cut_bonds", std::to_string(partition.stats.cutBonds) });
+            summary.results.push_back({ "partition_imbalance", jsonNumber(partition.stats.imbalance) });
+            summary.results.push_back({ "row_block_cut_bonds", std::to_string(partition.rowBlocks.cutBonds) });
+            summary.results.push_back({ "row_block_imbalance", jsonNumber(partition.rowBlocks.imbalance) });
+        }
+        if (!fatigue.history.empty()) {
+            summary.results.push_back({ "fatigue_cycles", jsonNumber(fatigue.cycles) });
+            summary.results.push_back({ "fatigue_failed", fatigue.failed ? "true" : "false" });
+            summary.results.push_back({ "fatigue_resolved_cycles", std::to_string(fatigue.resolvedCycles) });
+            summary.results.push_back({ "fatigue_broken_bonds", std::to_string(fatigue.brokenBonds) });
+            summary.results.push_back({ "fatigue_stiffness", jsonNumber(fatigue.stiffness) });
+        }
+        if (!dynamics.history.empty()) {
+            summary.results.push_back({ "dynamics_time", jsonNumber(dynamics.time) });
+            summary.results.push_back({ "dynamics_explicit_step", jsonNumber(dynamics.explicitStep) });
+            summary.results.push_back({ "dynamics_steps", std::to_string(dynamics.steps) });
+            summary.results.push_back({ "dynamics_cutbacks", std::to_string(dynamics.cutbacks) });
+            summary.results.push_back({ "dynamics_krylov_iterations", std::to_string(dynamics.krylovIterations) });
+            summary.results.push_back({ "dynamics_broken_bonds", std::to_string(dynamics.brokenBonds) });
+            summary.results.push_back({ "dynamics_bond_updates", std::to_string(dynamics.bondUpdates) });
+            if (config.dynamics.refineStretch > 0.0) {
+                summary.results.push_back({ "dynamics_peak_particles", std::to_string(dynamics.peakParticles) });
+            }
+        }
+        std::string summaryFile = runSummaryName(filename);
+        if (!writeRunSummary(summaryFile, summary)) {
+            return false;
+        }
+        std::cout << "Run summary written to: " << summaryFile << "\n";
+    }
+
+    metricsSetStage("idle");
+    result.outputFile = filename;
+    result.totalBonds = totalBonds;
+    result.brokenBonds = brokenBonds;
+    result.realizedPorosity = realizedPorosity;
+    result.meanDamage = meanDamage;
+    result.partial = partial;
+    result.completeRows = completeRows;
+    result.particles = config.keepBonds ? bonds.particles() : N;
+    result.bondBytes = bonds.bytes();
+    result.dynamics = std::move(dynamics);
+    result.dynamics.displacement.clear();
+    return true;
+}
+
+// Batch run of one job file. threads replaces an automatic thread count.
+// Returns 0 when done, 1 on failure and 2 when stopped by the time budget
+// (rerun with resume = 1).
+int runJobFile(const std::string& path, int threads) {
+    SimulationConfig config;
+    RunResult result;
+    if (!loadJobConfig(path, config)) {
+        return 1;
+    }
+    if (config.tuning.threads == 0) {
+        config.tuning.threads = threads;
+    }
+    if (!runSimulation(config, result)) {
+        return 1;
     }
+    return result.partial ? 2 : 0;
 }
 
-int main() {
+int main(int argc, char* argv[]) {
+    // Random engine benchmark: Peridynamic --bench-rng [grid size] [trials]
+    if (argc > 1 && std::string(argv[1]) == "--bench-rng") {
+        int gridSize = (argc > 2) ? std::atoi(argv[2]) : 2000;
+        int trials = (argc > 3) ? std::atoi(argv[3]) : 200;
+        return runRngBenchmark(gridSize, trials);
+    }
+
+    // Kernel auto-tuning: Peridynamic --calibrate [grid size] [horizon factor m]
+    if (argc > 1 && std::string(argv[1]) == "--calibrate") {
+        int gridSize = (argc > 2) ? std::atoi(argv[2]) : 1000;
+        double m = (argc > 3) ? std::atof(argv[3]) : 3.0;
+        return runCalibration(gridSize, m, kTuningFile);
+    }
+
+    // Mixed-precision accuracy check: Peridynamic --check-precision [grid size] [horizon factor m]
+    if (argc > 1 && std::string(argv[1]) == "--check-precision") {
+        int gridSize = (argc > 2) ? std::atoi(argv[2]) : 96;
+        double m = (argc > 3) ? std::atof(argv[3]) : 3.0;
+        return runPrecisionCheck(gridSize, m);
+    }
+
+    // Field comparison: Peridynamic --compare <first> <second> [field] [difference output]
+    if (argc > 3 && std::string(argv[1]) == "--compare") {
+        std::string field = (argc > 4) ? argv[4] : "damage";
+        std::string difference = (argc > 5) ? argv[5] : "";
+        return runComparison(argv[2], argv[3], field, difference);
+    }
+
+    // Fracture benchmarks: Peridynamic --benchmark [name | all] [scale]
+    if (argc > 1 && std::string(argv[1]) == "--benchmark") {
+        std::string name = (argc > 2) ? argv[2] : "all";
+        double scale = (argc > 3) ? std::atof(argv[3]) : 1.0;
+        return runBenchmarks(name, scale, [](const SimulationConfig& config, BenchmarkRun& run) {
+            RunResult result;
+            if (!runSimulation(config, result)) {
+                return false;
+            }
+            run.particles = result.particles;
+            run.bonds = result.totalBonds;
+            run.bondBytes = result.bondBytes;
+            run.dynamics = std::move(result.dynamics);
+            run.dynamicsSeconds = result.dynamicsSeconds;
+            return true;
+        });
+    }
+
+    // Sweep: Peridynamic --sweep <queue dir> [worker processes]
+    if (argc > 2 && std::string(argv[1]) == "--sweep") {
+        int workers = (argc > 3) ? std::atoi(argv[3]) : 1;
+        return runSweep(argv[2], workers, argv[0]);
+    }
+    if (argc > 2 && std::string(argv[1]) == "--sweep-worker") {
+        int threads = (argc > 3) ? std::atoi(argv[3]) : 0;
+        return runSweepWorker(argv[2], [threads](const std::string& jobFile) {
+            return runJobFile(jobFile, threads);
+        });
+    }
+
+    // Batch mode: Peridynamic <job file>
+    if (argc > 1) {
+        return runJobFile(argv[1], 0);
+    }
+
     bool continueSimulations = true;
 
     while (continueSimulations) {
-        runSimulation();
+        SimulationConfig config;
+        RunResult result;
+        if (readInteractiveConfig(config) && runSimulation(config, result)) {
+            // Offer to open the VTK file
+            std::cout << "\nWould you like to visualize the results? (y/n): ";
+            char visualize;
+            std::cin >> visualize;
+
+            if (visualize == 'y' || visualize == 'Y') {
+                openVTKFile(result.outputFile);
+                std::cout << "If the file didn't open automatically, you can open it manually with ParaView.\n";
+                std::cout << "ParaView (free): https://www.paraview.org/download/\n";
+            }
+        }
 
         // Ask user if they want to run another simulation
         std::cout << "\n========================================\n";
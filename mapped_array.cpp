@@ -0,0 +1,282 @@
+#include "mapped_array.h"
+
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <utility>
+
+#ifdef _WIN32
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #ifndef WIN32_LEAN_AND_MEAN
+        #define WIN32_LEAN_AND_MEAN
+    #endif
+    #include <windows.h>
+#else
+    #include <cerrno>
+    #include <cstring>
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+namespace {
+
+std::atomic<unsigned> scratchCounter{ 0 };
+
+// Unique scratch file name inside directory
+std::string scratchPath(const std::string& directory) {
+#ifdef _WIN32
+    unsigned long pid = GetCurrentProcessId();
+#else
+    unsigned long pid = static_cast<unsigned long>(getpid());
+#endif
+    std::filesystem::path p(directory);
+    p /= "peridynamic-bonds-" + std::to_string(pid) + "-" + std::to_string(scratchCounter++) + ".bin";
+    return p.string();
+}
+
+size_t pageSize() {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwPageSize;
+#else
+    return static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#endif
+}
+
+}  // namespace
+
+MappedRegion::~MappedRegion() {
+    reset();
+}
+
+MappedRegion::MappedRegion(MappedRegion&& other) noexcept {
+    *this = std::move(other);
+}
+
+MappedRegion& MappedRegion::operator=(MappedRegion&& other) noexcept {
+    if (this != &other) {
+        reset();
+        std::swap(data_, other.data_);
+        std::swap(bytes_, other.bytes_);
+        std::swap(fileBacked_, other.fileBacked_);
+#ifdef _WIN32
+        std::swap(fileHandle_, other.fileHandle_);
+        std::swap(mappingHandle_, other.mappingHandle_);
+#endif
+    }
+    return *this;
+}
+
+bool MappedRegion::allocate(size_t bytes, const std::string& directory) {
+    reset();
+    if (bytes == 0) {
+        return true;
+    }
+    fileBacked_ = !directory.empty();
+
+#ifdef _WIN32
+    if (!fileBacked_) {
+        data_ = VirtualAlloc(nullptr, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    }
+    else {
+        std::string path = scratchPath(directory);
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_NEW,
+                                  FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            std::cerr << "Error: could not create bond scratch file " << path << "\n";
+            return false;
+        }
+        fileHandle_ = file;
+        ULARGE_INTEGER size;
+        size.QuadPart = bytes;
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, size.HighPart, size.LowPart, nullptr);
+        if (mapping != nullptr) {
+            mappingHandle_ = mapping;
+            data_ = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, bytes);
+        }
+    }
+    if (data_ == nullptr) {
+        std::cerr << "Error: could not allocate " << bytes << " bytes of bond storage\n";
+        reset();
+        return false;
+    }
+#else
+    if (!fileBacked_) {
+        void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        data_ = (p == MAP_FAILED) ? nullptr : p;
+    }
+    else {
+        std::string path = scratchPath(directory);
+        int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd < 0) {
+            std::cerr << "Error: could not create bond scratch file " << path << ": " << std::strerror(errno) << "\n";
+            fileBacked_ = false;
+            return false;
+        }
+        // The mapping keeps the file alive; unlinking now means no stale
+        // scratch files are left behind, even after a crash.
+        ::unlink(path.c_str());
+        if (::ftruncate(fd, static_cast<off_t>(bytes)) == 0) {
+            void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            data_ = (p == MAP_FAILED) ? nullptr : p;
+        }
+        ::close(fd);
+    }
+    if (data_ == nullptr) {
+        std::cerr << "Error: could not allocate " << bytes << " bytes of bond storage: " << std::strerror(errno) << "\n";
+        fileBacked_ = false;
+        return false;
+    }
+#endif
+    bytes_ = bytes;
+    return true;
+}
+
+bool MappedRegion::mapFile(const std::string& path) {
+    reset();
+    fileBacked_ = true;
+    size_t bytes = 0;
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        std::cerr << "Error: could not open " << path << "\n";
+        fileBacked_ = false;
+        return false;
+    }
+    fileHandle_ = file;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) {
+        std::cerr << "Error: could not read the size of " << path << "\n";
+        reset();
+        return false;
+    }
+    bytes = static_cast<size_t>(size.QuadPart);
+    if (bytes > 0) {
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping != nullptr) {
+            mappingHandle_ = mapping;
+            data_ = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        }
+        if (data_ == nullptr) {
+            std::cerr << "Error: could not map " << path << "\n";
+            reset();
+            return false;
+        }
+    }
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Error: could not open " << path << ": " << std::strerror(errno) << "\n";
+        fileBacked_ = false;
+        return false;
+    }
+    struct stat info;
+    bool mapped = ::fstat(fd, &info) == 0;
+    if (mapped) {
+        bytes = static_cast<size_t>(info.st_size);
+        if (bytes > 0) {
+            void* p = mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+            data_ = (p == MAP_FAILED) ? nullptr : p;
+            mapped = data_ != nullptr;
+        }
+    }
+    ::close(fd);
+    if (!mapped) {
+        std::cerr << "Error: could not map " << path << ": " << std::strerror(errno) << "\n";
+        fileBacked_ = false;
+        return false;
+    }
+#endif
+    bytes_ = bytes;
+    return true;
+}
+
+void MappedRegion::reset() {
+#ifdef _WIN32
+    if (data_ != nullptr) {
+        if (fileBacked_) {
+            UnmapViewOfFile(data_);
+        }
+        else {
+            VirtualFree(data_, 0, MEM_RELEASE);
+        }
+    }
+    if (mappingHandle_ != nullptr) {
+        CloseHandle(mappingHandle_);
+    }
+    if (fileHandle_ != nullptr) {
+        CloseHandle(fileHandle_);
+    }
+    fileHandle_ = nullptr;
+    mappingHandle_ = nullptr;
+#else
+    if (data_ != nullptr) {
+        munmap(data_, bytes_);
+    }
+#endif
+    data_ = nullptr;
+    bytes_ = 0;
+    fileBacked_ = false;
+}
+
+void MappedRegion::adviseSequential() const {
+#ifndef _WIN32
+    if (data_ != nullptr) {
+        madvise(data_, bytes_, MADV_SEQUENTIAL);
+    }
+#endif
+}
+
+void MappedRegion::prefetch(size_t begin, size_t end) const {
+    if (data_ == nullptr || !fileBacked_) {
+        return;
+    }
+    // Round outwards to whole pages
+    const size_t page = pageSize();
+    begin = begin / page * page;
+    end = std::min(bytes_, end);
+    if (begin >= end) {
+        return;
+    }
+    char* p = static_cast<char*>(data_) + begin;
+#ifdef _WIN32
+    WIN32_MEMORY_RANGE_ENTRY range;
+    range.VirtualAddress = p;
+    range.NumberOfBytes = end - begin;
+    PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+    madvise(p, end - begin, MADV_WILLNEED);
+#endif
+}
+
+void MappedRegion::release(size_t begin, size_t end) const {
+    if (data_ == nullptr || !fileBacked_) {
+        return;
+    }
+    // Only whole pages inside the range may be dropped
+    const size_t page = pageSize();
+    begin = (begin + page - 1) / page * page;
+    end = std::min(bytes_, end) / page * page;
+    if (begin >= end) {
+        return;
+    }
+    char* p = static_cast<char*>(data_) + begin;
+#ifdef _WIN32
+    // Write dirty pages back and take them out of the working set
+    FlushViewOfFile(p, end - begin);
+    VirtualUnlock(p, end - begin);
+#else
+    // MADV_DONTNEED on a shared file mapping drops the pages; dirty pages are
+    // still in the page cache and are re-read from there or from the file.
+    madvise(p, end - begin, MADV_DONTNEED);
+#endif
+}
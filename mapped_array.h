@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// Raw storage for large bond arrays: either ordinary heap memory or a
+// memory-mapped scratch file (deleted automatically), so arrays larger than
+// RAM are paged to local disk by the OS instead of a custom paging layer.
+// Existing files (results read back by --compare) can be mapped read-only.
+// Access hints map to madvise (POSIX) / PrefetchVirtualMemory (Windows).
+class MappedRegion {
+public:
+    MappedRegion() = default;
+    ~MappedRegion();
+
+    MappedRegion(const MappedRegion&) = delete;
+    MappedRegion& operator=(const MappedRegion&) = delete;
+    MappedRegion(MappedRegion&& other) noexcept;
+    MappedRegion& operator=(MappedRegion&& other) noexcept;
+
+    // Allocate bytes of zeroed storage; a non-empty directory selects a
+    // file-backed mapping inside it. Prints an error and returns false on failure.
+    bool allocate(size_t bytes, const std::string& directory);
+
+    // Map the existing file at path read-only (never write through data()).
+    // Prints an error and returns false on failure.
+    bool mapFile(const std::string& path);
+    void reset();
+
+    void* data() const { return data_; }
+    size_t bytes() const { return bytes_; }
+    bool fileBacked() const { return fileBacked_; }
+
+    // Access pattern hints; byte ranges are clamped to the region
+    // (hints only change residency, never contents, hence const)
+    void adviseSequential() const;
+    void prefetch(size_t begin, size_t end) const;   // MADV_WILLNEED
+    void release(size_t begin, size_t end) const;    // drop resident pages (written back first)
+
+private:
+    void* data_ = nullptr;
+    size_t bytes_ = 0;
+    bool fileBacked_ = false;
+#ifdef _WIN32
+    void* fileHandle_ = nullptr;
+    void* mappingHandle_ = nullptr;
+#endif
+};
+
+// Typed view of a MappedRegion
+template <typename T>
+class MappedArray {
+public:
+    bool allocate(size_t count, const std::string& directory) {
+        count_ = count;
+        return region_.allocate(count * sizeof(T), directory);
+    }
+
+    T* data() { return static_cast<T*>(region_.data()); }
+    const T* data() const { return static_cast<const T*>(region_.data()); }
+    size_t size() const { return count_; }
+    T& operator[](size_t i) { return data()[i]; }
+    const T& operator[](size_t i) const { return data()[i]; }
+
+    bool fileBacked() const { return region_.fileBacked(); }
+    size_t bytes() const { return count_ * sizeof(T); }
+
+    void adviseSequential() const { region_.adviseSequential(); }
+    void prefetch(size_t first, size_t last) const { region_.prefetch(first * sizeof(T), last * sizeof(T)); }
+    void release(size_t first, size_t last) const { region_.release(first * sizeof(T), last * sizeof(T)); }
+
+private:
+    MappedRegion region_;
+    size_t count_ = 0;
+};
@@ -0,0 +1,305 @@
+#include "metrics.h"
+
+#include "parallel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+
+#ifdef _WIN32
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #ifndef WIN32_LEAN_AND_MEAN
+        #define WIN32_LEAN_AND_MEAN
+    #endif
+    #include <winsock2.h>
+    #include <ws2tcpip.h>
+    #include <windows.h>
+    #include <psapi.h>
+    #ifdef _MSC_VER
+        #pragma comment(lib, "ws2_32.lib")
+    #endif
+#else
+    #include <arpa/inet.h>
+    #include <netinet/in.h>
+    #include <poll.h>
+    #include <sys/socket.h>
+    #include <unistd.h>
+#endif
+
+namespace {
+
+#ifdef _WIN32
+using SocketHandle = SOCKET;
+const SocketHandle kNoSocket = INVALID_SOCKET;
+const int kSendFlags = 0;
+void closeSocket(SocketHandle s) { closesocket(s); }
+int pollSocket(SocketHandle s, int timeoutMs) {
+    WSAPOLLFD fd = { s, POLLRDNORM, 0 };
+    return WSAPoll(&fd, 1, timeoutMs);
+}
+#else
+using SocketHandle = int;
+const SocketHandle kNoSocket = -1;
+// A scraper hanging up mid-response must not raise SIGPIPE in the run
+#ifdef MSG_NOSIGNAL
+const int kSendFlags = MSG_NOSIGNAL;
+#else
+const int kSendFlags = 0;  // SO_NOSIGPIPE is set on each client instead
+#endif
+void closeSocket(SocketHandle s) { ::close(s); }
+int pollSocket(SocketHandle s, int timeoutMs) {
+    pollfd fd = { s, POLLIN, 0 };
+    return ::poll(&fd, 1, timeoutMs);
+}
+#endif
+
+// Threads beyond this share slots (still correct, the adds are atomic)
+const int kMetricsSlots = 256;
+
+MetricsSlot slots[kMetricsSlots];
+std::atomic<int> nextSlot{ 0 };
+std::atomic<const char*> currentStage{ "idle" };
+const auto processStart = std::chrono::steady_clock::now();
+
+struct Totals {
+    unsigned long long particles = 0;
+    unsigned long long bonds = 0;
+    unsigned long long bytesWritten = 0;
+    unsigned long long busyNanoseconds = 0;
+};
+
+// Previous scrape, for the throughput gauges
+std::mutex scrapeMutex;
+Totals lastTotals;
+double lastScrape = 0.0;
+
+double secondsSinceStart() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - processStart).count();
+}
+
+void metric(std::ostream& out, const char* name, const char* type, const char* help) {
+    out << "# HELP " << name << " " << help << "\n# TYPE " << name << " " << type << "\n";
+}
+
+bool sendAll(SocketHandle s, const std::string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        int n = ::send(s, data.data() + sent, static_cast<int>(data.size() - sent), kSendFlags);
+        if (n <= 0) {
+            return false;
+        }
+        sent += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+}  // namespace
+
+unsigned long long residentBytes() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (K32GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return counters.WorkingSetSize;
+    }
+    return 0;
+#else
+    // Second field of statm: resident pages
+    std::ifstream statm("/proc/self/statm");
+    unsigned long long size = 0;
+    unsigned long long resident = 0;
+    if (statm >> size >> resident) {
+        return resident * static_cast<unsigned long long>(sysconf(_SC_PAGESIZE));
+    }
+    return 0;
+#endif
+}
+
+unsigned long long peakResidentBytes() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (K32GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return counters.PeakWorkingSetSize;
+    }
+    return 0;
+#else
+    // High water mark of the resident set, in kB
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "VmHWM:") == 0) {
+            return std::stoull(line.substr(6)) * 1024;
+        }
+    }
+    return 0;
+#endif
+}
+
+MetricsSlot& metricsSlot() {
+    thread_local MetricsSlot* slot =
+        &slots[nextSlot.fetch_add(1, std::memory_order_relaxed) % kMetricsSlots];
+    return *slot;
+}
+
+void metricsSetStage(const char* stage) {
+    currentStage.store(stage, std::memory_order_relaxed);
+}
+
+std::string renderMetrics() {
+    Totals now;
+    std::ostringstream busy;
+    const int used = std::min(nextSlot.load(std::memory_order_relaxed), kMetricsSlots);
+    for (int s = 0; s < used; ++s) {
+        now.particles += slots[s].particles.load(std::memory_order_relaxed);
+        now.bonds += slots[s].bonds.load(std::memory_order_relaxed);
+        now.bytesWritten += slots[s].bytesWritten.load(std::memory_order_relaxed);
+        unsigned long long ns = slots[s].busyNanoseconds.load(std::memory_order_relaxed);
+        now.busyNanoseconds += ns;
+        busy << "peridynamic_worker_busy_seconds_total{thread=\"" << s << "\"} " << ns * 1e-9 << "\n";
+    }
+
+    // Rates and utilization over the interval since the previous scrape
+    double t = secondsSinceStart();
+    Totals before;
+    double interval;
+    {
+        std::lock_guard<std::mutex> lock(scrapeMutex);
+        before = lastTotals;
+        interval = std::max(1e-9, t - lastScrape);
+        lastTotals = now;
+        lastScrape = t;
+    }
+    const int workers = workerThreads();
+
+    std::ostringstream out;
+    metric(out, "peridynamic_stage", "gauge", "Pipeline stage currently running (value 1).");
+    out << "peridynamic_stage{stage=\"" << currentStage.load(std::memory_order_relaxed) << "\"} 1\n";
+    metric(out, "peridynamic_uptime_seconds", "gauge", "Seconds since the process started.");
+    out << "peridynamic_uptime_seconds " << t << "\n";
+    metric(out, "peridynamic_particles_processed_total", "counter", "Particles processed by the lattice stages.");
+    out << "peridynamic_particles_processed_total " << now.particles << "\n";
+    metric(out, "peridynamic_bonds_processed_total", "counter", "Bonds visited by the bond kernels.");
+    out << "peridynamic_bonds_processed_total " << now.bonds << "\n";
+    metric(out, "peridynamic_bytes_written_total", "counter", "Bytes of output written.");
+    out << "peridynamic_bytes_written_total " << now.bytesWritten << "\n";
+    metric(out, "peridynamic_bonds_per_second", "gauge", "Bond throughput since the previous scrape.");
+    out << "peridynamic_bonds_per_second " << (now.bonds - before.bonds) / interval << "\n";
+    metric(out, "peridynamic_particles_per_second", "gauge", "Particle throughput since the previous scrape.");
+    out << "peridynamic_particles_per_second " << (now.particles - before.particles) / interval << "\n";
+    metric(out, "peridynamic_write_bytes_per_second", "gauge", "Output throughput since the previous scrape.");
+    out << "peridynamic_write_bytes_per_second " << (now.bytesWritten - before.bytesWritten) / interval << "\n";
+    metric(out, "peridynamic_resident_memory_bytes", "gauge", "Resident memory of the process.");
+    out << "peridynamic_resident_memory_bytes " << residentBytes() << "\n";
+    metric(out, "peridynamic_worker_threads", "gauge", "Worker threads of the kernel thread pool.");
+    out << "peridynamic_worker_threads " << workers << "\n";
+    metric(out, "peridynamic_worker_utilization", "gauge",
+           "Fraction of worker time spent in kernels since the previous scrape.");
+    out << "peridynamic_worker_utilization "
+        << std::min(1.0, (now.busyNanoseconds - before.busyNanoseconds) * 1e-9 / (interval * workers)) << "\n";
+    metric(out, "peridynamic_worker_busy_seconds_total", "counter", "Time each thread spent in kernels.");
+    out << busy.str();
+    return out.str();
+}
+
+MetricsServer::~MetricsServer() {
+    stop();
+}
+
+bool MetricsServer::start(int port) {
+#ifdef _WIN32
+    WSADATA wsa;
+    if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) {
+        std::cerr << "Error: could not initialize Winsock\n";
+        return false;
+    }
+#endif
+    SocketHandle s = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (s == kNoSocket) {
+        std::cerr << "Error: could not create metrics socket\n";
+#ifdef _WIN32
+        WSACleanup();
+#endif
+        return false;
+    }
+    int yes = 1;
+    setsockopt(s, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&yes), sizeof(yes));
+
+    // Loopback only: the endpoint is for a local Prometheus agent
+    sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<unsigned short>(port));
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::bind(s, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 || ::listen(s, 8) != 0) {
+        std::cerr << "Error: could not listen on 127.0.0.1:" << port << " for metrics\n";
+        closeSocket(s);
+#ifdef _WIN32
+        WSACleanup();
+#endif
+        return false;
+    }
+
+    listener_ = static_cast<long long>(s);
+    stop_ = false;
+    thread_ = std::thread([this] { serve(); });
+    std::cout << "Metrics at http://127.0.0.1:" << port << "/metrics\n";
+    return true;
+}
+
+void MetricsServer::stop() {
+    if (!thread_.joinable()) {
+        return;
+    }
+    stop_ = true;
+    thread_.join();
+    closeSocket(static_cast<SocketHandle>(listener_));
+    listener_ = -1;
+#ifdef _WIN32
+    WSACleanup();
+#endif
+}
+
+void MetricsServer::serve() {
+    const SocketHandle listener = static_cast<SocketHandle>(listener_);
+    while (!stop_) {
+        // Wake up regularly to notice stop()
+        if (pollSocket(listener, 200) <= 0) {
+            continue;
+        }
+        SocketHandle client = ::accept(listener, nullptr, nullptr);
+        if (client == kNoSocket) {
+            continue;
+        }
+#if !defined(_WIN32) && !defined(MSG_NOSIGNAL) && defined(SO_NOSIGPIPE)
+        int yes = 1;
+        setsockopt(client, SOL_SOCKET, SO_NOSIGPIPE, &yes, sizeof(yes));
+#endif
+
+        // Only the request line matters; scrapers send small requests
+        char request[2048];
+        int n = 0;
+        if (pollSocket(client, 1000) > 0) {
+            n = static_cast<int>(::recv(client, request, sizeof(request) - 1, 0));
+        }
+        std::string line = (n > 0) ? std::string(request, static_cast<size_t>(n)) : std::string();
+        line = line.substr(0, line.find('\r'));
+
+        std::string response;
+        if (line.rfind("GET /metrics ", 0) == 0 || line.rfind("GET / ", 0) == 0) {
+            std::string body = renderMetrics();
+            response = "HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                       "Content-Length: " + std::to_string(body.size()) +
+                       "\r\nConnection: close\r\n\r\n" + body;
+        }
+        else {
+            response = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+        }
+        sendAll(client, response);
+        closeSocket(client);
+    }
+}
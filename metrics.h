@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+// Live run telemetry in the Prometheus text format.
+//
+// Kernels count their work into a per-thread slot (one cache line each) with
+// relaxed atomic adds, once per row or block rather than per bond, so there
+// is no shared cache line and no lock in the hot loops. The slots are only
+// summed when the endpoint is scraped. With metrics_port = <port> in the job
+// file, runSimulation serves them at http://127.0.0.1:<port>/metrics.
+
+struct alignas(64) MetricsSlot {
+    std::atomic<unsigned long long> particles{ 0 };
+    std::atomic<unsigned long long> bonds{ 0 };
+    std::atomic<unsigned long long> bytesWritten{ 0 };
+    std::atomic<unsigned long long> busyNanoseconds{ 0 };
+};
+
+// Slot of the calling thread
+MetricsSlot& metricsSlot();
+
+inline void metricsCountParticles(long long n) {
+    metricsSlot().particles.fetch_add(static_cast<unsigned long long>(n), std::memory_order_relaxed);
+}
+
+inline void metricsCountBonds(long long n) {
+    metricsSlot().bonds.fetch_add(static_cast<unsigned long long>(n), std::memory_order_relaxed);
+}
+
+inline void metricsCountBytesWritten(unsigned long long n) {
+    metricsSlot().bytesWritten.fetch_add(n, std::memory_order_relaxed);
+}
+
+inline void metricsCountBusy(unsigned long long nanoseconds) {
+    metricsSlot().busyNanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+}
+
+// Resident memory of the process now and at its peak (0 where unknown)
+unsigned long long residentBytes();
+unsigned long long peakResidentBytes();
+
+// Name of the running pipeline stage (a string literal); "idle" between runs
+void metricsSetStage(const char* stage);
+
+// All metrics in the Prometheus text exposition format (version 0.0.4)
+std::string renderMetrics();
+
+// Minimal HTTP server on 127.0.0.1 answering GET /metrics
+class MetricsServer {
+public:
+    MetricsServer() = default;
+    ~MetricsServer();
+
+    MetricsServer(const MetricsServer&) = delete;
+    MetricsServer& operator=(const MetricsServer&) = delete;
+
+    // Prints an error and returns false if the port cannot be bound
+    bool start(int port);
+    void stop();
+
+private:
+    void serve();
+
+    std::thread thread_;
+    std::atomic<bool> stop_{ false };
+    long long listener_ = -1;  // socket handle (SOCKET on Windows)
+};
@@ -0,0 +1,163 @@
+#include "nonlocal.h"
+
+#include "parallel.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Column block width for the vertical passes (keeps the running sums in cache)
+const int kColumnBlock = 64;
+
+// Box half-widths (in cells) whose successive application gives the kernel.
+// For the Gaussian, three boxes are chosen so that their combined variance
+// matches sigma^2 (W. Wells, "Efficient synthesis of Gaussian filters by
+// cascaded uniform filters", 1986).
+std::vector<int> boxRadii(double radiusCells, NonlocalKernel kernel) {
+    if (kernel == NonlocalKernel::TopHat) {
+        return { std::max(0, static_cast<int>(std::lround(radiusCells))) };
+    }
+
+    const int n = 3;
+    double sigma = radiusCells / 3.0;
+    double wIdeal = std::sqrt(12.0 * sigma * sigma / n + 1.0);
+    int wl = static_cast<int>(std::floor(wIdeal));
+    if (wl % 2 == 0) {
+        wl--;
+    }
+    wl = std::max(1, wl);
+    int wu = wl + 2;
+    double mIdeal = (12.0 * sigma * sigma - n * wl * wl - 4.0 * n * wl - 3.0 * n) / (-4.0 * wl - 4.0);
+    int mCount = std::clamp(static_cast<int>(std::lround(mIdeal)), 0, n);
+
+    std::vector<int> radii;
+    for (int k = 0; k < n; ++k) {
+        radii.push_back(((k < mCount) ? wl : wu) / 2);
+    }
+    return radii;
+}
+
+// Unnormalized window sum over [k - r, k + r] along a strided line
+void boxLine(const double* src, double* dst, int n, long long stride, int r) {
+    double acc = 0.0;
+    for (int k = 0; k < std::min(r, n); ++k) {
+        acc += src[k * stride];
+    }
+    for (int k = 0; k < n; ++k) {
+        if (k + r < n) {
+            acc += src[(k + r) * stride];
+        }
+        if (k - r - 1 >= 0) {
+            acc -= src[(k - r - 1) * stride];
+        }
+        dst[k * stride] = acc;
+    }
+}
+
+// Sum of the cascaded box weights seen by each position of a line of length n
+std::vector<double> lineWeights(int n, const std::vector<int>& radii) {
+    std::vector<double> a(n, 1.0), b(n, 0.0);
+    for (int r : radii) {
+        boxLine(a.data(), b.data(), n, 1, r);
+        std::swap(a, b);
+    }
+    return a;
+}
+
+}  // namespace
+
+bool parseNonlocalKernel(const std::string& name, NonlocalKernel& kernel) {
+    if (name == "tophat" || name == "top-hat") {
+        kernel = NonlocalKernel::TopHat;
+        return true;
+    }
+    if (name == "gaussian" || name == "gauss") {
+        kernel = NonlocalKernel::Gaussian;
+        return true;
+    }
+    return false;
+}
+
+const char* nonlocalKernelName(NonlocalKernel kernel) {
+    return (kernel == NonlocalKernel::TopHat) ? "tophat" : "gaussian";
+}
+
+void nonlocalAverage(const std::vector<double>& field, int Nx, int Ny,
+                     double dx, double radius, NonlocalKernel kernel,
+                     std::vector<double>& out) {
+    const long long N = static_cast<long long>(Nx) * Ny;
+    out.assign(N, 0.0);
+    if (N == 0) {
+        return;
+    }
+
+    std::vector<int> radii = boxRadii(radius / dx, kernel);
+    std::vector<double> tmp(N, 0.0);
+
+    // Horizontal passes: one row per task, row-local ping-pong buffers
+    parallelFor(Ny, 16, [&](long long j0, long long j1) {
+        std::vector<double> a(Nx), b(Nx);
+        for (long long j = j0; j < j1; ++j) {
+            std::copy(field.begin() + j * Nx, field.begin() + (j + 1) * Nx, a.begin());
+            for (int r : radii) {
+                boxLine(a.data(), b.data(), Nx, 1, r);
+                std::swap(a, b);
+            }
+            std::copy(a.begin(), a.end(), tmp.begin() + j * Nx);
+        }
+    });
+
+    // Vertical passes: blocks of adjacent columns so every row access is contiguous
+    long long columnBlocks = (Nx + kColumnBlock - 1) / kColumnBlock;
+    for (size_t pass = 0; pass < radii.size(); ++pass) {
+        int r = radii[pass];
+        const std::vector<double>& src = (pass % 2 == 0) ? tmp : out;
+        std::vector<double>& dst = (pass % 2 == 0) ? out : tmp;
+        parallelBlocks(columnBlocks, [&](long long block, int) {
+            int i0 = static_cast<int>(block) * kColumnBlock;
+            int i1 = std::min(Nx, i0 + kColumnBlock);
+            int w = i1 - i0;
+            double acc[kColumnBlock] = {};
+            for (int j = 0; j < std::min(r, Ny); ++j) {
+                const double* row = &src[static_cast<long long>(j) * Nx + i0];
+                for (int c = 0; c < w; ++c) {
+                    acc[c] += row[c];
+                }
+            }
+            for (int j = 0; j < Ny; ++j) {
+                if (j + r < Ny) {
+                    const double* row = &src[static_cast<long long>(j + r) * Nx + i0];
+                    for (int c = 0; c < w; ++c) {
+                        acc[c] += row[c];
+                    }
+                }
+                if (j - r - 1 >= 0) {
+                    const double* row = &src[static_cast<long long>(j - r - 1) * Nx + i0];
+                    for (int c = 0; c < w; ++c) {
+                        acc[c] -= row[c];
+                    }
+                }
+                double* dstRow = &dst[static_cast<long long>(j) * Nx + i0];
+                for (int c = 0; c < w; ++c) {
+                    dstRow[c] = acc[c];
+                }
+            }
+        });
+    }
+    if (radii.size() % 2 == 0) {
+        out.swap(tmp);
+    }
+
+    // Renormalize: the separable weight sum is the product of the 1D sums
+    std::vector<double> wx = lineWeights(Nx, radii);
+    std::vector<double> wy = lineWeights(Ny, radii);
+    parallelFor(Ny, 16, [&](long long j0, long long j1) {
+        for (long long j = j0; j < j1; ++j) {
+            double* row = &out[j * Nx];
+            for (int i = 0; i < Nx; ++i) {
+                row[i] /= wx[i] * wy[j];
+            }
+        }
+    });
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Weight function used for the nonlocal damage average
+enum class NonlocalKernel {
+    TopHat,    // uniform weights over a (2r+1) x (2r+1) window
+    Gaussian   // Gaussian weights, sigma = radius / 3
+};
+
+// Parse "tophat" / "gaussian"; returns false for unknown names
+bool parseNonlocalKernel(const std::string& name, NonlocalKernel& kernel);
+const char* nonlocalKernelName(NonlocalKernel kernel);
+
+// Nonlocal average of a field stored on the Nx x Ny particle grid (row-major).
+//
+// The weights are applied as separable 1D running-sum passes (one box for
+// top-hat, three successive boxes approximating the Gaussian), so the cost per
+// particle does not depend on the averaging radius. Weights are renormalized
+// near the domain edges. Rows and column blocks are processed in parallel.
+void nonlocalAverage(const std::vector<double>& field, int Nx, int Ny,
+                     double dx, double radius, NonlocalKernel kernel,
+                     std::vector<double>& out);
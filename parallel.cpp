@@ -0,0 +1,172 @@
+#include "parallel.h"
+
+#include "metrics.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+class ThreadPool {
+public:
+    ~ThreadPool() {
+        stopWorkers();
+    }
+
+    void resize(int threads) {
+        if (threads <= 0) {
+            threads = static_cast<int>(std::thread::hardware_concurrency());
+        }
+        threads = std::max(1, threads);
+        if (threads == size_) {
+            return;
+        }
+        stopWorkers();
+        size_ = threads;
+        stop_ = false;
+        // Worker 0 is the calling thread, so only size_ - 1 threads are spawned
+        for (int w = 1; w < size_; ++w) {
+            workers_.emplace_back([this, w] { workerLoop(w); });
+        }
+    }
+
+    int size() {
+        if (size_ == 0) {
+            resize(0);
+        }
+        return size_;
+    }
+
+    void run(long long blocks, const std::function<void(long long, int)>& task) {
+        if (blocks <= 0) {
+            return;
+        }
+        // Nested or single-threaded calls run inline
+        if (inside_) {
+            for (long long b = 0; b < blocks; ++b) {
+                task(b, 0);
+            }
+            return;
+        }
+        if (size() == 1 || blocks == 1) {
+            for (long long b = 0; b < blocks; ++b) {
+                auto start = std::chrono::steady_clock::now();
+                task(b, 0);
+                countBusy(start);
+            }
+            return;
+        }
+
+        std::lock_guard<std::mutex> runLock(runMutex_);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            task_ = &task;
+            blocks_ = blocks;
+            next_.store(0);
+            pending_ = size_ - 1;
+            ++generation_;
+        }
+        wake_.notify_all();
+
+        inside_ = true;
+        drain(0);
+        inside_ = false;
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_.wait(lock, [this] { return pending_ == 0; });
+        task_ = nullptr;
+    }
+
+private:
+    void drain(int worker) {
+        for (;;) {
+            long long b = next_.fetch_add(1);
+            if (b >= blocks_) {
+                break;
+            }
+            auto start = std::chrono::steady_clock::now();
+            (*task_)(b, worker);
+            countBusy(start);
+        }
+    }
+
+    // Worker utilization for the metrics endpoint: one clock pair per block
+    static void countBusy(std::chrono::steady_clock::time_point start) {
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+        metricsCountBusy(static_cast<unsigned long long>(ns.count()));
+    }
+
+    void workerLoop(int worker) {
+        unsigned long long seen = 0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                wake_.wait(lock, [&] { return stop_ || generation_ != seen; });
+                if (stop_) {
+                    return;
+                }
+                seen = generation_;
+            }
+            inside_ = true;
+            drain(worker);
+            inside_ = false;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                --pending_;
+            }
+            done_.notify_one();
+        }
+    }
+
+    void stopWorkers() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        wake_.notify_all();
+        for (std::thread& t : workers_) {
+            t.join();
+        }
+        workers_.clear();
+        size_ = 0;
+    }
+
+    std::vector<std::thread> workers_;
+    std::mutex runMutex_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    const std::function<void(long long, int)>* task_ = nullptr;
+    long long blocks_ = 0;
+    std::atomic<long long> next_{ 0 };
+    int pending_ = 0;
+    int size_ = 0;
+    bool stop_ = false;
+    unsigned long long generation_ = 0;
+    static thread_local bool inside_;
+};
+
+thread_local bool ThreadPool::inside_ = false;
+
+ThreadPool& pool() {
+    static ThreadPool instance;
+    return instance;
+}
+
+}  // namespace
+
+void setWorkerThreads(int threads) {
+    pool().resize(threads);
+}
+
+int workerThreads() {
+    return pool().size();
+}
+
+void parallelBlocks(long long blocks, const std::function<void(long long, int)>& task) {
+    pool().run(blocks, task);
+}
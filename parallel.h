@@ -0,0 +1,33 @@
+#pragma once
+
+#include <algorithm>
+#include <functional>
+
+// Minimal persistent thread pool used by the lattice kernels.
+// Work is handed out as numbered blocks; a block is always executed by exactly
+// one worker, so kernels that write disjoint block ranges need no locking.
+
+// Set the number of worker threads (0 = use hardware concurrency)
+void setWorkerThreads(int threads);
+
+// Current number of worker threads (always >= 1)
+int workerThreads();
+
+// Run task(block, worker) for block = 0 .. blocks-1 on the pool.
+// Returns after every block has finished.
+void parallelBlocks(long long blocks, const std::function<void(long long, int)>& task);
+
+// Run body(begin, end) over [0, count) in chunks of at most grain items
+template <typename Body>
+void parallelFor(long long count, long long grain, Body&& body) {
+    if (count <= 0) {
+        return;
+    }
+    grain = std::max(1LL, grain);
+    long long blocks = (count + grain - 1) / grain;
+    parallelBlocks(blocks, [&](long long b, int) {
+        long long begin = b * grain;
+        long long end = std::min(count, begin + grain);
+        body(begin, end);
+    });
+}
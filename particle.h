@@ -0,0 +1,14 @@
+#pragma once
+
+// Simple 2D particle representation
+struct Particle {
+    double x;
+    double y;
+};
+
+// Helper: squared distance between two particles
+inline double dist2(const Particle& a, const Particle& b) {
+    double dx = a.x - b.x;
+    double dy = a.y - b.y;
+    return dx * dx + dy * dy;
+}
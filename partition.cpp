@@ -0,0 +1,403 @@
+#include "partition.h"
+
+#include "parallel.h"
+#include "reduction.h"
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <utility>
+
+namespace {
+
+// Histogram bins per refinement round, and the candidate count below which
+// the rest of the median search sorts
+const int kBins = 1024;
+const size_t kExactCandidates = 4096;
+
+// Blocks of a parallel pass over n items: enough to share out, each at least
+// a few thousand items long
+long long passBlocks(long long n) {
+    return std::max(1LL, std::min((n + 4095) / 4096, 4LL * workerThreads()));
+}
+
+// Smallest and largest value(i) over [0, n), n > 0
+template <typename Value>
+std::pair<double, double> range(long long n, const Value& value) {
+    const long long blocks = passBlocks(n);
+    std::vector<std::pair<double, double>> partial(blocks);
+    parallelBlocks(blocks, [&](long long block, int) {
+        double lo = value(n * block / blocks);
+        double hi = lo;
+        for (long long i = n * block / blocks; i < n * (block + 1) / blocks; ++i) {
+            lo = std::min(lo, value(i));
+            hi = std::max(hi, value(i));
+        }
+        partial[block] = { lo, hi };
+    });
+    std::pair<double, double> all = partial[0];
+    for (const auto& [lo, hi] : partial) {
+        all.first = std::min(all.first, lo);
+        all.second = std::max(all.second, hi);
+    }
+    return all;
+}
+
+// Order-preserving parallel filter of positions [0, n): the positions for
+// which keep(k) is true, ascending
+template <typename Keep>
+std::vector<long long> filterPositions(long long n, const Keep& keep) {
+    const long long blocks = passBlocks(n);
+    std::vector<std::vector<long long>> parts(blocks);
+    parallelBlocks(blocks, [&](long long block, int) {
+        for (long long k = n * block / blocks; k < n * (block + 1) / blocks; ++k) {
+            if (keep(k)) {
+                parts[block].push_back(k);
+            }
+        }
+    });
+    std::vector<long long> kept;
+    for (const std::vector<long long>& p : parts) {
+        kept.insert(kept.end(), p.begin(), p.end());
+    }
+    return kept;
+}
+
+class Bisection {
+public:
+    Bisection(const BondGraph& graph, int Nx, PartitionMethod method, std::vector<int>& owner)
+        : method_(method), owner_(owner), x_(graph.particles()), y_(graph.particles()),
+          weight_(graph.particles()) {
+        parallelFor(graph.particles(), 4096, [&](long long i0, long long i1) {
+            for (long long id = i0; id < i1; ++id) {
+                long long cell = graph.gridId(id);
+                x_[id] = static_cast<double>(cell % Nx);
+                y_[id] = static_cast<double>(cell / Nx);
+                weight_[id] = graph.offsets[id + 1] - graph.offsets[id];
+            }
+        });
+    }
+
+    // Assigns the particles of set to parts [firstPart, firstPart + parts)
+    void split(std::vector<long long> set, int firstPart, int parts) {
+        const long long n = static_cast<long long>(set.size());
+        if (parts == 1 || n == 0) {
+            parallelFor(n, 4096, [&](long long k0, long long k1) {
+                for (long long k = k0; k < k1; ++k) {
+                    owner_[set[k]] = firstPart;
+                }
+            });
+            return;
+        }
+        const int leftParts = parts / 2;
+        std::vector<double> key(n);
+        project(set, key);
+
+        // Left share of the weight; sets without bonds split by count
+        const long long total = exactIntegerSum(n, [&](long long k) { return weight_[set[k]]; });
+        const bool unit = (total == 0);
+        auto weightOf = [&](long long k) { return unit ? 1LL : weight_[set[k]]; };
+        const long long target = (unit ? n : total) * leftParts / parts;
+
+        std::vector<uint8_t> left(n, 0);
+        selectLeft(set, key, weightOf, target, left);
+
+        std::vector<long long> first;
+        std::vector<long long> second;
+        first.reserve(n);
+        second.reserve(n);
+        for (long long k = 0; k < n; ++k) {
+            (left[k] ? first : second).push_back(set[k]);
+        }
+        set = std::vector<long long>();
+        split(std::move(first), firstPart, leftParts);
+        split(std::move(second), firstPart + leftParts, parts - leftParts);
+    }
+
+private:
+    // Coordinate of every member along the direction the set is cut across
+    void project(const std::vector<long long>& set, std::vector<double>& key) const {
+        const long long n = static_cast<long long>(set.size());
+        double ex = 1.0;
+        double ey = 0.0;
+        if (method_ == PartitionMethod::Coordinate) {
+            auto [x0, x1] = range(n, [&](long long k) { return x_[set[k]]; });
+            auto [y0, y1] = range(n, [&](long long k) { return y_[set[k]]; });
+            if (y1 - y0 > x1 - x0) {
+                ex = 0.0;
+                ey = 1.0;
+            }
+        }
+        else {
+            // Principal axis of the weighted second moments (unit weights
+            // if no member has bonds)
+            double w = deterministicSum(n, [&](long long k) { return static_cast<double>(weight_[set[k]]); });
+            const bool unit = (w == 0.0);
+            auto weightOf = [&](long long k) { return unit ? 1.0 : static_cast<double>(weight_[set[k]]); };
+            if (unit) {
+                w = static_cast<double>(n);
+            }
+            double cx = deterministicSum(n, [&](long long k) { return weightOf(k) * x_[set[k]]; }) / w;
+            double cy = deterministicSum(n, [&](long long k) { return weightOf(k) * y_[set[k]]; }) / w;
+            double xx = deterministicSum(n, [&](long long k) {
+                double d = x_[set[k]] - cx;
+                return weightOf(k) * d * d;
+            });
+            double yy = deterministicSum(n, [&](long long k) {
+                double d = y_[set[k]] - cy;
+                return weightOf(k) * d * d;
+            });
+            double xy = deterministicSum(n, [&](long long k) {
+                return weightOf(k) * (x_[set[k]] - cx) * (y_[set[k]] - cy);
+            });
+            double angle = 0.5 * std::atan2(2.0 * xy, xx - yy);
+            ex = std::cos(angle);
+            ey = std::sin(angle);
+        }
+        parallelFor(n, 4096, [&](long long k0, long long k1) {
+            for (long long k = k0; k < k1; ++k) {
+                key[k] = ex * x_[set[k]] + ey * y_[set[k]];
+            }
+        });
+    }
+
+    // Weighted median: marks the members that go left so that their weight
+    // comes closest to target, in the order of (key, particle id). Each round
+    // histograms the remaining candidates in parallel, settles every bin on
+    // either side of the one holding the target, and keeps that bin's
+    // members as the new candidates.
+    template <typename WeightOf>
+    void selectLeft(const std::vector<long long>& set, const std::vector<double>& key, const WeightOf& weightOf,
+                    long long target, std::vector<uint8_t>& left) const {
+        const long long n = static_cast<long long>(set.size());
+        std::vector<long long> candidates(n);
+        for (long long k = 0; k < n; ++k) {
+            candidates[k] = k;
+        }
+        long long below = 0;  // weight settled on the left
+        while (candidates.size() > kExactCandidates) {
+            const long long c = static_cast<long long>(candidates.size());
+            const std::pair<double, double> bounds = range(c, [&](long long i) { return key[candidates[i]]; });
+            const double lo = bounds.first;
+            const double hi = bounds.second;
+            if (hi <= lo) {
+                break;
+            }
+            const double scale = kBins / (hi - lo);
+            auto bin = [&](long long k) {
+                return std::min(kBins - 1, static_cast<int>((key[k] - lo) * scale));
+            };
+            const long long blocks = passBlocks(c);
+            std::vector<long long> histogram(static_cast<size_t>(blocks) * kBins, 0);
+            parallelBlocks(blocks, [&](long long block, int) {
+                long long* h = histogram.data() + block * kBins;
+                for (long long i = c * block / blocks; i < c * (block + 1) / blocks; ++i) {
+                    h[bin(candidates[i])] += weightOf(candidates[i]);
+                }
+            });
+            int split = kBins - 1;
+            long long sum = below;
+            for (int b = 0; b < kBins; ++b) {
+                long long binWeight = 0;
+                for (long long block = 0; block < blocks; ++block) {
+                    binWeight += histogram[block * kBins + b];
+                }
+                if (sum + binWeight >= target) {
+                    split = b;
+                    break;
+                }
+                sum += binWeight;
+            }
+            below = sum;
+            parallelFor(c, 4096, [&](long long i0, long long i1) {
+                for (long long i = i0; i < i1; ++i) {
+                    left[candidates[i]] = (bin(candidates[i]) < split) ? 1 : 0;
+                }
+            });
+            std::vector<long long> inBin = filterPositions(c, [&](long long i) { return bin(candidates[i]) == split; });
+            for (long long& i : inBin) {
+                i = candidates[i];
+            }
+            candidates.swap(inBin);
+        }
+
+        // The last candidates in exact order; stop where the left weight is
+        // closest to the target
+        std::sort(candidates.begin(), candidates.end(), [&](long long a, long long b) {
+            return key[a] != key[b] ? key[a] < key[b] : set[a] < set[b];
+        });
+        for (long long k : candidates) {
+            long long w = weightOf(k);
+            bool take = below + w <= target || (below < target && below + w - target < target - below);
+            left[k] = take ? 1 : 0;
+            if (take) {
+                below += w;
+            }
+            else {
+                break;
+            }
+        }
+    }
+
+    PartitionMethod method_;
+    std::vector<int>& owner_;
+    std::vector<double> x_, y_;
+    std::vector<long long> weight_;
+};
+
+// Cut bonds and imbalance of an assignment
+PartitionStats measure(const BondGraph& graph, int parts, const std::vector<int>& owner, std::vector<long long>& weight) {
+    PartitionStats stats;
+    const long long N = graph.particles();
+    std::vector<int> cut(N, 0);
+    graph.forEachBlock([&](long long first, long long last) {
+        for (long long id = first; id < last; ++id) {
+            int n = 0;
+            graph.forEachBond(id, [&](long long, long long nid) {
+                n += (owner[nid] != owner[id]) ? 1 : 0;
+            });
+            cut[id] = n;
+        }
+    });
+    stats.cutBonds = exactIntegerSum(N, [&](long long id) { return cut[id]; }) / 2;
+
+    weight.assign(parts, 0);
+    for (long long id = 0; id < N; ++id) {
+        weight[owner[id]] += graph.offsets[id + 1] - graph.offsets[id];
+    }
+    long long total = 0;
+    long long largest = 0;
+    for (long long w : weight) {
+        total += w;
+        largest = std::max(largest, w);
+    }
+    stats.imbalance = (total > 0) ? static_cast<double>(largest) * parts / static_cast<double>(total) : 1.0;
+    return stats;
+}
+
+}  // namespace
+
+bool parsePartitionMethod(const std::string& name, PartitionMethod& method) {
+    if (name == "coordinate") {
+        method = PartitionMethod::Coordinate;
+        return true;
+    }
+    if (name == "inertial") {
+        method = PartitionMethod::Inertial;
+        return true;
+    }
+    return false;
+}
+
+const char* partitionMethodName(PartitionMethod method) {
+    return method == PartitionMethod::Inertial ? "inertial" : "coordinate";
+}
+
+bool partitionGraph(const BondGraph& graph, int Nx, int parts, PartitionMethod method, Partition& partition) {
+    const long long N = graph.particles();
+    if (parts < 1 || parts > N) {
+        std::cerr << "Error: cannot split " << N << " particles into " << parts << " partitions\n";
+        return false;
+    }
+    partition.parts = parts;
+    partition.owner.assign(N, 0);
+
+    // Reference: consecutive ranges of equal particle counts (row blocks)
+    parallelFor(N, 4096, [&](long long i0, long long i1) {
+        for (long long id = i0; id < i1; ++id) {
+            partition.owner[id] = static_cast<int>(id * parts / N);
+        }
+    });
+    std::vector<long long> weight;
+    partition.rowBlocks = measure(graph, parts, partition.owner, weight);
+
+    std::vector<long long> all(N);
+    for (long long id = 0; id < N; ++id) {
+        all[id] = id;
+    }
+    Bisection(graph, Nx, method, partition.owner).split(std::move(all), 0, parts);
+    partition.stats = measure(graph, parts, partition.owner, partition.weight);
+
+    partition.particles.assign(parts, 0);
+    for (long long id = 0; id < N; ++id) {
+        partition.particles[partition.owner[id]]++;
+    }
+
+    // Halos: (part, particle) pairs of bonds that leave their part, gathered
+    // per block and made unique
+    const long long blocks = passBlocks(N);
+    std::vector<std::vector<std::pair<int, long long>>> found(blocks);
+    parallelBlocks(blocks, [&](long long block, int) {
+        for (long long id = N * block / blocks; id < N * (block + 1) / blocks; ++id) {
+            const int p = partition.owner[id];
+            graph.forEachBond(id, [&](long long, long long nid) {
+                if (partition.owner[nid] != p) {
+                    found[block].push_back({ p, nid });
+                }
+            });
+        }
+    });
+    std::vector<std::pair<int, long long>> pairs;
+    for (const auto& f : found) {
+        pairs.insert(pairs.end(), f.begin(), f.end());
+    }
+    std::sort(pairs.begin(), pairs.end());
+    pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+    partition.halo.assign(parts, {});
+    for (const auto& [p, id] : pairs) {
+        partition.halo[p].push_back(id);
+    }
+    return true;
+}
+
+bool writePartition(const std::string& path, const std::string& haloPath, const BondGraph& graph,
+                    const Partition& partition) {
+    std::vector<long long> boundary(partition.parts, 0);
+    for (long long id = 0; id < graph.particles(); ++id) {
+        const int p = partition.owner[id];
+        graph.forEachBond(id, [&](long long, long long nid) {
+            boundary[p] += (partition.owner[nid] != p) ? 1 : 0;
+        });
+    }
+
+    std::ofstream out(path);
+    if (!out) {
+        std::cerr << "Error: could not write partition table " << path << "\n";
+        return false;
+    }
+    out << "part,particles,weight,boundary_bonds,halo_particles\n";
+    for (int p = 0; p < partition.parts; ++p) {
+        out << p << "," << partition.particles[p] << "," << partition.weight[p] << "," << boundary[p] << ","
+            << partition.halo[p].size() << "\n";
+    }
+    if (!out) {
+        return false;
+    }
+
+    std::ofstream halo(haloPath);
+    if (!halo) {
+        std::cerr << "Error: could not write halo lists " << haloPath << "\n";
+        return false;
+    }
+    halo << "part,grid_index\n";
+    for (int p = 0; p < partition.parts; ++p) {
+        for (long long id : partition.halo[p]) {
+            halo << p << "," << graph.gridId(id) << "\n";
+        }
+    }
+    return static_cast<bool>(halo);
+}
+
+std::string partitionTableName(const std::string& outputName) {
+    std::filesystem::path p(outputName);
+    p.replace_extension(".partition.csv");
+    return p.string();
+}
+
+std::string partitionHaloName(const std::string& outputName) {
+    std::filesystem::path p(outputName);
+    p.replace_extension(".halo.csv");
+    return p.string();
+}
@@ -0,0 +1,261 @@
+#include "porosity_models.h"
+
+#include "metrics.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// -----------------------------
+// Models
+// -----------------------------
+// Each model is constructed once per run from the setup and must provide
+//   double breakProbability(int i, int j, const StencilOffset& o, size_t k) const
+// for the bond from grid point (i, j) along half-stencil offset o (index k).
+
+// Same probability d_phi = phi / phi_c (phi_c = 1) for every bond
+struct UniformPorosity {
+    double p;
+
+    explicit UniformPorosity(const PreDamageSetup& setup)
+        : p(setup.config->phi) {}
+
+    double breakProbability(int, int, const StencilOffset&, size_t) const {
+        return p;
+    }
+};
+
+// Porosity varying linearly in x from phi (x = 0) to phi_end (x = Lx),
+// evaluated at the bond midpoint
+struct GradientPorosity {
+    double p0;
+    double slope;  // change of probability per grid cell in x
+
+    explicit GradientPorosity(const PreDamageSetup& setup) {
+        p0 = setup.config->phi;
+        slope = (setup.Nx > 1) ? (setup.config->phiEnd - p0) / (setup.Nx - 1) : 0.0;
+    }
+
+    double breakProbability(int i, int, const StencilOffset& o, size_t) const {
+        return p0 + slope * (i + 0.5 * o.di);
+    }
+};
+
+// Direction-dependent porosity: bonds aligned with the preferred angle break
+// with probability phi * (1 + a), perpendicular ones with phi * (1 - a).
+// The probability only depends on the offset, so it is tabulated per offset.
+struct AnisotropicPorosity {
+    std::vector<double> table;
+
+    explicit AnisotropicPorosity(const PreDamageSetup& setup) {
+        const double pi = 3.14159265358979323846;
+        double phi = setup.config->phi;
+        double a = setup.config->anisotropy;
+        double theta = setup.config->anisotropyAngle * pi / 180.0;
+        for (const StencilOffset& o : setup.stencil->half) {
+            double alpha = std::atan2(static_cast<double>(o.dj), static_cast<double>(o.di));
+            table.push_back(std::clamp(phi * (1.0 + a * std::cos(2.0 * (alpha - theta))), 0.0, 1.0));
+        }
+    }
+
+    double breakProbability(int, int, const StencilOffset&, size_t k) const {
+        return table[k];
+    }
+};
+
+// Polycrystal: bonds between particles of different grains break with
+// probability phi * grain_boundary_factor, bonds inside a grain with phi
+// (see grain_structure.h)
+struct GrainPorosity {
+    const GrainStructure* grains;
+    int Nx;
+    double inside;
+    double boundary;
+
+    explicit GrainPorosity(const PreDamageSetup& setup)
+        : grains(setup.grains), Nx(setup.Nx), inside(setup.config->phi),
+          boundary(std::min(1.0, setup.config->phi * setup.config->grainBoundaryFactor)) {}
+
+    double breakProbability(int i, int j, const StencilOffset& o, size_t) const {
+        long long id = static_cast<long long>(j) * Nx + i;
+        long long nid = id + static_cast<long long>(o.dj) * Nx + o.di;
+        return (grains == nullptr || grains->grain(id) == grains->grain(nid)) ? inside : boundary;
+    }
+};
+
+// -----------------------------
+// Bond kernel
+// -----------------------------
+// Visits every bond once through the half stencil. Each particle draws from
+// its own random stream (Engine::forStream(seed, id)), so the result does not
+// depend on the number of threads or on the traversal order.
+//
+// A row block writes Nb(i) for its own rows and for the next `reach` rows.
+// With blocks at least `reach` rows high, blocks of equal parity never touch
+// the same rows, so even blocks run concurrently first, then odd blocks,
+// without atomics. Inside a block, particles are visited in column tiles
+// (tile_columns wide) in the tuned loop order. Every particle still draws for
+// its offsets in stencil order, so neither knob changes the result. Bonds a
+// coupling zone removes, and candidates a jittered lattice places outside
+// the horizon, are skipped without a draw.
+template <typename Model, typename Engine>
+void preDamageKernel(const PreDamageSetup& setup, std::vector<int>& N_broken) {
+    const Model model(setup);
+    const BondStencil& stencil = *setup.stencil;
+    const int Nx = setup.Nx;
+    const int Ny = setup.Ny;
+    const unsigned long long seed = setup.seed;
+    uint8_t* const state = setup.bondState;
+    const CouplingZone* const coupling = setup.coupling;
+    const LatticeJitter* const jitter = setup.jitter;
+    const size_t H = stencil.half.size();
+
+    const KernelTuning& tuning = setup.tuning;
+    const int blockRows = std::max(tuning.tileRows > 0 ? tuning.tileRows : 16, stencil.reach);
+    const int tileColumns = (tuning.tileColumns > 0) ? std::min(tuning.tileColumns, Nx) : Nx;
+    const bool offsetMajor = (tuning.loopOrder == LoopOrder::OffsetMajor);
+    const int rowBegin = setup.rowBegin;
+    const int rowEnd = (setup.rowEnd < 0) ? Ny : std::min(Ny, setup.rowEnd);
+    const long long blocks = (rowEnd - rowBegin + blockRows - 1) / blockRows;
+
+    // Half-stencil indices of the nearest-neighbor offsets, the only ones
+    // coupled runs visit outside the columns around the region of interest
+    std::vector<size_t> nearest;
+    for (size_t k = 0; k < H; ++k) {
+        if (CouplingZone::nearestNeighbor(stencil.half[k].di, stencil.half[k].dj)) {
+            nearest.push_back(k);
+        }
+    }
+
+    auto breakBond = [&](int id, int nid, size_t k) {
+        N_broken[id]++;
+        N_broken[nid]++;
+        if (state != nullptr) {
+            state[static_cast<size_t>(id) * H + k] = 1;
+        }
+    };
+
+    for (int parity = 0; parity < 2; ++parity) {
+        parallelBlocks((blocks + 1 - parity) / 2, [&](long long t, int) {
+            int j0 = rowBegin + static_cast<int>(2 * t + parity) * blockRows;
+            int j1 = std::min(rowEnd, j0 + blockRows);
+            std::vector<Engine> rngs(offsetMajor ? tileColumns : 0);
+            std::vector<uint8_t> keep(offsetMajor && jitter != nullptr ? tileColumns : 0);
+            for (int i0 = 0; i0 < Nx; i0 += tileColumns) {
+                int i1 = std::min(Nx, i0 + tileColumns);
+                for (int j = j0; j < j1; ++j) {
+                    long long visited = 0;  // bonds of this tile row, for the metrics
+                    int spanFirst = 0;
+                    int spanLast = Nx;
+                    if (coupling != nullptr) {
+                        coupling->nonlocalSpan(j, stencil.reach, Nx, spanFirst, spanLast);
+                    }
+                    if (!offsetMajor) {
+                        for (int i = i0; i < i1; ++i) {
+                            int id = j * Nx + i;
+                            Engine rng = Engine::forStream(seed, static_cast<uint64_t>(id));
+                            const bool nonlocal = (i >= spanFirst && i < spanLast);
+                            const size_t offsets = nonlocal ? H : nearest.size();
+                            for (size_t q = 0; q < offsets; ++q) {
+                                const size_t k = nonlocal ? q : nearest[q];
+                                const StencilOffset& o = stencil.half[k];
+                                int ni = i + o.di;
+                                int nj = j + o.dj;
+                                if (ni < 0 || ni >= Nx || nj >= Ny) {
+                                    continue;
+                                }
+                                if (coupling != nullptr && !coupling->hasBond(i, j, o.di, o.dj)) {
+                                    continue;  // far field: nearest neighbors only
+                                }
+                                if (jitter != nullptr && !jitter->hasBond(id, nj * Nx + ni, o.di, o.dj)) {
+                                    continue;  // candidate beyond the horizon
+                                }
+                                visited++;
+                                uint64_t threshold = probabilityThreshold(model.breakProbability(i, j, o, k));
+                                if (drawBelow(rng.next(), threshold)) {
+                                    breakBond(id, nj * Nx + ni, k);  // break bond (id, nid)
+                                }
+                            }
+                        }
+                        metricsCountParticles(i1 - i0);
+                        metricsCountBonds(visited);
+                        continue;
+                    }
+                    // Offset-major: one engine per particle of the tile row,
+                    // and the grid bounds are resolved once per offset
+                    for (int i = i0; i < i1; ++i) {
+                        rngs[i - i0] = Engine::forStream(seed, static_cast<uint64_t>(j * Nx + i));
+                    }
+                    for (size_t k = 0; k < H; ++k) {
+                        const StencilOffset& o = stencil.half[k];
+                        int nj = j + o.dj;
+                        if (nj >= Ny) {
+                            continue;
+                        }
+                        int first = std::max(i0, -o.di);
+                        int last = std::min(i1, Nx - o.di);
+                        if (!CouplingZone::nearestNeighbor(o.di, o.dj)) {
+                            first = std::max(first, spanFirst);
+                            last = std::min(last, spanLast);
+                        }
+                        visited += std::max(0, last - first);
+                        if (jitter != nullptr && first < last) {
+                            jitter->filterRow(j, o, first, last, keep.data());
+                        }
+                        for (int i = first; i < last; ++i) {
+                            if ((coupling != nullptr && !coupling->hasBond(i, j, o.di, o.dj)) ||
+                                (jitter != nullptr && !keep[i - first])) {
+                                visited--;  // counted with the range above
+                                continue;
+                            }
+                            uint64_t threshold = probabilityThreshold(model.breakProbability(i, j, o, k));
+                            if (drawBelow(rngs[i - i0].next(), threshold)) {
+                                breakBond(j * Nx + i, nj * Nx + i + o.di, k);
+                            }
+                        }
+                    }
+                    metricsCountParticles(i1 - i0);
+                    metricsCountBonds(visited);
+                }
+            }
+        });
+    }
+}
+
+// Kernel table of one model, one instantiation per engine (RngEngine order)
+template <typename Model>
+PorosityModelInfo registerModel(const char* name, const char* description) {
+    return { name, description,
+             { &preDamageKernel<Model, Xoshiro256pp>,
+               &preDamageKernel<Model, Pcg64>,
+               &preDamageKernel<Model, Philox4x32>,
+               &preDamageKernel<Model, SplitMixEngine> } };
+}
+
+const PorosityModelInfo kModels[] = {
+    registerModel<UniformPorosity>("uniform", "same breaking probability phi for every bond"),
+    registerModel<GradientPorosity>("gradient", "phi varies linearly in x from phi to phi_end"),
+    registerModel<AnisotropicPorosity>("anisotropic",
+        "phi * (1 + anisotropy * cos 2(bond angle - anisotropy_angle))"),
+    registerModel<GrainPorosity>("grains",
+        "Voronoi grains of grain_size; phi inside, phi * grain_boundary_factor across boundaries"),
+};
+
+}  // namespace
+
+const PorosityModelInfo* findPorosityModel(const std::string& name) {
+    for (const PorosityModelInfo& model : kModels) {
+        if (name == model.name) {
+            return &model;
+        }
+    }
+    return nullptr;
+}
+
+void listPorosityModels(std::ostream& out) {
+    for (const PorosityModelInfo& model : kModels) {
+        out << "  " << model.name << ": " << model.description << "\n";
+    }
+}
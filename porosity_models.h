@@ -0,0 +1,66 @@
+#pragma once
+
+#include "coupling.h"
+#include "grain_structure.h"
+#include "job_config.h"
+#include "kernel_tuning.h"
+#include "lattice.h"
+#include "lattice_jitter.h"
+#include "rng.h"
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Porosity models for the pre-damage step (step 4 of runSimulation).
+//
+// A model is a small policy class that supplies the breaking probability of
+// one bond. It is a template argument of the bond kernel, so the call is
+// inlined into the bond loop. The registry maps the model name from the job
+// configuration to the kernels instantiated for that model (one per random
+// engine); the only indirect call is the one that starts the kernel.
+
+// Everything a pre-damage kernel needs to know about the run
+struct PreDamageSetup {
+    int Nx = 0;
+    int Ny = 0;
+    double dx = 0.0;
+    const BondStencil* stencil = nullptr;
+    const SimulationConfig* config = nullptr;
+    unsigned long long seed = 0;
+    KernelTuning tuning;  // resolved tile size and loop order (auto fields use defaults)
+    // Rows whose bonds are processed; the kernel may be run band by band
+    // (Nb(i) of rows up to rowEnd + reach is updated)
+    int rowBegin = 0;
+    int rowEnd = -1;      // -1 = Ny
+    // Optional record of every decision: bondState[id * half.size() + k] = 1
+    // when the bond from id along half-stencil offset k broke (slots of
+    // offsets leaving the grid stay untouched)
+    uint8_t* bondState = nullptr;
+    // Coupled runs: only the bonds the zone keeps exist (nullptr = all)
+    const CouplingZone* coupling = nullptr;
+    // Jittered lattice: stencil candidates outside the horizon are no bonds
+    const LatticeJitter* jitter = nullptr;
+    // Grain map of the grains model (nullptr otherwise)
+    const GrainStructure* grains = nullptr;
+};
+
+// Breaks bonds and accumulates Nb(i) for both end points of every broken bond
+using PreDamageKernel = void (*)(const PreDamageSetup& setup, std::vector<int>& N_broken);
+
+struct PorosityModelInfo {
+    const char* name;
+    const char* description;
+    PreDamageKernel kernels[kRngEngineCount];  // indexed by RngEngine
+
+    PreDamageKernel kernel(RngEngine engine) const {
+        return kernels[static_cast<int>(engine)];
+    }
+};
+
+// Registered model with the given name, or nullptr
+const PorosityModelInfo* findPorosityModel(const std::string& name);
+
+// Print the registered model names and descriptions
+void listPorosityModels(std::ostream& out);
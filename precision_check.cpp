@@ -0,0 +1,158 @@
+#include "precision_check.h"
+
+#include "bond_graph.h"
+#include "fatigue.h"
+#include "job_config.h"
+#include "lattice.h"
+#include "lattice_stages.h"
+#include "porosity_models.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+namespace {
+
+const double kEnergyTolerance = 1e-5;      // relative, after one jump
+const double kLifeTolerance = 1e-4;        // absolute, per particle after one jump
+const double kCyclesTolerance = 0.02;      // relative, cycles to failure
+
+struct CheckLattice {
+    int Nx = 0;
+    int Ny = 0;
+    BondStencil stencil;
+    SimulationConfig config;
+    std::vector<int> N_total;
+};
+
+struct CheckRun {
+    FatigueResult result;
+    double seconds = 0.0;
+    long long iterations = 0;
+};
+
+// Fresh pre-damaged graph (the same for every call) and one fatigue run on it
+bool runFatigueOnce(const CheckLattice& l, const FatigueOptions& options, CheckRun& run) {
+    const long long N = static_cast<long long>(l.Nx) * l.Ny;
+    MappedArray<uint8_t> halfState;
+    if (!halfState.allocate(static_cast<size_t>(N) * l.stencil.half.size(), std::string())) {
+        return false;
+    }
+    PreDamageSetup setup;
+    setup.Nx = l.Nx;
+    setup.Ny = l.Ny;
+    setup.dx = 1.0;
+    setup.stencil = &l.stencil;
+    setup.config = &l.config;
+    setup.seed = l.config.seed;
+    setup.tuning = l.config.tuning;
+    setup.bondState = halfState.data();
+    std::vector<int> N_broken(N, 0);
+    findPorosityModel("uniform")->kernel(l.config.rng)(setup, N_broken);
+
+    BondGraph graph;
+    if (!buildBondGraph(l.Nx, l.Ny, l.stencil, nullptr, nullptr, l.N_total, halfState, BondStorageOptions(), graph)) {
+        return false;
+    }
+    auto start = std::chrono::steady_clock::now();
+    if (!runFatigue(graph, l.Nx, l.Ny, l.stencil, nullptr, options, BondStorageOptions(), run.result)) {
+        return false;
+    }
+    run.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    for (const FatigueStep& step : run.result.history) {
+        run.iterations += step.solverIterations;
+    }
+    return true;
+}
+
+void printRow(const char* name, const CheckRun& run) {
+    std::cout << std::left << std::setw(10) << name << std::right
+        << std::setw(14) << run.result.cycles
+        << std::setw(10) << run.result.resolvedCycles
+        << std::setw(12) << run.result.brokenBonds
+        << std::setw(12) << run.iterations
+        << std::fixed << std::setprecision(3) << std::setw(10) << run.seconds << "\n";
+    std::cout.unsetf(std::ios::floatfield);
+    std::cout << std::setprecision(6);
+}
+
+bool report(const char* what, double difference, double tolerance) {
+    bool ok = difference <= tolerance;
+    std::cout << "  " << std::left << std::setw(28) << what << std::right << std::setw(12) << difference
+        << "  (tolerance " << tolerance << ")" << (ok ? "" : "   EXCEEDED") << "\n";
+    return ok;
+}
+
+}  // namespace
+
+int runPrecisionCheck(int gridSize, double m) {
+    gridSize = std::max(gridSize, 32);
+    m = std::max(m, 1.0);
+
+    CheckLattice l;
+    l.Nx = gridSize;
+    l.Ny = gridSize / 2;
+    l.stencil = buildBondStencil(1.0, m);
+    l.config.phi = 0.05;
+    l.config.seed = 12345;
+    l.N_total.assign(static_cast<size_t>(l.Nx) * l.Ny, 0);
+    computeNeighborCounts(l.stencil, nullptr, nullptr, l.Nx, l.Ny, l.config.tuning.tileRows, l.N_total);
+
+    std::cout << "\n===== Mixed-precision check =====\n";
+    std::cout << "Fatigue on " << l.Nx << " x " << l.Ny << " (m = " << m << ", phi = " << l.config.phi << ")\n";
+
+    // One jump: the stretch field and wear rates of the intact lattice
+    FatigueOptions options;
+    options.cycles = 1e9;
+    options.maxJumps = 1;
+    CheckRun single[2];
+    for (int mixed = 0; mixed < 2; ++mixed) {
+        options.mixedPrecision = (mixed != 0);
+        if (!runFatigueOnce(l, options, single[mixed])) {
+            return 1;
+        }
+    }
+    const FatigueResult& d = single[0].result;
+    const FatigueResult& f = single[1].result;
+    double lifeDifference = 0.0;
+    for (size_t i = 0; i < d.life.size(); ++i) {
+        lifeDifference = std::max(lifeDifference, std::abs(d.life[i] - f.life[i]));
+    }
+    std::cout << "\nAfter one jump of " << d.cycles << " cycles:\n";
+    // The elastic energy of each path on its own, not the stiffness: that is
+    // normalized by the path's own first solve and is 1 in both
+    bool ok = report("elastic energy (relative)", std::abs(f.energy - d.energy) / d.energy, kEnergyTolerance);
+    ok = report("bond life (max absolute)", lifeDifference, kLifeTolerance) && ok;
+
+    // To failure: bonds break in the same order unless their lives tie
+    options.maxJumps = FatigueOptions().maxJumps;
+    CheckRun full[2];
+    for (int mixed = 0; mixed < 2; ++mixed) {
+        options.mixedPrecision = (mixed != 0);
+        if (!runFatigueOnce(l, options, full[mixed])) {
+            return 1;
+        }
+    }
+    std::cout << "\nTo failure:\n" << std::left << std::setw(10) << "precision" << std::right
+        << std::setw(14) << "cycles" << std::setw(10) << "solves" << std::setw(12) << "broken"
+        << std::setw(12) << "CG iters" << std::setw(10) << "seconds" << "\n";
+    printRow("double", full[0]);
+    printRow("mixed", full[1]);
+    ok = report("cycles to failure (relative)",
+        std::abs(full[1].result.cycles - full[0].result.cycles) / full[0].result.cycles, kCyclesTolerance) && ok;
+    if (full[0].result.failed != full[1].result.failed) {
+        std::cout << "  only one precision reached failure\n";
+        ok = false;
+    }
+    std::cout << "Speed-up of mixed precision: " << full[0].seconds / full[1].seconds << "x\n";
+
+    if (!ok) {
+        std::cerr << "\nError: mixed precision differs from the double path beyond tolerance\n";
+        return 1;
+    }
+    std::cout << "\nMixed precision matches the double path.\n";
+    return 0;
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+// Accuracy check of the mixed-precision bond kernels
+// (Peridynamic --check-precision [grid size] [m]).
+//
+// Builds one pre-damaged grid x grid lattice and runs the fatigue solver on
+// it in double and in mixed precision: first a single cycle jump, comparing
+// the elastic energy and the remaining bond lives, then a run to failure,
+// comparing the cycles to failure and timing both. Returns 1 when a
+// difference exceeds its tolerance.
+int runPrecisionCheck(int gridSize, double m);
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "parallel.h"
+
+#include <cmath>
+#include <vector>
+
+// Deterministic parallel reductions.
+//
+// The index range is cut into fixed-size leaves that depend only on the item
+// count, never on the number of threads. Each leaf is summed in index order
+// with Neumaier compensation, and the leaf results are combined by a fixed
+// pairwise tree. The result is therefore bit-identical for any thread count.
+
+// Items per leaf of the reduction tree
+const long long kReductionLeaf = 4096;
+
+// Compensated partial sum (value + running error term)
+struct CompensatedSum {
+    double sum = 0.0;
+    double err = 0.0;
+
+    void add(double v) {
+        double t = sum + v;
+        if (std::fabs(sum) >= std::fabs(v)) {
+            err += (sum - t) + v;
+        }
+        else {
+            err += (v - t) + sum;
+        }
+        sum = t;
+    }
+
+    void add(const CompensatedSum& o) {
+        add(o.sum);
+        err += o.err;
+    }
+
+    double value() const {
+        return sum + err;
+    }
+};
+
+// Combine leaves [lo, hi) with a fixed-shape pairwise tree
+inline CompensatedSum combinePairwise(const std::vector<CompensatedSum>& leaves, size_t lo, size_t hi) {
+    if (hi - lo == 1) {
+        return leaves[lo];
+    }
+    size_t mid = lo + (hi - lo) / 2;
+    CompensatedSum left = combinePairwise(leaves, lo, mid);
+    left.add(combinePairwise(leaves, mid, hi));
+    return left;
+}
+
+// Sum of term(i) for i in [0, count), reproducible across thread counts
+template <typename Term>
+double deterministicSum(long long count, Term&& term) {
+    if (count <= 0) {
+        return 0.0;
+    }
+    long long leafCount = (count + kReductionLeaf - 1) / kReductionLeaf;
+    std::vector<CompensatedSum> leaves(leafCount);
+    parallelFor(leafCount, 1, [&](long long l0, long long l1) {
+        for (long long l = l0; l < l1; ++l) {
+            long long begin = l * kReductionLeaf;
+            long long end = std::min(count, begin + kReductionLeaf);
+            CompensatedSum s;
+            for (long long i = begin; i < end; ++i) {
+                s.add(static_cast<double>(term(i)));
+            }
+            leaves[l] = s;
+        }
+    });
+    return combinePairwise(leaves, 0, leaves.size()).value();
+}
+
+inline double deterministicSum(const std::vector<double>& values) {
+    return deterministicSum(static_cast<long long>(values.size()),
+                            [&](long long i) { return values[i]; });
+}
+
+// Integer sums are exact, so any order is reproducible; leaves keep the
+// work split identical to the floating-point version.
+template <typename Term>
+long long exactIntegerSum(long long count, Term&& term) {
+    if (count <= 0) {
+        return 0;
+    }
+    long long leafCount = (count + kReductionLeaf - 1) / kReductionLeaf;
+    std::vector<long long> leaves(leafCount, 0);
+    parallelFor(leafCount, 1, [&](long long l0, long long l1) {
+        for (long long l = l0; l < l1; ++l) {
+            long long begin = l * kReductionLeaf;
+            long long end = std::min(count, begin + kReductionLeaf);
+            long long s = 0;
+            for (long long i = begin; i < end; ++i) {
+                s += static_cast<long long>(term(i));
+            }
+            leaves[l] = s;
+        }
+    });
+    long long total = 0;
+    for (long long s : leaves) {
+        total += s;
+    }
+    return total;
+}
@@ -0,0 +1,498 @@
+#include "refinement.h"
+
+#include "parallel.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <iostream>
+#include <utility>
+
+namespace {
+
+const long long kParticleGrain = 4096;
+
+// Origin of a particle in the new set
+enum class Origin : uint8_t { Kept, Child, Merged };
+
+struct NewParticle {
+    long long cell;     // index lattice id
+    long long parent;   // reference particle
+    long long from;     // kept: old id; child: old id of the split parent; merged: -1
+    Origin origin;
+};
+
+// Directed bond from id to nid in g (neighbors are sorted), or -1
+long long findBond(const BondGraph& g, long long id, long long nid) {
+    const int* first = g.neighbor.data() + g.offsets[id];
+    const int* last = g.neighbor.data() + g.offsets[id + 1];
+    const int* it = std::lower_bound(first, last, static_cast<int>(nid));
+    return (it != last && *it == nid) ? it - g.neighbor.data() : -1;
+}
+
+}  // namespace
+
+AdaptiveLattice::AdaptiveLattice(BondGraph& reference, int Nx, int Ny, const BondStencil& stencil, int coarsenSteps,
+                                 const BondStorageOptions& storage)
+    : reference_(reference), Nx_(Nx), Ny_(Ny), reach_(stencil.reach), coarsenSteps_(coarsenSteps),
+      storage_(storage) {
+    width_ = kSubdivision * (Nx - 1) + 1;
+    height_ = kSubdivision * (Ny - 1) + 1;
+    for (const StencilOffset& o : stencil.full) {
+        maxLength2_ = std::max(maxLength2_, static_cast<long long>(o.di) * o.di + static_cast<long long>(o.dj) * o.dj);
+    }
+    // Long enough for any bond plus the shift of a child from its parent
+    cellSize_ = static_cast<int>(std::ceil(kSubdivision * (std::sqrt(static_cast<double>(maxLength2_)) + 1.0)));
+}
+
+double AdaptiveLattice::bondWeight(int I, int, int dI, int) {
+    // c V_i V_j relative to a coarse bond: children have a quarter of the
+    // volume and c ~ 1 / horizon^3 with the mean horizon of the two ends
+    bool fineA = (I % 2) != 0;
+    bool fineB = ((I + dI) % 2) != 0;
+    if (fineA && fineB) {
+        return 0.5;             // 8 / 16
+    }
+    if (fineA || fineB) {
+        return 16.0 / 27.0;     // (4/3)^3 / 4
+    }
+    return 1.0;
+}
+
+bool AdaptiveLattice::start() {
+    const long long N = reference_.particles();
+    std::vector<int> counts(N);
+    for (long long id = 0; id < N; ++id) {
+        counts[id] = static_cast<int>(reference_.offsets[id + 1] - reference_.offsets[id]);
+    }
+    if (!graph_.allocate(counts, storage_)) {
+        return false;
+    }
+    parallelFor(reference_.bonds(), 1 << 16, [&](long long b0, long long b1) {
+        std::copy(reference_.neighbor.data() + b0, reference_.neighbor.data() + b1, graph_.neighbor.data() + b0);
+        std::copy(reference_.broken.data() + b0, reference_.broken.data() + b1, graph_.broken.data() + b0);
+    });
+
+    cell_.resize(N);
+    parent_.resize(N);
+    for (long long id = 0; id < N; ++id) {
+        long long g = reference_.gridId(id);
+        cell_[id] = kSubdivision * ((g % Nx_) + (g / Nx_) * static_cast<long long>(width_));
+        parent_[id] = id;
+    }
+    graph_.setGridIds(cell_);
+    quiet_.assign(N, 0);
+    mass_.assign(N, 1.0);
+    refinedParents_ = 0;
+    return true;
+}
+
+bool AdaptiveLattice::adapt(const std::vector<uint8_t>& active, std::vector<double>& u,
+                            const std::vector<std::vector<double>*>& fields, bool& changed) {
+    const long long N = graph_.particles();
+    std::vector<uint8_t> refine(N, 0);
+    std::vector<uint8_t> quietChildren(reference_.particles(), 0);
+    std::vector<uint8_t> coarsen(reference_.particles(), 0);
+    changed = false;
+    for (long long p = 0; p < N; ++p) {
+        quiet_[p] = active[p] ? 0 : std::min(quiet_[p] + 1, INT_MAX - 1);
+        long long P = parent_[p];
+        if ((cell_[p] % width_) % 2 != 0) {
+            if (quiet_[p] >= coarsenSteps_ && ++quietChildren[P] == 4) {
+                coarsen[P] = 1;
+                changed = true;
+            }
+            continue;
+        }
+        // Children must stay inside the specimen and off the grips
+        long long g = reference_.gridId(P);
+        int i = static_cast<int>(g % Nx_);
+        int j = static_cast<int>(g / Nx_);
+        if (active[p] && i > reach_ && i < Nx_ - reach_ && j > 0 && j < Ny_ - 1) {
+            refine[p] = 1;
+            changed = true;
+        }
+    }
+    if (!changed) {
+        return true;
+    }
+    return rebuild(refine, coarsen, u, fields);
+}
+
+bool AdaptiveLattice::finish(std::vector<double>& u, const std::vector<std::vector<double>*>& fields) {
+    const long long N = graph_.particles();
+    std::vector<uint8_t> refine(N, 0);
+    std::vector<uint8_t> coarsen(reference_.particles(), 0);
+    bool any = false;
+    for (long long p = 0; p < N; ++p) {
+        if ((cell_[p] % width_) % 2 != 0) {
+            coarsen[parent_[p]] = 1;
+            any = true;
+        }
+    }
+    if (any && !rebuild(refine, coarsen, u, fields)) {
+        return false;
+    }
+    syncReference();
+    return true;
+}
+
+// Bonds between coarse particles are the reference bonds; copy their state
+void AdaptiveLattice::syncReference() {
+    const long long N = graph_.particles();
+    parallelFor(N, kParticleGrain, [&](long long p0, long long p1) {
+        for (long long p = p0; p < p1; ++p) {
+            if ((cell_[p] % width_) % 2 != 0) {
+                continue;
+            }
+            for (long long b = graph_.offsets[p]; b < graph_.offsets[p + 1]; ++b) {
+                long long q = graph_.neighbor[b];
+                if ((cell_[q] % width_) % 2 != 0) {
+                    continue;
+                }
+                long long rb = findBond(reference_, parent_[p], parent_[q]);
+                if (rb >= 0) {
+                    reference_.broken[rb] = graph_.broken[b];
+                }
+            }
+        }
+    });
+}
+
+// A merging family sets each coarse bond of its parent by majority of the
+// current bonds between its children and the other end's particles
+void AdaptiveLattice::mergeBondStates(const std::vector<uint8_t>& coarsen) {
+    const long long N = graph_.particles();
+    std::vector<std::pair<long long, long long>> members;  // (parent, child)
+    for (long long p = 0; p < N; ++p) {
+        if ((cell_[p] % width_) % 2 != 0 && coarsen[parent_[p]]) {
+            members.push_back({ parent_[p], p });
+        }
+    }
+    std::sort(members.begin(), members.end());
+    for (size_t g0 = 0; g0 < members.size();) {
+        size_t g1 = g0;
+        const long long P = members[g0].first;
+        while (g1 < members.size() && members[g1].first == P) {
+            g1++;
+        }
+        for (long long rb = reference_.offsets[P]; rb < reference_.offsets[P + 1]; ++rb) {
+            long long Q = reference_.neighbor[rb];
+            int total = 0;
+            int broken = 0;
+            for (size_t m = g0; m < g1; ++m) {
+                long long c = members[m].second;
+                for (long long b = graph_.offsets[c]; b < graph_.offsets[c + 1]; ++b) {
+                    if (parent_[graph_.neighbor[b]] == Q) {
+                        total++;
+                        broken += graph_.broken[b];
+                    }
+                }
+            }
+            if (total > 0) {
+                uint8_t state = (2 * broken > total) ? 1 : 0;
+                reference_.broken[rb] = state;
+                long long reverse = findBond(reference_, Q, P);
+                if (reverse >= 0) {
+                    reference_.broken[reverse] = state;
+                }
+            }
+        }
+        g0 = g1;
+    }
+}
+
+bool AdaptiveLattice::rebuild(const std::vector<uint8_t>& refine, const std::vector<uint8_t>& coarsen,
+                              std::vector<double>& u, const std::vector<std::vector<double>*>& fields) {
+    const long long oldN = graph_.particles();
+    const long long W = width_;
+    syncReference();
+    mergeBondStates(coarsen);
+
+    // New particle set in index lattice order; a merged parent enters with
+    // its lower left child
+    auto parentCell = [&](long long P) {
+        long long g = reference_.gridId(P);
+        return kSubdivision * ((g % Nx_) + (g / Nx_) * W);
+    };
+    std::vector<NewParticle> next;
+    next.reserve(oldN + 3 * std::count(refine.begin(), refine.end(), uint8_t(1)));
+    for (long long p = 0; p < oldN; ++p) {
+        long long P = parent_[p];
+        if ((cell_[p] % W) % 2 != 0) {
+            if (!coarsen[P]) {
+                next.push_back({ cell_[p], P, p, Origin::Kept });
+            }
+            else if (cell_[p] == parentCell(P) - 1 - W) {
+                next.push_back({ parentCell(P), P, -1, Origin::Merged });
+            }
+        }
+        else if (refine[p]) {
+            for (int dJ = -1; dJ <= 1; dJ += 2) {
+                for (int dI = -1; dI <= 1; dI += 2) {
+                    next.push_back({ cell_[p] + dI + dJ * W, P, p, Origin::Child });
+                }
+            }
+        }
+        else {
+            next.push_back({ cell_[p], P, p, Origin::Kept });
+        }
+    }
+    std::sort(next.begin(), next.end(), [](const NewParticle& a, const NewParticle& b) { return a.cell < b.cell; });
+    const long long newN = static_cast<long long>(next.size());
+    if (newN >= INT_MAX) {
+        std::cerr << "Error: too many particles after refinement\n";
+        return false;
+    }
+    std::vector<long long> oldToNew(oldN, -1);
+    std::vector<long long> mergedId(reference_.particles(), -1);
+    for (long long k = 0; k < newN; ++k) {
+        if (next[k].origin == Origin::Kept) {
+            oldToNew[next[k].from] = k;
+        }
+        else if (next[k].origin == Origin::Merged) {
+            mergedId[next[k].parent] = k;
+        }
+    }
+
+    // Displacements of children: parent value plus the least-squares
+    // deformation gradient over the parent's intact bonds
+    auto childDisplacement = [&](long long p, long long cell, double& ux, double& uy) {
+        double a00 = 0.0, a01 = 0.0, a11 = 0.0;
+        double b00 = 0.0, b01 = 0.0, b10 = 0.0, b11 = 0.0;
+        for (long long b = graph_.offsets[p]; b < graph_.offsets[p + 1]; ++b) {
+            if (graph_.broken[b]) {
+                continue;
+            }
+            long long q = graph_.neighbor[b];
+            double xi = static_cast<double>(cell_[q] % W - cell_[p] % W) / kSubdivision;
+            double eta = static_cast<double>(cell_[q] / W - cell_[p] / W) / kSubdivision;
+            double dux = u[2 * q] - u[2 * p];
+            double duy = u[2 * q + 1] - u[2 * p + 1];
+            a00 += xi * xi;
+            a01 += xi * eta;
+            a11 += eta * eta;
+            b00 += dux * xi;
+            b01 += dux * eta;
+            b10 += duy * xi;
+            b11 += duy * eta;
+        }
+        ux = u[2 * p];
+        uy = u[2 * p + 1];
+        double det = a00 * a11 - a01 * a01;
+        if (det <= 1e-12) {
+            return;
+        }
+        double ox = static_cast<double>(cell % W - cell_[p] % W) / kSubdivision;
+        double oy = static_cast<double>(cell / W - cell_[p] / W) / kSubdivision;
+        // F = B A^-1 applied to the offset
+        double sx = (a11 * ox - a01 * oy) / det;
+        double sy = (a00 * oy - a01 * ox) / det;
+        ux += b00 * sx + b01 * sy;
+        uy += b10 * sx + b11 * sy;
+    };
+
+    // Carry the fields into their swap buffers (the capacity is kept, so the
+    // solver vectors only grow when the particle count exceeds its peak)
+    spare_.resize(fields.size() + 1);
+    auto carry = [&](std::vector<double>& field, std::vector<double>& spare, bool displacement) {
+        spare.assign(2 * newN, 0.0);
+        parallelFor(newN, kParticleGrain, [&](long long k0, long long k1) {
+            for (long long k = k0; k < k1; ++k) {
+                const NewParticle& n = next[k];
+                if (n.origin == Origin::Merged) {
+                    continue;
+                }
+                if (n.origin == Origin::Child && displacement) {
+                    childDisplacement(n.from, n.cell, spare[2 * k], spare[2 * k + 1]);
+                    continue;
+                }
+                spare[2 * k] = field[2 * n.from];
+                spare[2 * k + 1] = field[2 * n.from + 1];
+            }
+        });
+        for (long long p = 0; p < oldN; ++p) {
+            long long k = oldToNew[p] < 0 ? mergedId[parent_[p]] : -1;
+            if (k >= 0) {
+                spare[2 * k] += 0.25 * field[2 * p];
+                spare[2 * k + 1] += 0.25 * field[2 * p + 1];
+            }
+        }
+        field.swap(spare);
+    };
+    carry(u, spare_[0], true);
+    for (size_t f = 0; f < fields.size(); ++f) {
+        carry(*fields[f], spare_[f + 1], false);
+    }
+
+    // Cell list of the new particles
+    const long long cellsX = W / cellSize_ + 1;
+    const long long cellsY = height_ / cellSize_ + 1;
+    auto cellOf = [&](long long c) { return ((c / W) / cellSize_) * cellsX + (c % W) / cellSize_; };
+    std::vector<long long> cellStart(cellsX * cellsY + 1, 0);
+    std::vector<long long> cellItems(newN);
+    for (long long k = 0; k < newN; ++k) {
+        cellStart[cellOf(next[k].cell) + 1]++;
+    }
+    for (long long c = 0; c < cellsX * cellsY; ++c) {
+        cellStart[c + 1] += cellStart[c];
+    }
+    {
+        std::vector<long long> fill(cellStart.begin(), cellStart.end() - 1);
+        for (long long k = 0; k < newN; ++k) {
+            cellItems[fill[cellOf(next[k].cell)]++] = k;
+        }
+    }
+    auto forNeighbors = [&](long long k, const auto& visit) {
+        long long cx = (next[k].cell % W) / cellSize_;
+        long long cy = (next[k].cell / W) / cellSize_;
+        for (long long y = std::max(0LL, cy - 1); y <= std::min(cellsY - 1, cy + 1); ++y) {
+            for (long long x = std::max(0LL, cx - 1); x <= std::min(cellsX - 1, cx + 1); ++x) {
+                long long c = y * cellsX + x;
+                for (long long e = cellStart[c]; e < cellStart[c + 1]; ++e) {
+                    visit(cellItems[e]);
+                }
+            }
+        }
+    };
+    auto distance2 = [&](long long k, long long q) {
+        long long dI = next[q].cell % W - next[k].cell % W;
+        long long dJ = next[q].cell / W - next[k].cell / W;
+        return dI * dI + dJ * dJ;
+    };
+
+    // Particles near a new one search for bonds; so does any particle that
+    // lost a neighbor
+    std::vector<uint8_t> affected(newN, 0);
+    const long long reach2 = static_cast<long long>(cellSize_) * cellSize_;
+    for (long long k = 0; k < newN; ++k) {
+        if (next[k].origin == Origin::Kept) {
+            continue;
+        }
+        affected[k] = 1;
+        forNeighbors(k, [&](long long q) {
+            if (distance2(k, q) <= reach2) {
+                affected[q] = 1;
+            }
+        });
+    }
+    parallelFor(newN, kParticleGrain, [&](long long k0, long long k1) {
+        for (long long k = k0; k < k1; ++k) {
+            if (affected[k]) {
+                continue;
+            }
+            long long p = next[k].from;
+            for (long long b = graph_.offsets[p]; b < graph_.offsets[p + 1]; ++b) {
+                if (oldToNew[graph_.neighbor[b]] < 0) {
+                    affected[k] = 1;
+                    break;
+                }
+            }
+        }
+    });
+
+    // State of a new bond that involves a child: the bond it continues, else
+    // the coarse bond between the parents (siblings are intact; parents
+    // without a bond have no load path between them)
+    auto fineState = [&](long long k, long long q) -> uint8_t {
+        const NewParticle& a = next[k];
+        const NewParticle& b = next[q];
+        if (a.origin == Origin::Kept && b.origin == Origin::Kept) {
+            long long ob = findBond(graph_, a.from, b.from);
+            if (ob >= 0) {
+                return graph_.broken[ob];
+            }
+        }
+        if (a.parent == b.parent) {
+            return 0;
+        }
+        long long rb = findBond(reference_, a.parent, b.parent);
+        return rb >= 0 ? reference_.broken[rb] : 1;
+    };
+    std::vector<long long> searching;
+    std::vector<long long> listIndex(newN, -1);
+    for (long long k = 0; k < newN; ++k) {
+        if (affected[k]) {
+            listIndex[k] = static_cast<long long>(searching.size());
+            searching.push_back(k);
+        }
+    }
+    const long long fine2 = 4 * maxLength2_;    // (2 * stencil length)^2: half the horizon
+    const long long mixed2 = 9 * maxLength2_;   // (3 * stencil length)^2: three quarters
+    std::vector<std::vector<std::pair<int, uint8_t>>> lists(searching.size());
+    parallelFor(static_cast<long long>(searching.size()), 16, [&](long long s0, long long s1) {
+        for (long long s = s0; s < s1; ++s) {
+            long long k = searching[s];
+            bool fineK = (next[k].cell % W) % 2 != 0;
+            std::vector<std::pair<int, uint8_t>>& list = lists[s];
+            forNeighbors(k, [&](long long q) {
+                if (q == k) {
+                    return;
+                }
+                bool fineQ = (next[q].cell % W) % 2 != 0;
+                if (!fineK && !fineQ) {
+                    long long rb = findBond(reference_, next[k].parent, next[q].parent);
+                    if (rb >= 0) {
+                        list.push_back({ static_cast<int>(q), reference_.broken[rb] });
+                    }
+                    return;
+                }
+                if (distance2(k, q) <= ((fineK && fineQ) ? fine2 : mixed2)) {
+                    list.push_back({ static_cast<int>(q), fineState(k, q) });
+                }
+            });
+            std::sort(list.begin(), list.end());
+        }
+    });
+
+    // Assemble the new graph
+    std::vector<int> counts(newN);
+    for (long long k = 0; k < newN; ++k) {
+        counts[k] = affected[k] ? static_cast<int>(lists[listIndex[k]].size())
+                                : static_cast<int>(graph_.offsets[next[k].from + 1] - graph_.offsets[next[k].from]);
+    }
+    BondGraph rebuilt;
+    if (!rebuilt.allocate(counts, storage_)) {
+        return false;
+    }
+    parallelFor(newN, kParticleGrain, [&](long long k0, long long k1) {
+        for (long long k = k0; k < k1; ++k) {
+            long long c = rebuilt.offsets[k];
+            if (affected[k]) {
+                for (const std::pair<int, uint8_t>& bond : lists[listIndex[k]]) {
+                    rebuilt.neighbor[c] = bond.first;
+                    rebuilt.broken[c] = bond.second;
+                    c++;
+                }
+                continue;
+            }
+            long long p = next[k].from;
+            for (long long b = graph_.offsets[p]; b < graph_.offsets[p + 1]; ++b) {
+                rebuilt.neighbor[c] = static_cast<int>(oldToNew[graph_.neighbor[b]]);
+                rebuilt.broken[c] = graph_.broken[b];
+                c++;
+            }
+        }
+    });
+
+    std::vector<int> quiet(newN, 0);
+    cell_.resize(newN);
+    parent_.resize(newN);
+    mass_.resize(newN);
+    long long fineParticles = 0;
+    for (long long k = 0; k < newN; ++k) {
+        if (next[k].origin == Origin::Kept) {
+            quiet[k] = quiet_[next[k].from];
+        }
+        cell_[k] = next[k].cell;
+        parent_[k] = next[k].parent;
+        bool fine = (next[k].cell % W) % 2 != 0;
+        mass_[k] = fine ? 0.25 : 1.0;
+        fineParticles += fine ? 1 : 0;
+    }
+    quiet_.swap(quiet);
+    refinedParents_ = fineParticles / 4;
+    rebuilt.setGridIds(cell_);
+    graph_ = std::move(rebuilt);
+    return true;
+}
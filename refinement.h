@@ -0,0 +1,93 @@
+#pragma once
+
+#include "bond_graph.h"
+#include "lattice.h"
+
+#include <cstdint>
+#include <vector>
+
+// Adaptive refinement of implicit dynamics (dynamics_refine_stretch > 0).
+//
+// Accuracy only matters where cracks grow. A coarse particle that becomes
+// active (an intact bond stretched beyond the refinement threshold, or bonds
+// lost in the last step with its damage above refine_damage) is split into
+// four children at (+-dx/4, +-dx/4) with half the spacing, half the horizon
+// and a quarter of the volume. A family whose children all stayed quiet for
+// coarsenSteps steps (the front has passed) merges back into its parent, so
+// the particle count follows the active crack region, not the domain.
+//
+// Particles live on an index lattice with kSubdivision points per dx: coarse
+// particle (i, j) sits at (4i, 4j), its children at (4i +- 1, 4j +- 1). The
+// solver therefore keeps its offset tables. A bond reaches over the mean
+// horizon of its ends. Its micromodulus (~ 1 / horizon^3) and the particle
+// volumes give fine-fine bonds half the stiffness of coarse ones, which
+// keeps the elastic modulus the same at both resolutions.
+//
+// After a change, only particles within a horizon of a new particle search
+// for bonds, through a cell list of horizon-sized cells; all others carry
+// their bond lists over. A new bond takes the state of the coarse bond
+// between its parents, so cracks carry over between levels, and a family
+// that merges sets each coarse bond by majority of the fine bonds it
+// replaces. Bonds between coarse particles are always those of the coarse
+// graph.
+
+class AdaptiveLattice {
+public:
+    static const int kSubdivision = 4;  // index lattice points per dx
+
+    // reference is the coarse graph of the run on the Nx x Ny lattice; it
+    // receives the bond states in finish()
+    AdaptiveLattice(BondGraph& reference, int Nx, int Ny, const BondStencil& stencil, int coarsenSteps,
+                    const BondStorageOptions& storage);
+
+    // Starts from a copy of the reference graph. Prints an error and returns
+    // false on failure.
+    bool start();
+
+    BondGraph& graph() { return graph_; }
+    int width() const { return width_; }    // index lattice
+    int height() const { return height_; }
+    const std::vector<double>& mass() const { return mass_; }
+    long long refinedParents() const { return refinedParents_; }
+
+    // Stiffness factor of the bond from (I, J) by (dI, dJ) on the index lattice
+    static double bondWeight(int I, int J, int dI, int dJ);
+
+    // Refines the active coarse particles (active: per current particle) and
+    // merges quiet families. Displacements u (interleaved x, y) move to the
+    // children along the local deformation gradient; the other fields are
+    // copied to children and averaged over merged families. changed tells
+    // whether the particle set changed. Prints an error and returns false on
+    // failure.
+    bool adapt(const std::vector<uint8_t>& active, std::vector<double>& u,
+               const std::vector<std::vector<double>*>& fields, bool& changed);
+
+    // Merges every family and writes the bond states into the reference
+    // graph; u and the fields then hold the reference particles
+    bool finish(std::vector<double>& u, const std::vector<std::vector<double>*>& fields);
+
+private:
+    bool rebuild(const std::vector<uint8_t>& refine, const std::vector<uint8_t>& coarsen, std::vector<double>& u,
+                 const std::vector<std::vector<double>*>& fields);
+    void syncReference();
+    void mergeBondStates(const std::vector<uint8_t>& coarsen);
+
+    BondGraph& reference_;
+    int Nx_ = 0;
+    int Ny_ = 0;
+    int reach_ = 0;
+    int coarsenSteps_ = 0;
+    BondStorageOptions storage_;
+    int width_ = 0;
+    int height_ = 0;
+    long long maxLength2_ = 0;      // squared longest stencil bond (in dx^2)
+    int cellSize_ = 0;              // cell list edge (index lattice points)
+
+    BondGraph graph_;
+    std::vector<long long> cell_;   // per particle: index lattice id
+    std::vector<long long> parent_; // per particle: reference particle (itself when coarse)
+    std::vector<int> quiet_;        // per particle: steps since it was last active
+    std::vector<double> mass_;
+    long long refinedParents_ = 0;
+    std::vector<std::vector<double>> spare_;  // swap buffers of the carried fields
+};
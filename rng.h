@@ -0,0 +1,325 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#if defined(_MSC_VER) && defined(_M_X64)
+    #include <intrin.h>
+#endif
+
+// Random number engines for the pre-damage step.
+//
+// Every engine can be positioned on an independent stream with
+// forStream(seed, stream); the bond kernels open one stream per particle, so
+// the random decisions do not depend on thread count or traversal order.
+// Each engine also supports jump-ahead / discard for splitting one stream
+// into non-overlapping sub-sequences.
+
+enum class RngEngine {
+    Xoshiro256pp,
+    Pcg64,
+    Philox4x32,
+    SplitMix,
+};
+
+const int kRngEngineCount = 4;
+
+inline const char* rngEngineName(RngEngine engine) {
+    switch (engine) {
+    case RngEngine::Xoshiro256pp: return "xoshiro256pp";
+    case RngEngine::Pcg64: return "pcg64";
+    case RngEngine::Philox4x32: return "philox4x32";
+    case RngEngine::SplitMix: return "splitmix";
+    }
+    return "unknown";
+}
+
+inline bool parseRngEngine(const std::string& name, RngEngine& engine) {
+    for (int e = 0; e < kRngEngineCount; ++e) {
+        if (name == rngEngineName(static_cast<RngEngine>(e))) {
+            engine = static_cast<RngEngine>(e);
+            return true;
+        }
+    }
+    return false;
+}
+
+// -----------------------------
+// Uniform-to-threshold fast path
+// -----------------------------
+// A Bernoulli(p) draw compares the top 53 random bits with p * 2^53 in integer
+// arithmetic, which is equivalent to "uniform double in [0,1) < p" without
+// the int-to-double conversion per bond.
+inline uint64_t probabilityThreshold(double p) {
+    if (!(p > 0.0)) {
+        return 0;
+    }
+    if (p >= 1.0) {
+        return 1ULL << 53;
+    }
+    return static_cast<uint64_t>(p * 9007199254740992.0);  // p * 2^53
+}
+
+inline bool drawBelow(uint64_t bits, uint64_t threshold) {
+    return (bits >> 11) < threshold;
+}
+
+// Uniform double in [0, 1) from 64 random bits
+inline double toUnitDouble(uint64_t bits) {
+    return static_cast<double>(bits >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// -----------------------------
+// SplitMix64 (seeding helper and counter-based engine)
+// -----------------------------
+inline uint64_t splitMix64Mix(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// Hash of (seed, stream) used to derive independent stream keys
+inline uint64_t streamKey(uint64_t seed, uint64_t stream) {
+    return splitMix64Mix(splitMix64Mix(seed) ^ (stream * 0xD1B54A32D192ED03ULL + 0x8CB92BA72F3D8DD7ULL));
+}
+
+// Counter-based SplitMix64: output n of a stream is mix(key + n * gamma),
+// so discard() is a single multiply-add.
+struct SplitMixEngine {
+    static constexpr uint64_t kGamma = 0x9E3779B97F4A7C15ULL;
+    uint64_t x = 0;
+
+    static SplitMixEngine forStream(uint64_t seed, uint64_t stream) {
+        SplitMixEngine e;
+        e.x = streamKey(seed, stream);
+        return e;
+    }
+
+    uint64_t next() {
+        x += kGamma;
+        return splitMix64Mix(x);
+    }
+
+    void discard(uint64_t n) {
+        x += n * kGamma;
+    }
+};
+
+// -----------------------------
+// xoshiro256++ (Blackman & Vigna)
+// -----------------------------
+struct Xoshiro256pp {
+    uint64_t s[4] = { 0, 0, 0, 0 };
+
+    static uint64_t rotl(uint64_t x, int k) {
+        return (x << k) | (x >> (64 - k));
+    }
+
+    static Xoshiro256pp forStream(uint64_t seed, uint64_t stream) {
+        Xoshiro256pp e;
+        SplitMixEngine sm;
+        sm.x = streamKey(seed, stream);
+        for (uint64_t& w : e.s) {
+            w = sm.next();
+        }
+        return e;
+    }
+
+    uint64_t next() {
+        uint64_t result = rotl(s[0] + s[3], 23) + s[0];
+        uint64_t t = s[1] << 17;
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = rotl(s[3], 45);
+        return result;
+    }
+
+    // Advance by 2^128 outputs (2^128 non-overlapping sub-streams)
+    void jump() {
+        static const uint64_t kJump[] = { 0x180EC6D33CFD0ABAULL, 0xD5A61266F0C9392CULL,
+                                          0xA9582618E03FC9AAULL, 0x39ABDC4529B1661CULL };
+        applyJump(kJump);
+    }
+
+    // Advance by 2^192 outputs
+    void longJump() {
+        static const uint64_t kLongJump[] = { 0x76E15D3EFEFDCBBFULL, 0xC5004E441C522FB3ULL,
+                                              0x77710069854EE241ULL, 0x39109BB02ACBE635ULL };
+        applyJump(kLongJump);
+    }
+
+private:
+    void applyJump(const uint64_t* poly) {
+        uint64_t t[4] = { 0, 0, 0, 0 };
+        for (int w = 0; w < 4; ++w) {
+            for (int b = 0; b < 64; ++b) {
+                if (poly[w] & (1ULL << b)) {
+                    for (int k = 0; k < 4; ++k) {
+                        t[k] ^= s[k];
+                    }
+                }
+                next();
+            }
+        }
+        for (int k = 0; k < 4; ++k) {
+            s[k] = t[k];
+        }
+    }
+};
+
+// -----------------------------
+// PCG64 (XSL-RR 128/64, O'Neill)
+// -----------------------------
+struct UInt128 {
+    uint64_t hi = 0;
+    uint64_t lo = 0;
+};
+
+inline UInt128 add128(UInt128 a, UInt128 b) {
+    UInt128 r;
+    r.lo = a.lo + b.lo;
+    r.hi = a.hi + b.hi + (r.lo < a.lo ? 1 : 0);
+    return r;
+}
+
+inline UInt128 mul128(UInt128 a, UInt128 b) {
+    UInt128 r;
+#if defined(__SIZEOF_INT128__)
+    unsigned __int128 p = static_cast<unsigned __int128>(a.lo) * b.lo;
+    r.lo = static_cast<uint64_t>(p);
+    r.hi = static_cast<uint64_t>(p >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    r.lo = _umul128(a.lo, b.lo, &r.hi);
+#else
+    uint64_t a0 = a.lo & 0xFFFFFFFFULL, a1 = a.lo >> 32;
+    uint64_t b0 = b.lo & 0xFFFFFFFFULL, b1 = b.lo >> 32;
+    uint64_t p00 = a0 * b0, p01 = a0 * b1, p10 = a1 * b0, p11 = a1 * b1;
+    uint64_t mid = (p00 >> 32) + (p01 & 0xFFFFFFFFULL) + (p10 & 0xFFFFFFFFULL);
+    r.lo = (mid << 32) | (p00 & 0xFFFFFFFFULL);
+    r.hi = p11 + (p01 >> 32) + (p10 >> 32) + (mid >> 32);
+#endif
+    r.hi += a.hi * b.lo + a.lo * b.hi;
+    return r;
+}
+
+struct Pcg64 {
+    static constexpr UInt128 kMultiplier = { 0x2360ED051FC65DA4ULL, 0x4385DF649FCCF645ULL };
+    UInt128 state;
+    UInt128 inc;
+
+    static Pcg64 forStream(uint64_t seed, uint64_t stream) {
+        Pcg64 e;
+        // Stream selection through the (odd) increment, as in pcg64 set_seq
+        e.inc.hi = splitMix64Mix(stream);
+        e.inc.lo = (streamKey(seed, stream) << 1) | 1ULL;
+        e.state = UInt128{};
+        e.step();
+        e.state = add128(e.state, UInt128{ splitMix64Mix(seed ^ 0x5851F42D4C957F2DULL), seed });
+        e.step();
+        return e;
+    }
+
+    void step() {
+        state = add128(mul128(state, kMultiplier), inc);
+    }
+
+    uint64_t next() {
+        step();
+        uint64_t x = state.hi ^ state.lo;
+        int rot = static_cast<int>(state.hi >> 58);
+        return (x >> rot) | (x << ((64 - rot) & 63));
+    }
+
+    // Advance by delta outputs in O(log delta) (Brown, "Random number generation
+    // with arbitrary strides", 1994)
+    void discard(uint64_t delta) {
+        UInt128 accMult{ 0, 1 };
+        UInt128 accPlus{ 0, 0 };
+        UInt128 curMult = kMultiplier;
+        UInt128 curPlus = inc;
+        while (delta > 0) {
+            if (delta & 1) {
+                accMult = mul128(accMult, curMult);
+                accPlus = add128(mul128(accPlus, curMult), curPlus);
+            }
+            curPlus = mul128(add128(curMult, UInt128{ 0, 1 }), curPlus);
+            curMult = mul128(curMult, curMult);
+            delta >>= 1;
+        }
+        state = add128(mul128(accMult, state), accPlus);
+    }
+};
+
+// -----------------------------
+// Philox4x32-10 (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3")
+// -----------------------------
+// Counter-based: block n of a stream is Philox(key, {n, stream}); each block
+// yields two 64-bit outputs.
+struct Philox4x32 {
+    uint32_t key[2] = { 0, 0 };
+    uint64_t counter = 0;
+    uint64_t stream = 0;
+    uint64_t buffer[2] = { 0, 0 };
+    int buffered = 0;
+
+    static Philox4x32 forStream(uint64_t seed, uint64_t streamId) {
+        Philox4x32 e;
+        e.key[0] = static_cast<uint32_t>(seed);
+        e.key[1] = static_cast<uint32_t>(seed >> 32);
+        e.stream = streamId;
+        return e;
+    }
+
+    static void mulHiLo(uint32_t a, uint32_t b, uint32_t& hi, uint32_t& lo) {
+        uint64_t p = static_cast<uint64_t>(a) * b;
+        hi = static_cast<uint32_t>(p >> 32);
+        lo = static_cast<uint32_t>(p);
+    }
+
+    void generateBlock() {
+        uint32_t c[4] = { static_cast<uint32_t>(counter), static_cast<uint32_t>(counter >> 32),
+                          static_cast<uint32_t>(stream), static_cast<uint32_t>(stream >> 32) };
+        uint32_t k0 = key[0];
+        uint32_t k1 = key[1];
+        for (int round = 0; round < 10; ++round) {
+            uint32_t hi0, lo0, hi1, lo1;
+            mulHiLo(0xD2511F53U, c[0], hi0, lo0);
+            mulHiLo(0xCD9E8D57U, c[2], hi1, lo1);
+            uint32_t n0 = hi1 ^ c[1] ^ k0;
+            uint32_t n2 = hi0 ^ c[3] ^ k1;
+            c[0] = n0;
+            c[1] = lo1;
+            c[2] = n2;
+            c[3] = lo0;
+            k0 += 0x9E3779B9U;
+            k1 += 0xBB67AE85U;
+        }
+        buffer[0] = (static_cast<uint64_t>(c[1]) << 32) | c[0];
+        buffer[1] = (static_cast<uint64_t>(c[3]) << 32) | c[2];
+        counter++;
+        buffered = 2;
+    }
+
+    uint64_t next() {
+        if (buffered == 0) {
+            generateBlock();
+        }
+        return buffer[2 - buffered--];
+    }
+
+    // Skip n outputs: whole blocks are skipped by moving the counter
+    void discard(uint64_t n) {
+        while (n > 0 && buffered > 0) {
+            buffered--;
+            n--;
+        }
+        counter += n / 2;
+        if (n % 2 == 1) {
+            generateBlock();
+            buffered = 1;
+        }
+    }
+};
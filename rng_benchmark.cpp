@@ -0,0 +1,159 @@
+#include "rng_benchmark.h"
+
+#include "job_config.h"
+#include "lattice.h"
+#include "parallel.h"
+#include "porosity_models.h"
+#include "reduction.h"
+#include "rng.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+namespace {
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Single-thread raw throughput of one engine (draws per second)
+template <typename Engine>
+double rawDrawsPerSecond(long long draws) {
+    Engine rng = Engine::forStream(12345, 0);
+    uint64_t sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (long long n = 0; n < draws; ++n) {
+        sink ^= rng.next();
+    }
+    double t = secondsSince(start);
+    // Keep the loop from being optimized away
+    if (sink == 42) {
+        std::cout << "";
+    }
+    return draws / t;
+}
+
+double rawDrawsPerSecond(RngEngine engine, long long draws) {
+    switch (engine) {
+    case RngEngine::Xoshiro256pp: return rawDrawsPerSecond<Xoshiro256pp>(draws);
+    case RngEngine::Pcg64: return rawDrawsPerSecond<Pcg64>(draws);
+    case RngEngine::Philox4x32: return rawDrawsPerSecond<Philox4x32>(draws);
+    case RngEngine::SplitMix: return rawDrawsPerSecond<SplitMixEngine>(draws);
+    }
+    return 0.0;
+}
+
+struct BenchLattice {
+    int Nx;
+    int Ny;
+    BondStencil stencil;
+    long long bonds;
+};
+
+BenchLattice makeLattice(int Nx, int Ny, double m) {
+    BenchLattice l{ Nx, Ny, buildBondStencil(1.0, m), 0 };
+    l.bonds = exactIntegerSum(static_cast<long long>(Nx) * Ny, [&](long long id) {
+        return countLatticeNeighbors(l.stencil, static_cast<int>(id % Nx), static_cast<int>(id / Nx), Nx, Ny);
+    }) / 2;
+    return l;
+}
+
+// Realized bond porosity of one uniform pre-damage run
+double realizedPorosity(const BenchLattice& l, RngEngine engine, const SimulationConfig& config,
+                        unsigned long long seed, double* seconds) {
+    PreDamageSetup setup;
+    setup.Nx = l.Nx;
+    setup.Ny = l.Ny;
+    setup.dx = 1.0;
+    setup.stencil = &l.stencil;
+    setup.config = &config;
+    setup.seed = seed;
+
+    std::vector<int> N_broken(static_cast<size_t>(l.Nx) * l.Ny, 0);
+    auto start = std::chrono::steady_clock::now();
+    findPorosityModel("uniform")->kernel(engine)(setup, N_broken);
+    if (seconds != nullptr) {
+        *seconds = secondsSince(start);
+    }
+    long long broken = exactIntegerSum(static_cast<long long>(N_broken.size()),
+                                       [&](long long i) { return N_broken[i]; }) / 2;
+    return static_cast<double>(broken) / static_cast<double>(l.bonds);
+}
+
+}  // namespace
+
+int runRngBenchmark(int gridSize, int trials) {
+    const double m = 3.0;
+    const double p = 0.3;
+    gridSize = std::max(gridSize, 10);
+    trials = std::max(trials, 2);
+
+    SimulationConfig config;
+    config.phi = p;
+
+    BenchLattice big = makeLattice(gridSize, gridSize, m);
+    BenchLattice small = makeLattice(100, 100, m);
+
+    std::cout << "\n===== Random engine benchmark =====\n";
+    std::cout << "Threads: " << workerThreads()
+        << ", kernel grid: " << gridSize << " x " << gridSize << " (" << big.bonds << " bonds)"
+        << ", statistics: " << trials << " seeds on 100 x 100 (" << small.bonds << " bonds), phi = " << p << "\n\n";
+
+    // Binomial expectation for the realized porosity of one run
+    double expectedVar = p * (1.0 - p) / static_cast<double>(small.bonds);
+    // Sample variance / expected variance ~ chi2(T-1)/(T-1): std dev sqrt(2/(T-1))
+    double ratioTolerance = 4.0 * std::sqrt(2.0 / (trials - 1));
+
+    std::cout << std::left << std::setw(14) << "engine"
+        << std::right << std::setw(14) << "Mdraws/s"
+        << std::setw(14) << "Mbonds/s"
+        << std::setw(12) << "mean z"
+        << std::setw(12) << "var ratio"
+        << std::setw(8) << "check" << "\n";
+
+    bool allPassed = true;
+    for (int e = 0; e < kRngEngineCount; ++e) {
+        RngEngine engine = static_cast<RngEngine>(e);
+
+        double draws = rawDrawsPerSecond(engine, 50000000);
+
+        // Best of three kernel runs
+        double best = 1e300;
+        for (int rep = 0; rep < 3; ++rep) {
+            double t = 0.0;
+            realizedPorosity(big, engine, config, 1000 + rep, &t);
+            best = std::min(best, t);
+        }
+
+        std::vector<double> samples(trials);
+        for (int t = 0; t < trials; ++t) {
+            samples[t] = realizedPorosity(small, engine, config, static_cast<unsigned long long>(t + 1), nullptr);
+        }
+        double mean = deterministicSum(samples) / trials;
+        double var = deterministicSum(trials, [&](long long t) {
+            return (samples[t] - mean) * (samples[t] - mean);
+        }) / (trials - 1);
+        double z = (mean - p) / std::sqrt(expectedVar / trials);
+        double ratio = var / expectedVar;
+        bool passed = std::fabs(z) < 4.0 && std::fabs(ratio - 1.0) < ratioTolerance;
+        allPassed = allPassed && passed;
+
+        std::cout << std::left << std::setw(14) << rngEngineName(engine)
+            << std::right << std::fixed << std::setprecision(1)
+            << std::setw(14) << draws / 1e6
+            << std::setw(14) << big.bonds / best / 1e6
+            << std::setprecision(3)
+            << std::setw(12) << z
+            << std::setw(12) << ratio
+            << std::setw(8) << (passed ? "ok" : "FAIL") << "\n";
+        std::cout.unsetf(std::ios::floatfield);
+    }
+
+    std::cout << "\nmean z: deviation of the mean realized porosity from phi in standard errors (|z| < 4)\n";
+    std::cout << "var ratio: sample variance / binomial variance p(1-p)/B (1 +/- " << ratioTolerance << ")\n";
+    return allPassed ? 0 : 1;
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+// Random engine benchmark (Peridynamic --bench-rng [grid size] [trials]).
+//
+// For every engine it reports raw draws/second, bonds/second of the uniform
+// pre-damage kernel on a grid x grid lattice (m = 3), and compares the
+// realized porosity of `trials` independent seeds with the binomial
+// expectation (mean and variance).
+int runRngBenchmark(int gridSize, int trials);
@@ -0,0 +1,150 @@
+#include "roofline.h"
+
+#include "parallel.h"
+#include "run_summary.h"
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+
+namespace {
+
+const long long kStreamElements = 1LL << 23;  // 3 x 64 MiB, well beyond the last-level cache
+const int kStreamRepeats = 5;
+const int kFmaChains = 16;                     // independent chains hide the FMA latency
+const long long kFmaIterations = 1LL << 24;    // per worker
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+double streamTriad() {
+    std::vector<double> a(kStreamElements), b(kStreamElements), c(kStreamElements);
+    const long long grain = kStreamElements / (4LL * workerThreads()) + 1;
+    // First touch by the workers, as in STREAM
+    parallelFor(kStreamElements, grain, [&](long long i0, long long i1) {
+        for (long long i = i0; i < i1; ++i) {
+            a[i] = 0.0;
+            b[i] = 1.0;
+            c[i] = 2.0;
+        }
+    });
+
+    const double s = 3.0;
+    double best = 1e300;
+    for (int rep = 0; rep < kStreamRepeats; ++rep) {
+        auto start = std::chrono::steady_clock::now();
+        parallelFor(kStreamElements, grain, [&](long long i0, long long i1) {
+            double* __restrict pa = a.data();
+            const double* __restrict pb = b.data();
+            const double* __restrict pc = c.data();
+            for (long long i = i0; i < i1; ++i) {
+                pa[i] = pb[i] + s * pc[i];
+            }
+        });
+        best = std::min(best, secondsSince(start));
+    }
+    return 24.0 * kStreamElements / best;
+}
+
+// One worker's multiply-add chains; returns a value that depends on all of
+// them so the loop cannot be removed
+double fmaChains(long long iterations, double seed) {
+    double x[kFmaChains];
+    for (int k = 0; k < kFmaChains; ++k) {
+        x[k] = seed + k;
+    }
+    const double m = 0.999999;
+    const double c = 1e-7;
+    for (long long n = 0; n < iterations; ++n) {
+        for (int k = 0; k < kFmaChains; ++k) {
+            x[k] = x[k] * m + c;
+        }
+    }
+    double sum = 0.0;
+    for (int k = 0; k < kFmaChains; ++k) {
+        sum += x[k];
+    }
+    return sum;
+}
+
+// Written once so the chains cannot be optimized away
+volatile double fmaSink = 0.0;
+
+double peakOps() {
+    const int workers = workerThreads();
+    std::vector<double> sink(workers, 0.0);
+    double best = 1e300;
+    for (int rep = 0; rep < 3; ++rep) {
+        auto start = std::chrono::steady_clock::now();
+        parallelBlocks(workers, [&](long long w, int) {
+            sink[w] += fmaChains(kFmaIterations, 1.0 + static_cast<double>(w));
+        });
+        best = std::min(best, secondsSince(start));
+    }
+    for (double v : sink) {
+        fmaSink = fmaSink + v;
+    }
+    return 2.0 * kFmaChains * kFmaIterations * workers / best;
+}
+
+// A zero or degenerate ceiling gives nan or inf, which jsonNumber turns into null
+void writeNumber(std::ostream& out, const char* key, double value) {
+    out << "\"" << key << "\": " << jsonNumber(value) << ", ";
+}
+
+}  // namespace
+
+const MachineCeilings& measureCeilings() {
+    static MachineCeilings cached;
+    if (cached.threads != workerThreads()) {
+        cached.threads = workerThreads();
+        cached.bytesPerSecond = streamTriad();
+        cached.opsPerSecond = peakOps();
+    }
+    return cached;
+}
+
+double opsPerBondDraw(RngEngine engine) {
+    // add/xor/shift/multiply count of next() plus bounds check and compare
+    switch (engine) {
+    case RngEngine::SplitMix: return 9.0 + 4.0;
+    case RngEngine::Xoshiro256pp: return 11.0 + 4.0;
+    case RngEngine::Pcg64: return 14.0 + 4.0;       // 128-bit multiply-add, XSL-RR output
+    case RngEngine::Philox4x32: return 20.0 + 4.0;  // 10 rounds per 4 outputs
+    }
+    return 4.0;
+}
+
+void writeRooflineJson(std::ostream& out, const MachineCeilings& ceilings,
+                       const std::vector<StageWork>& stages, int indent) {
+    const std::string pad(indent, ' ');
+    out << "{\n"
+        << pad << "  \"threads\": " << ceilings.threads << ",\n"
+        << pad << "  \"stream_bytes_per_s\": " << jsonNumber(ceilings.bytesPerSecond) << ",\n"
+        << pad << "  \"peak_ops_per_s\": " << jsonNumber(ceilings.opsPerSecond) << ",\n"
+        << pad << "  \"stages\": [\n";
+    for (size_t s = 0; s < stages.size(); ++s) {
+        const StageWork& st = stages[s];
+        double t = std::max(st.seconds, 1e-12);
+        double bytesPerSecond = st.bytes / t;
+        double opsPerSecond = st.ops / t;
+        double intensity = (st.bytes > 0.0) ? st.ops / st.bytes : 0.0;
+        double attainable = std::min(ceilings.opsPerSecond, intensity * ceilings.bytesPerSecond);
+        bool memoryBound = intensity * ceilings.bytesPerSecond < ceilings.opsPerSecond;
+
+        out << pad << "    {\"stage\": \"" << st.name << "\", ";
+        writeNumber(out, "seconds", st.seconds);
+        writeNumber(out, "bytes", st.bytes);
+        writeNumber(out, "ops", st.ops);
+        writeNumber(out, "bytes_per_s", bytesPerSecond);
+        writeNumber(out, "ops_per_s", opsPerSecond);
+        writeNumber(out, "bandwidth_fraction", bytesPerSecond / ceilings.bytesPerSecond);
+        writeNumber(out, "peak_ops_fraction", opsPerSecond / ceilings.opsPerSecond);
+        writeNumber(out, "arithmetic_intensity", intensity);
+        writeNumber(out, "roofline_fraction", (attainable > 0.0) ? opsPerSecond / attainable : 0.0);
+        out << "\"bound\": \"" << (memoryBound ? "memory" : "compute") << "\"}"
+            << (s + 1 < stages.size() ? "," : "") << "\n";
+    }
+    out << pad << "  ]\n" << pad << "}";
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "rng.h"
+
+#include <ostream>
+#include <vector>
+
+// Roofline model of the pipeline stages.
+//
+// Two short micro-benchmarks measure the ceilings of this machine with the
+// current worker threads: a STREAM triad (a[i] = b[i] + s * c[i]) for memory
+// bandwidth and independent multiply-add chains for peak floating-point
+// throughput. Each stage reports its compulsory memory traffic and operation
+// count; with its run time this gives achieved bytes/s and ops/s, the
+// arithmetic intensity (ops per byte) and the fraction of the roofline
+// min(peak ops/s, intensity * bandwidth) it reaches.
+
+struct MachineCeilings {
+    int threads = 0;
+    double bytesPerSecond = 0.0;  // STREAM triad, counting 24 bytes per element
+    double opsPerSecond = 0.0;    // multiply-add chains, 2 ops each
+};
+
+// Measure (or reuse the measurement for the current thread count)
+const MachineCeilings& measureCeilings();
+
+// Work and time of one pipeline stage
+struct StageWork {
+    const char* name;
+    double seconds = 0.0;
+    double bytes = 0.0;  // compulsory memory (and file) traffic
+    double ops = 0.0;    // arithmetic / integer operations (estimated per item)
+};
+
+// Approximate integer operations of one draw of the engine, including the
+// threshold comparison of the pre-damage kernel
+double opsPerBondDraw(RngEngine engine);
+
+// JSON object with the ceilings and one entry per stage; indent is the
+// indentation of the object's own lines
+void writeRooflineJson(std::ostream& out, const MachineCeilings& ceilings,
+                       const std::vector<StageWork>& stages, int indent);
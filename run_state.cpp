@@ -0,0 +1,112 @@
+#include "run_state.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace {
+
+const char* const kStateMagic = "PERIDYNAMIC-STATE 1";
+
+}  // namespace
+
+Deadline::Deadline(double seconds) {
+    if (seconds > 0.0) {
+        enabled_ = true;
+        end_ = std::chrono::steady_clock::now() +
+               std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                   std::chrono::duration<double>(seconds));
+    }
+}
+
+std::string runFingerprint(const SimulationConfig& config) {
+    std::ostringstream s;
+    s.precision(17);
+    s << "Lx=" << config.Lx << " Ly=" << config.Ly << " dx=" << config.dx << " m=" << config.m
+      << " model=" << config.porosityModel << " phi=" << config.phi << " phi_end=" << config.phiEnd
+      << " anisotropy=" << config.anisotropy << " anisotropy_angle=" << config.anisotropyAngle
+      << " rng=" << rngEngineName(config.rng);
+    if (config.porosityModel == "grains") {
+        s << " grains=" << config.grainSize << "," << config.grainBoundaryFactor << "," << config.grainSeed;
+    }
+    if (config.latticeJitter > 0.0) {
+        s << " jitter=" << config.latticeJitter << "," << config.latticeJitterSeed;
+    }
+    if (config.coupling.enabled) {
+        s << " coupling=" << config.coupling.x0 << "," << config.coupling.y0 << "," << config.coupling.x1
+          << "," << config.coupling.y1 << "," << config.coupling.blend;
+    }
+    return s.str();
+}
+
+std::string runStateName(const std::string& outputName) {
+    std::filesystem::path p(outputName);
+    p.replace_extension(".state");
+    return p.string();
+}
+
+bool saveRunState(const std::string& path, const RunState& state) {
+    // Written to a temporary name first so a kill during the write never
+    // leaves a truncated state behind
+    const std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary);
+        out << kStateMagic << "\n"
+            << state.fingerprint << "\n"
+            << state.seed << " " << state.completeRows << " " << state.N_broken.size() << "\n";
+        std::vector<uint8_t> bytes(state.N_broken.size() * 4);
+        for (size_t i = 0; i < state.N_broken.size(); ++i) {
+            uint32_t v = static_cast<uint32_t>(state.N_broken[i]);
+            for (int b = 0; b < 4; ++b) {
+                bytes[4 * i + b] = static_cast<uint8_t>(v >> (8 * b));  // little-endian
+            }
+        }
+        out.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+        if (!out) {
+            std::cerr << "Error: could not write run state " << tmp << "\n";
+            return false;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp, path, ec);
+    if (ec) {
+        std::cerr << "Error: could not replace run state " << path << ": " << ec.message() << "\n";
+        return false;
+    }
+    return true;
+}
+
+bool loadRunState(const std::string& path, RunState& state) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        std::cerr << "Error: could not open run state " << path << "\n";
+        return false;
+    }
+    std::string magic;
+    std::getline(in, magic);
+    std::getline(in, state.fingerprint);
+    size_t count = 0;
+    in >> state.seed >> state.completeRows >> count;
+    in.get();  // newline before the counts
+    if (!in || magic != kStateMagic || state.completeRows < 0) {
+        std::cerr << "Error: " << path << " is not a run state file\n";
+        return false;
+    }
+    std::vector<uint8_t> bytes(count * 4);
+    in.read(reinterpret_cast<char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+    if (static_cast<size_t>(in.gcount()) != bytes.size()) {
+        std::cerr << "Error: run state " << path << " is truncated\n";
+        return false;
+    }
+    state.N_broken.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t v = 0;
+        for (int b = 0; b < 4; ++b) {
+            v |= static_cast<uint32_t>(bytes[4 * i + b]) << (8 * b);
+        }
+        state.N_broken[i] = static_cast<int>(v);
+    }
+    return true;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "job_config.h"
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+// Time-budgeted runs (time_budget = seconds in the job file).
+//
+// The pre-damage kernel runs in bands of rows and the deadline is checked
+// between bands. Bonds only point forward (dj >= 0 in the half stencil), so
+// once rows [0, R) have been processed every particle in them has all of its
+// bonds decided: these rows are final and are written as the (partial)
+// output. The Nb counts of rows [0, R + reach) and the seed are saved in a
+// state file next to the output; a later run with resume = 1 continues at
+// row R and produces the same result as an uninterrupted run.
+
+class Deadline {
+public:
+    Deadline() = default;
+    // Expires seconds from now; seconds <= 0 never expires
+    explicit Deadline(double seconds);
+
+    bool expired() const {
+        return enabled_ && std::chrono::steady_clock::now() >= end_;
+    }
+
+private:
+    bool enabled_ = false;
+    std::chrono::steady_clock::time_point end_;
+};
+
+struct RunState {
+    std::string fingerprint;        // parameters that determine the result
+    unsigned long long seed = 0;
+    int completeRows = 0;
+    std::vector<int> N_broken;      // rows [0, completeRows + reach), row-major
+};
+
+// Parameters that must match between the interrupted and the resumed run
+std::string runFingerprint(const SimulationConfig& config);
+
+// State file matching an output name ("a/b.vtk" -> "a/b.state")
+std::string runStateName(const std::string& outputName);
+
+// Both print an error and return false on failure
+bool saveRunState(const std::string& path, const RunState& state);
+bool loadRunState(const std::string& path, RunState& state);
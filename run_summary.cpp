@@ -0,0 +1,76 @@
+#include "run_summary.h"
+
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace {
+
+void writeObject(std::ostream& out, const std::vector<std::pair<std::string, std::string>>& members) {
+    out << "{";
+    for (size_t k = 0; k < members.size(); ++k) {
+        out << (k ? "," : "") << "\n    " << jsonString(members[k].first) << ": " << members[k].second;
+    }
+    out << "\n  }";
+}
+
+}  // namespace
+
+std::string jsonString(const std::string& s) {
+    std::string quoted = "\"";
+    for (char ch : s) {
+        if (ch == '"' || ch == '\\') {
+            quoted += '\\';
+            quoted += ch;
+        }
+        else if (static_cast<unsigned char>(ch) < 0x20) {
+            quoted += ' ';
+        }
+        else {
+            quoted += ch;
+        }
+    }
+    return quoted + "\"";
+}
+
+std::string jsonNumber(double v) {
+    if (!std::isfinite(v)) {
+        return "null";
+    }
+    std::ostringstream s;
+    s.precision(17);
+    s << v;
+    return s.str();
+}
+
+bool writeRunSummary(const std::string& path, const RunSummary& summary) {
+    std::ofstream out(path);
+    if (!out) {
+        std::cerr << "Error: could not write run summary " << path << "\n";
+        return false;
+    }
+    out.precision(6);
+    out << "{\n  \"parameters\": ";
+    writeObject(out, summary.parameters);
+    out << ",\n  \"results\": ";
+    writeObject(out, summary.results);
+    out << ",\n  \"stage_seconds\": {";
+    for (size_t s = 0; s < summary.stages.size(); ++s) {
+        out << (s ? ", " : "") << jsonString(summary.stages[s].name) << ": " << summary.stages[s].seconds;
+    }
+    out << "}";
+    if (summary.hasRoofline) {
+        out << ",\n  \"roofline\": ";
+        writeRooflineJson(out, summary.ceilings, summary.stages, 2);
+    }
+    out << "\n}\n";
+    return static_cast<bool>(out);
+}
+
+std::string runSummaryName(const std::string& outputName) {
+    std::filesystem::path p(outputName);
+    p.replace_extension(".json");
+    return p.string();
+}
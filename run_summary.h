@@ -0,0 +1,28 @@
+#pragma once
+
+#include "roofline.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+// Machine-readable summary of one run (summary = 1 in the job file), written
+// as JSON next to the output: parameters, results, stage timings and, with
+// roofline = 1, the roofline report of every stage.
+
+struct RunSummary {
+    // Values are stored JSON-encoded (see jsonString / jsonNumber)
+    std::vector<std::pair<std::string, std::string>> parameters;
+    std::vector<std::pair<std::string, std::string>> results;
+    std::vector<StageWork> stages;
+    bool hasRoofline = false;
+    MachineCeilings ceilings;
+};
+
+std::string jsonString(const std::string& s);
+std::string jsonNumber(double v);
+
+bool writeRunSummary(const std::string& path, const RunSummary& summary);
+
+// Summary name matching an output name ("a/b.vtk" -> "a/b.json")
+std::string runSummaryName(const std::string& outputName);
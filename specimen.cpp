@@ -0,0 +1,110 @@
+#include "specimen.h"
+
+#include "parallel.h"
+#include "reduction.h"
+
+#include <algorithm>
+#include <sstream>
+
+namespace {
+
+// Twice the signed area of the triangle (a, b, c)
+double orientation(double ax, double ay, double bx, double by, double cx, double cy) {
+    return (bx - ax) * (cy - ay) - (by - ay) * (cx - ax);
+}
+
+}  // namespace
+
+bool SpecimenShape::cuts(double xa, double ya, double xb, double yb) const {
+    for (const Hole& h : holes) {
+        double ax = xa - h.cx, ay = ya - h.cy;
+        double bx = xb - h.cx, by = yb - h.cy;
+        if (ax * ax + ay * ay < h.r * h.r || bx * bx + by * by < h.r * h.r) {
+            return true;
+        }
+    }
+    // The ends lie on opposite sides of the notch line (a point on the line
+    // counts as below it) and the notch ends on opposite sides of the bond
+    for (const Notch& n : notches) {
+        double da = orientation(n.x0, n.y0, n.x1, n.y1, xa, ya);
+        double db = orientation(n.x0, n.y0, n.x1, n.y1, xb, yb);
+        if ((da > 0.0) == (db > 0.0)) {
+            continue;
+        }
+        double d0 = orientation(xa, ya, xb, yb, n.x0, n.y0);
+        double d1 = orientation(xa, ya, xb, yb, n.x1, n.y1);
+        if (d0 * d1 <= 0.0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool parseHole(const std::string& value, SpecimenShape::Hole& hole) {
+    std::istringstream in(value);
+    return (in >> hole.cx >> hole.cy >> hole.r) && (in >> std::ws).eof() && hole.r > 0.0;
+}
+
+bool parseNotch(const std::string& value, SpecimenShape::Notch& notch) {
+    std::istringstream in(value);
+    return (in >> notch.x0 >> notch.y0 >> notch.x1 >> notch.y1) && (in >> std::ws).eof() &&
+           (notch.x0 != notch.x1 || notch.y0 != notch.y1);
+}
+
+bool cutSpecimen(const SpecimenShape& shape, int Nx, double dx, const BondStorageOptions& options, BondGraph& graph,
+                 std::vector<int>& N_total, std::vector<int>& N_broken, long long& cutBonds) {
+    const long long N = graph.particles();
+    auto cut = [&](long long id, long long nid) {
+        long long a = std::min(id, nid);
+        long long b = std::max(id, nid);
+        return shape.cuts((a % Nx) * dx, (a / Nx) * dx, (b % Nx) * dx, (b / Nx) * dx);
+    };
+
+    // Bonds left per particle; N(i) and Nb(i) lose the cut ones
+    std::vector<int> bondCounts(N, 0);
+    graph.forEachBlock([&](long long first, long long last) {
+        for (long long id = first; id < last; ++id) {
+            int kept = 0;
+            int brokenCut = 0;
+            graph.forEachBond(id, [&](long long b, long long nid) {
+                if (cut(id, nid)) {
+                    brokenCut += graph.broken[b];
+                }
+                else {
+                    kept++;
+                }
+            });
+            bondCounts[id] = kept;
+            N_broken[id] -= brokenCut;
+        }
+    });
+    cutBonds = exactIntegerSum(N, [&](long long id) { return N_total[id] - bondCounts[id]; }) / 2;
+    parallelFor(N, 4096, [&](long long i0, long long i1) {
+        std::copy(bondCounts.begin() + i0, bondCounts.begin() + i1, N_total.begin() + i0);
+    });
+    if (cutBonds == 0) {
+        return true;
+    }
+
+    BondGraph shaped;
+    if (!shaped.allocate(bondCounts, options)) {
+        return false;
+    }
+    shaped.forEachBlock([&](long long first, long long last) {
+        long long c = shaped.offsets[first];
+        for (long long id = first; id < last; ++id) {
+            graph.forEachBond(id, [&](long long b, long long nid) {
+                if (!cut(id, nid)) {
+                    shaped.neighbor[c] = static_cast<int>(nid);
+                    shaped.broken[c] = graph.broken[b];
+                    c++;
+                }
+            });
+        }
+    });
+    if (!shaped.compress(options)) {
+        return false;
+    }
+    graph = std::move(shaped);
+    return true;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "bond_graph.h"
+
+#include <string>
+#include <vector>
+
+// Specimen shape cut out of the rectangular lattice
+// (hole = cx cy r, notch = x0 y0 x1 y1 in the job file, repeatable).
+//
+// A hole removes every particle whose grid point lies inside the circle. A
+// notch is a straight cut: bonds that cross the segment do not exist. Both
+// are applied to the stored bond graph right after it is built. The cut
+// bonds are taken out of the graph and out of N(i), so they count neither as
+// bonds nor as broken ones, and particles inside a hole are left without
+// bonds (compact = 1 drops them). Coordinates are physical units on the
+// regular grid points (i dx, j dx).
+
+struct SpecimenShape {
+    struct Hole {
+        double cx = 0.0, cy = 0.0, r = 0.0;
+    };
+    struct Notch {
+        double x0 = 0.0, y0 = 0.0, x1 = 0.0, y1 = 0.0;
+    };
+    std::vector<Hole> holes;
+    std::vector<Notch> notches;
+
+    bool empty() const { return holes.empty() && notches.empty(); }
+
+    // Whether the bond between (xa, ya) and (xb, yb) is cut. Callers pass
+    // the end points in a fixed order (lower particle id first), so both
+    // directions of a bond agree.
+    bool cuts(double xa, double ya, double xb, double yb) const;
+};
+
+// Parse "cx cy r" and "x0 y0 x1 y1"; false on malformed input
+bool parseHole(const std::string& value, SpecimenShape::Hole& hole);
+bool parseNotch(const std::string& value, SpecimenShape::Notch& notch);
+
+// Removes the bonds the shape cuts from graph (a plain Nx-wide lattice
+// graph) and from N_total and N_broken. Returns the number of bonds cut
+// through cutBonds (each counted once). Prints an error and returns false
+// on failure.
+bool cutSpecimen(const SpecimenShape& shape, int Nx, double dx, const BondStorageOptions& options, BondGraph& graph,
+                 std::vector<int>& N_total, std::vector<int>& N_broken, long long& cutBonds);
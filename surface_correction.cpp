@@ -0,0 +1,106 @@
+#include "surface_correction.h"
+
+#include "parallel.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Strain energy density terms of one bond under unit uniaxial strain in x
+// and in y: (n . e)^2 stretch squared times length, i.e. di^4 / L^3
+void bondEnergy(int di, int dj, double weight, double& wx, double& wy) {
+    double L2 = static_cast<double>(di * di + dj * dj);
+    double L3 = L2 * std::sqrt(L2);
+    wx += weight * static_cast<double>(di) * di * di * di / L3;
+    wy += weight * static_cast<double>(dj) * dj * dj * dj / L3;
+}
+
+// Bulk over actual energy; particles without a bond in a direction keep 1
+double ratio(double bulk, double actual) {
+    return actual > 0.0 ? bulk / actual : 1.0;
+}
+
+}  // namespace
+
+SurfaceCorrection::SurfaceCorrection(int Nx, int Ny, const BondStencil& stencil, const BondWeight& bondWeight)
+    : Nx_(Nx), Ny_(Ny), reach_(stencil.reach) {
+    double bulkX = 0.0;
+    double bulkY = 0.0;
+    for (const StencilOffset& o : stencil.full) {
+        bondEnergy(o.di, o.dj, 1.0, bulkX, bulkY);
+    }
+
+    // Plain lattice at least two horizons wide: a particle is cut off on one
+    // side at most, and the cut only depends on its distance to that edge
+    const int R = reach_;
+    if (!bondWeight && Nx >= 2 * R + 1 && Ny >= 2 * R + 1) {
+        table_.assign(2 * static_cast<size_t>(R + 1) * (R + 1), 1.0);
+        for (int ey = 0; ey <= R; ++ey) {
+            for (int ex = 0; ex <= R; ++ex) {
+                double wx = 0.0;
+                double wy = 0.0;
+                for (const StencilOffset& o : stencil.full) {
+                    if (o.di >= -ex && o.dj >= -ey) {
+                        bondEnergy(o.di, o.dj, 1.0, wx, wy);
+                    }
+                }
+                size_t k = 2 * (static_cast<size_t>(ey) * (R + 1) + ex);
+                table_[k] = ratio(bulkX, wx);
+                table_[k + 1] = ratio(bulkY, wy);
+            }
+        }
+        return;
+    }
+
+    // General case: one loading analysis per particle over its stencil
+    perParticle_.assign(2 * static_cast<size_t>(Nx) * Ny, 1.0f);
+    parallelFor(Ny, 1, [&](long long j0, long long j1) {
+        for (int j = static_cast<int>(j0); j < j1; ++j) {
+            for (int i = 0; i < Nx; ++i) {
+                double wx = 0.0;
+                double wy = 0.0;
+                for (const StencilOffset& o : stencil.full) {
+                    int ni = i + o.di;
+                    int nj = j + o.dj;
+                    if (ni < 0 || ni >= Nx || nj < 0 || nj >= Ny) {
+                        continue;
+                    }
+                    double weight = bondWeight ? bondWeight(i, j, o.di, o.dj) : 1.0;
+                    if (weight > 0.0) {
+                        bondEnergy(o.di, o.dj, weight, wx, wy);
+                    }
+                }
+                size_t k = 2 * (static_cast<size_t>(j) * Nx + i);
+                perParticle_[k] = static_cast<float>(ratio(bulkX, wx));
+                perParticle_[k + 1] = static_cast<float>(ratio(bulkY, wy));
+            }
+        }
+    });
+}
+
+void SurfaceCorrection::factors(int i, int j, double& gx, double& gy) const {
+    if (tabulated()) {
+        int ex = std::min({ i, Nx_ - 1 - i, reach_ });
+        int ey = std::min({ j, Ny_ - 1 - j, reach_ });
+        size_t k = 2 * (static_cast<size_t>(ey) * (reach_ + 1) + ex);
+        gx = table_[k];
+        gy = table_[k + 1];
+        return;
+    }
+    size_t k = 2 * (static_cast<size_t>(j) * Nx_ + i);
+    gx = perParticle_[k];
+    gy = perParticle_[k + 1];
+}
+
+double SurfaceCorrection::bond(int i, int j, int di, int dj) const {
+    double gx0, gy0, gx1, gy1;
+    factors(i, j, gx0, gy0);
+    factors(i + di, j + dj, gx1, gy1);
+    double gx = 0.5 * (gx0 + gx1);
+    double gy = 0.5 * (gy0 + gy1);
+    double L2 = static_cast<double>(di * di + dj * dj);
+    double nx = di / gx;
+    double ny = dj / gy;
+    return std::sqrt(L2 / (nx * nx + ny * ny));
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "lattice.h"
+
+#include <functional>
+#include <vector>
+
+// Surface correction of the bond stiffness (surface_correction = 1).
+//
+// Near a free edge the horizon of a particle is cut off, so it is softer than
+// a bulk particle under the same strain. The usual remedy (Madenci & Oterkus)
+// compares the strain energy density W of every particle under uniaxial
+// strain in x and in y with that of the bulk, g = W_bulk / W(i), which takes
+// two extra loading analyses over all bonds. A bond between i and j is then
+// scaled by
+//
+//     G = ((n_x / g_x)^2 + (n_y / g_y)^2)^(-1/2),   g = (g(i) + g(j)) / 2
+//
+// with n its unit direction. On the lattice W only depends on how far the
+// particle is from the nearest edge in x and in y (up to the horizon), so
+// the factors come from a (reach + 1)^2 table. Geometries with masked bonds
+// (the far field of coupled runs) and specimens narrower than two horizons
+// fall back to one energy sum per particle over its stencil.
+
+class SurfaceCorrection {
+public:
+    // Stiffness factor of the bond from (i, j) to (i + di, j + dj); 0 where
+    // the bond does not exist
+    using BondWeight = std::function<double(int i, int j, int di, int dj)>;
+
+    // bondWeight may be empty (every stencil bond inside the grid, weight 1)
+    SurfaceCorrection(int Nx, int Ny, const BondStencil& stencil, const BondWeight& bondWeight);
+
+    bool tabulated() const { return perParticle_.empty(); }
+
+    // Factors g_x, g_y of particle (i, j)
+    void factors(int i, int j, double& gx, double& gy) const;
+
+    // Factor G of the bond from (i, j) to (i + di, j + dj)
+    double bond(int i, int j, int di, int dj) const;
+
+private:
+    int Nx_ = 0;
+    int Ny_ = 0;
+    int reach_ = 0;
+    std::vector<double> table_;       // (g_x, g_y) by distance to the nearest x and y edge
+    std::vector<float> perParticle_;  // fallback: (g_x, g_y) of every particle
+};
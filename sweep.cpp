@@ -0,0 +1,416 @@
+#include "sweep.h"
+
+#include "job_config.h"
+#include "kernel_tuning.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #ifndef WIN32_LEAN_AND_MEAN
+        #define WIN32_LEAN_AND_MEAN
+    #endif
+    #include <windows.h>
+#else
+    #include <cerrno>
+    #include <fcntl.h>
+    #include <spawn.h>
+    #include <sys/file.h>
+    #include <sys/wait.h>
+    #include <unistd.h>
+
+extern char** environ;
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const char* const kJournal = "journal.txt";
+
+unsigned long currentPid() {
+#ifdef _WIN32
+    return GetCurrentProcessId();
+#else
+    return static_cast<unsigned long>(getpid());
+#endif
+}
+
+// Lock file held by a live worker in its claim directory. The operating
+// system drops the lock when the process dies, however it dies, so a lock
+// that can be taken marks the claims of a dead worker.
+class WorkerLock {
+public:
+    WorkerLock() = default;
+    WorkerLock(const WorkerLock&) = delete;
+    WorkerLock& operator=(const WorkerLock&) = delete;
+    ~WorkerLock() { release(); }
+
+    // Returns false if another process holds the lock (or locking fails)
+    bool acquire(const fs::path& path) {
+#ifdef _WIN32
+        // Exclusive share mode: a second open fails while the handle lives
+        // (sharing only delete, so the holder can rename the file)
+        HANDLE file = CreateFileA(path.string().c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_DELETE, nullptr,
+                                  OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+        handle_ = reinterpret_cast<long long>(file);
+#else
+        int fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0) {
+            return false;
+        }
+        if (::flock(fd, LOCK_EX | LOCK_NB) != 0) {
+            ::close(fd);
+            return false;
+        }
+        handle_ = fd;
+#endif
+        return true;
+    }
+
+    void release() {
+        if (handle_ == -1) {
+            return;
+        }
+#ifdef _WIN32
+        CloseHandle(reinterpret_cast<HANDLE>(handle_));
+#else
+        ::close(static_cast<int>(handle_));
+#endif
+        handle_ = -1;
+    }
+
+private:
+    long long handle_ = -1;  // HANDLE on Windows, file descriptor elsewhere
+};
+
+const char* const kWorkerLock = "worker.lock";
+
+// Appends one line to the journal while holding an exclusive lock on it, so
+// lines from concurrent workers (also on other nodes) never interleave
+bool appendJournal(const fs::path& path, const std::string& line) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.string().c_str(), FILE_APPEND_DATA, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                              nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    OVERLAPPED whole = {};
+    bool ok = LockFileEx(file, LOCKFILE_EXCLUSIVE_LOCK, 0, MAXDWORD, MAXDWORD, &whole) != 0;
+    DWORD written = 0;
+    ok = ok && WriteFile(file, line.data(), static_cast<DWORD>(line.size()), &written, nullptr) &&
+         written == line.size();
+    UnlockFileEx(file, 0, MAXDWORD, MAXDWORD, &whole);
+    CloseHandle(file);
+    return ok;
+#else
+    int fd = ::open(path.c_str(), O_WRONLY | O_APPEND | O_CREAT, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = ::flock(fd, LOCK_EX) == 0;
+    ok = ok && ::write(fd, line.data(), line.size()) == static_cast<ssize_t>(line.size());
+    ::flock(fd, LOCK_UN);
+    ::close(fd);
+    return ok;
+#endif
+}
+
+// Job names the journal records as done
+std::set<std::string> completedJobs(const fs::path& journal) {
+    std::set<std::string> done;
+    std::ifstream in(journal);
+    std::string line;
+    while (std::getline(in, line)) {
+        // <time> <worker> <job> <status> <seconds>
+        std::istringstream fields(line);
+        std::string time, worker, job, status;
+        if (fields >> time >> worker >> job >> status && status == "done") {
+            done.insert(job);
+        }
+    }
+    return done;
+}
+
+std::string timestamp() {
+    std::time_t now = std::time(nullptr);
+    std::tm utc{};
+#ifdef _WIN32
+    gmtime_s(&utc, &now);
+#else
+    gmtime_r(&now, &utc);
+#endif
+    char text[32];
+    std::strftime(text, sizeof(text), "%Y-%m-%dT%H:%M:%SZ", &utc);
+    return text;
+}
+
+std::vector<fs::path> queuedJobs(const fs::path& queue) {
+    std::vector<fs::path> jobs;
+    std::error_code ec;
+    for (const fs::directory_entry& entry : fs::directory_iterator(queue, ec)) {
+        if (entry.is_regular_file(ec) && entry.path().extension() == ".job") {
+            jobs.push_back(entry.path());
+        }
+    }
+    std::sort(jobs.begin(), jobs.end());
+    return jobs;
+}
+
+// Moves the first job that no other worker claims first into claimDir
+bool claimNextJob(const fs::path& queue, const fs::path& claimDir, fs::path& claimed) {
+    for (const fs::path& job : queuedJobs(queue)) {
+        fs::path target = claimDir / job.filename();
+        std::error_code ec;
+        fs::rename(job, target, ec);
+        if (!ec) {
+            claimed = target;
+            return true;
+        }
+        // Lost the race for this one; try the next
+    }
+    return false;
+}
+
+// Returns the claims of dead workers (any host sharing the queue) to the
+// queue
+void recoverStaleClaims(const fs::path& queue, const fs::path& ownClaimDir) {
+    std::error_code ec;
+    for (const fs::directory_entry& worker : fs::directory_iterator(queue / "running", ec)) {
+        // No lock file yet: a worker still setting up
+        if (worker.path() == ownClaimDir || !fs::exists(worker.path() / kWorkerLock, ec)) {
+            continue;
+        }
+        WorkerLock lock;
+        if (!lock.acquire(worker.path() / kWorkerLock)) {
+            continue;  // still running
+        }
+        std::error_code ignored;
+        for (const fs::path& job : queuedJobs(worker.path())) {
+            fs::rename(job, queue / job.filename(), ignored);
+            std::cout << "Requeued " << job.filename().string() << " from dead worker "
+                      << worker.path().filename().string() << "\n";
+        }
+        lock.release();
+        fs::remove_all(worker.path(), ignored);
+    }
+}
+
+// Sends std::cout and std::cerr to a log file while alive
+class ConsoleRedirect {
+public:
+    explicit ConsoleRedirect(const fs::path& file)
+        : log_(file, std::ios::app), out_(std::cout.rdbuf()), err_(std::cerr.rdbuf()) {
+        if (log_) {
+            std::cout.rdbuf(log_.rdbuf());
+            std::cerr.rdbuf(log_.rdbuf());
+        }
+    }
+    ~ConsoleRedirect() {
+        std::cout.flush();
+        std::cout.rdbuf(out_);
+        std::cerr.rdbuf(err_);
+    }
+
+private:
+    std::ofstream log_;
+    std::streambuf* out_;
+    std::streambuf* err_;
+};
+
+// Makes a job that stopped at its time budget continue on its next run
+bool markForResume(const fs::path& job) {
+    SimulationConfig config;
+    if (loadJobConfig(job.string(), config) && config.resume) {
+        return true;
+    }
+    std::ofstream out(job, std::ios::app);
+    out << "\nresume = 1  # added by the sweep runner after a time-budget stop\n";
+    return static_cast<bool>(out);
+}
+
+// Starts `self --sweep-worker <queue> <threads>`; returns false on failure
+bool spawnWorker(const char* self, const std::string& queue, int threads, std::vector<long long>& handles) {
+#ifdef _WIN32
+    (void)self;
+    char exe[MAX_PATH];
+    DWORD length = GetModuleFileNameA(nullptr, exe, MAX_PATH);
+    if (length == 0 || length == MAX_PATH) {
+        return false;
+    }
+    std::string command = "\"" + std::string(exe) + "\" --sweep-worker \"" + queue + "\" " + std::to_string(threads);
+    STARTUPINFOA startup = {};
+    startup.cb = sizeof(startup);
+    PROCESS_INFORMATION info = {};
+    if (!CreateProcessA(exe, command.data(), nullptr, nullptr, FALSE, 0, nullptr, nullptr, &startup, &info)) {
+        return false;
+    }
+    CloseHandle(info.hThread);
+    handles.push_back(reinterpret_cast<long long>(info.hProcess));
+    return true;
+#else
+    // Prefer the running binary itself over a PATH lookup of argv[0]
+    std::string exe = fs::exists("/proc/self/exe") ? fs::read_symlink("/proc/self/exe").string() : self;
+    std::string threadArg = std::to_string(threads);
+    std::vector<char*> args = { exe.data(), const_cast<char*>("--sweep-worker"),
+                                const_cast<char*>(queue.c_str()), threadArg.data(), nullptr };
+    pid_t pid = 0;
+    int rc = (exe.find('/') != std::string::npos)
+        ? posix_spawn(&pid, exe.c_str(), nullptr, nullptr, args.data(), environ)
+        : posix_spawnp(&pid, exe.c_str(), nullptr, nullptr, args.data(), environ);
+    if (rc != 0) {
+        return false;
+    }
+    handles.push_back(static_cast<long long>(pid));
+    return true;
+#endif
+}
+
+// Waits for a worker started by spawnWorker and returns its exit code
+int waitWorker(long long handle) {
+#ifdef _WIN32
+    HANDLE process = reinterpret_cast<HANDLE>(handle);
+    WaitForSingleObject(process, INFINITE);
+    DWORD code = 1;
+    GetExitCodeProcess(process, &code);
+    CloseHandle(process);
+    return static_cast<int>(code);
+#else
+    int status = 0;
+    if (waitpid(static_cast<pid_t>(handle), &status, 0) < 0 || !WIFEXITED(status)) {
+        return 1;
+    }
+    return WEXITSTATUS(status);
+#endif
+}
+
+size_t countJobs(const fs::path& dir) {
+    return queuedJobs(dir).size();
+}
+
+}  // namespace
+
+int runSweep(const std::string& queueDir, int workers, const char* self) {
+    std::error_code ec;
+    if (!fs::is_directory(queueDir, ec)) {
+        std::cerr << "Error: sweep queue " << queueDir << " is not a directory\n";
+        return 1;
+    }
+    workers = std::max(1, workers);
+    // Share the cores between the workers unless a job sets threads itself
+    unsigned hardware = std::max(1u, std::thread::hardware_concurrency());
+    int threads = std::max(1, static_cast<int>(hardware) / workers);
+
+    std::cout << "Sweep over " << queueDir << ": " << countJobs(queueDir) << " queued job(s), "
+              << workers << " worker(s) x " << threads << " thread(s)" << std::endl;
+    std::vector<long long> handles;
+    for (int w = 0; w < workers; ++w) {
+        if (!spawnWorker(self, queueDir, threads, handles)) {
+            std::cerr << "Error: could not start sweep worker " << w << "\n";
+            break;
+        }
+    }
+    int failedWorkers = (handles.size() < static_cast<size_t>(workers)) ? 1 : 0;
+    for (long long handle : handles) {
+        if (waitWorker(handle) != 0) {
+            failedWorkers++;
+        }
+    }
+
+    const fs::path queue(queueDir);
+    size_t failed = countJobs(queue / "failed");
+    std::cout << "Sweep finished: " << countJobs(queue / "done") << " done, " << failed << " failed, "
+              << countJobs(queue) << " still queued (journal: " << (queue / kJournal).string() << ")\n";
+    return (failedWorkers > 0 || failed > 0) ? 1 : 0;
+}
+
+int runSweepWorker(const std::string& queueDir, const SweepJobRunner& runJob) {
+    const fs::path queue(queueDir);
+    const std::string worker = hostName() + "-" + std::to_string(currentPid());
+    const fs::path claimDir = queue / "running" / worker;
+    std::error_code ec;
+    for (const char* dir : { "done", "failed", "logs" }) {
+        fs::create_directories(queue / dir, ec);
+    }
+    // The lock file is taken under another name and renamed into place, so
+    // other workers never find it unlocked and take this claim for dead
+    fs::create_directories(claimDir, ec);
+    const fs::path pendingLock = claimDir / (std::string(kWorkerLock) + ".new");
+    WorkerLock lock;
+    bool locked = !ec && lock.acquire(pendingLock);
+    if (locked) {
+        fs::rename(pendingLock, claimDir / kWorkerLock, ec);
+    }
+    if (!locked || ec) {
+        std::cerr << "Error: could not set up " << claimDir.string() << "\n";
+        return 1;
+    }
+    // A restarted container can reuse the name of a dead worker; its claims
+    // go back to the queue like those of any other dead worker
+    std::error_code ignored;
+    for (const fs::path& job : queuedJobs(claimDir)) {
+        fs::rename(job, queue / job.filename(), ignored);
+        std::cout << "Requeued " << job.filename().string() << " from an earlier worker named " << worker << "\n";
+    }
+    recoverStaleClaims(queue, claimDir);
+
+    int failures = 0;
+    fs::path job;
+    while (claimNextJob(queue, claimDir, job)) {
+        const std::string name = job.filename().string();
+        std::error_code moveError;
+
+        // Finished before a crash that kept it from being moved
+        if (completedJobs(queue / kJournal).count(name)) {
+            fs::rename(job, queue / "done" / name, moveError);
+            continue;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        int code;
+        {
+            ConsoleRedirect log(queue / "logs" / (job.stem().string() + ".log"));
+            code = runJob(job.string());
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        const char* status = (code == 0) ? "done" : (code == 2) ? "partial" : "failed";
+
+        std::ostringstream line;
+        line << timestamp() << " " << worker << " " << name << " " << status << " " << seconds << "\n";
+        if (!appendJournal(queue / kJournal, line.str())) {
+            std::cerr << "Error: could not append to " << (queue / kJournal).string() << "\n";
+        }
+        std::cout << "[" << worker << "] " << name << ": " << status << " (" << seconds << " s)\n";
+
+        if (code == 2 && markForResume(job)) {
+            fs::rename(job, queue / name, moveError);
+        }
+        else {
+            failures += (code == 0) ? 0 : 1;
+            fs::rename(job, queue / ((code == 0) ? "done" : "failed") / name, moveError);
+        }
+        if (moveError) {
+            std::cerr << "Error: could not move " << job.string() << ": " << moveError.message() << "\n";
+        }
+    }
+
+    lock.release();
+    fs::remove_all(claimDir, ec);
+    return (failures > 0) ? 1 : 0;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <functional>
+#include <string>
+
+// Parameter sweeps over a shared queue directory
+// (Peridynamic --sweep <queue dir> [workers]).
+//
+// The queue is a directory of job files. A worker process claims a job by
+// renaming it into its own directory running/<host>-<pid>/. The rename is
+// atomic on one filesystem, so exactly one worker wins even with several
+// nodes sharing the directory. Each finished job is appended to journal.txt
+// under an exclusive file lock and then moved to done/ (or failed/). Its
+// console output goes to logs/<job>.log.
+//
+// A job that stops at its time_budget gets `resume = 1` appended and goes
+// back into the queue. Every worker holds a lock file in its claim directory
+// for as long as it lives. When a worker starts, it returns the claims of
+// directories whose lock is free (their worker died) to the queue. Jobs the
+// journal already lists as done are moved to done/ without running again. So
+// restarting a killed sweep continues where it stopped.
+
+// Runs one job file; returns the batch-mode exit code (0 done, 1 failed,
+// 2 stopped by the time budget)
+using SweepJobRunner = std::function<int(const std::string& jobFile)>;
+
+// Starts `workers` worker processes of this executable (`self`) on the
+// queue and waits for them. Returns 0 if no job failed.
+int runSweep(const std::string& queueDir, int workers, const char* self);
+
+// Worker loop: claims and runs jobs until the queue is empty
+int runSweepWorker(const std::string& queueDir, const SweepJobRunner& runJob);
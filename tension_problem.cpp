@@ -0,0 +1,350 @@
+#include "tension_problem.h"
+
+#include "parallel.h"
+#include "reduction.h"
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+
+namespace {
+
+const double kSolverTolerance = 1e-6;   // residual relative to the force of the applied strain
+const int kMaxSolverIterations = 20000;
+const long long kVectorGrain = 16384;
+const int kMaxRefinements = 50;         // mixed precision: double-residual corrections per solve
+const double kInnerReduction = 1e-4;    // mixed precision: residual reduction of each float solve
+
+}  // namespace
+
+bool TensionProblem::setUp(const BondStencil& stencil, const CouplingZone* coupling, bool surfaceCorrection,
+                           const BondStorageOptions& storage) {
+    if (table.width > 255) {
+        std::cerr << "Error: the bond solver supports horizons of at most " << 127 / subdivision << " dx\n";
+        return false;
+    }
+
+    // Uniaxial stiffness of the full stencil and of its nearest-neighbor
+    // part; their ratio stiffens the far field of coupled runs to match
+    intactDiagonal = 0.0;
+    double fullModulus = 0.0;
+    double nearestModulus = 0.0;
+    for (const StencilOffset& o : stencil.full) {
+        double xx = table.xx[table.index(subdivision * o.di, subdivision * o.dj)];
+        intactDiagonal += xx;
+        fullModulus += xx * o.di * o.di;
+        if (CouplingZone::nearestNeighbor(o.di, o.dj)) {
+            nearestModulus += xx * o.di * o.di;
+        }
+    }
+    const double nearestScale = fullModulus / nearestModulus;
+
+    // Blending factor of a bond in coupled runs (0 where it does not exist)
+    SurfaceCorrection::BondWeight blend;
+    if (coupling != nullptr) {
+        blend = [coupling, nearestScale](int i, int j, int di, int dj) {
+            if (!coupling->hasBond(i, j, di, dj)) {
+                return 0.0;
+            }
+            double beta = coupling->weight(i + 0.5 * di, j + 0.5 * dj);
+            return CouplingZone::nearestNeighbor(di, dj) ? beta + (1.0 - beta) * nearestScale : beta;
+        };
+    }
+    std::unique_ptr<SurfaceCorrection> correction;
+    if (surfaceCorrection) {
+        correction = std::make_unique<SurfaceCorrection>(Nx, Ny, stencil, blend);
+    }
+    if (!indexBonds(blend, correction.get(), storage)) {
+        return false;
+    }
+
+    // Grips: the outer `reach` columns of dx (Nx counts lattice points)
+    const long long N = graph.particles();
+    const int gripWidth = subdivision * reach;
+    const double length = specimenLength();
+    const double height = static_cast<double>(Ny - 1) / subdivision;
+    freeDof.assign(2 * N, 1);
+    for (long long id = 0; id < N; ++id) {
+        int i = static_cast<int>(graph.gridId(id) % Nx);
+        double x = gridX(id);
+        double y = gridY(id);
+        switch (load) {
+        case LoadCase::Tension:
+            if (i < gripWidth) {
+                freeDof[2 * id] = 0;
+                freeDof[2 * id + 1] = 0;
+            }
+            else if (i >= Nx - 1 - gripWidth + subdivision) {
+                freeDof[2 * id] = 0;
+            }
+            break;
+        case LoadCase::Impact:
+            if (i < gripWidth && y >= 0.375 * height && y <= 0.625 * height) {
+                freeDof[2 * id] = 0;
+            }
+            break;
+        case LoadCase::Bend:
+            if (y == 0.0 && x <= reach) {
+                freeDof[2 * id] = 0;
+                freeDof[2 * id + 1] = 0;
+            }
+            else if ((y == 0.0 && x >= length - reach) || (y == height && std::abs(x - 0.5 * length) <= reach)) {
+                freeDof[2 * id + 1] = 0;
+            }
+            break;
+        }
+    }
+    regularization = 1e-8 * intactDiagonal;
+    return true;
+}
+
+void TensionProblem::homogeneousField(double strain, std::vector<double>& u) const {
+    const long long N = graph.particles();
+    u.assign(2 * N, 0.0);
+    for (long long id = 0; id < N; ++id) {
+        u[2 * id] = strain * gridX(id);
+    }
+}
+
+void TensionProblem::loadField(double value, std::vector<double>& u) const {
+    if (load == LoadCase::Tension) {
+        homogeneousField(value, u);
+        return;
+    }
+    u.assign(dofs(), 0.0);
+    prescribe(value, u);
+}
+
+void TensionProblem::prescribe(double value, std::vector<double>& u) const {
+    const long long N = graph.particles();
+    const double length = specimenLength();
+    const double height = static_cast<double>(Ny - 1) / subdivision;
+    for (long long id = 0; id < N; ++id) {
+        if (load == LoadCase::Tension) {
+            if (!freeDof[2 * id]) {
+                u[2 * id] = value * gridX(id);
+            }
+            if (!freeDof[2 * id + 1]) {
+                u[2 * id + 1] = 0.0;
+            }
+            continue;
+        }
+        // Impactor and load point move by value * W; supports stay put
+        if (!freeDof[2 * id]) {
+            u[2 * id] = (load == LoadCase::Impact) ? value * length : 0.0;
+        }
+        if (!freeDof[2 * id + 1]) {
+            u[2 * id + 1] = (gridY(id) == height) ? -value * length : 0.0;
+        }
+    }
+}
+
+bool parseLoadCase(const std::string& name, LoadCase& load) {
+    if (name == "tension") {
+        load = LoadCase::Tension;
+        return true;
+    }
+    if (name == "impact") {
+        load = LoadCase::Impact;
+        return true;
+    }
+    if (name == "bend") {
+        load = LoadCase::Bend;
+        return true;
+    }
+    return false;
+}
+
+const char* loadCaseName(LoadCase load) {
+    switch (load) {
+    case LoadCase::Impact:
+        return "impact";
+    case LoadCase::Bend:
+        return "bend";
+    default:
+        return "tension";
+    }
+}
+
+// Caches the offset (and stiffness factor) of every bond so the solver loops
+// need no divisions
+bool TensionProblem::indexBonds(const SurfaceCorrection::BondWeight& blend, const SurfaceCorrection* correction,
+                                const BondStorageOptions& storage) {
+    const std::string directory = storage.mapped ? storage.directory : std::string();
+    scaled = blend || correction != nullptr || materialWeight;
+    if (!bondOffset.allocate(graph.bonds(), directory) ||
+        (scaled && !bondScale.allocate(graph.bonds(), directory))) {
+        return false;
+    }
+    graph.forEachBlock([&](long long first, long long last) {
+        for (long long id = first; id < last; ++id) {
+            long long cell = graph.gridId(id);
+            int i = static_cast<int>(cell % Nx);
+            int j = static_cast<int>(cell / Nx);
+            graph.forEachBond(id, [&](long long b, long long nid) {
+                long long neighborCell = graph.gridId(nid);
+                int di = static_cast<int>(neighborCell % Nx) - i;
+                int dj = static_cast<int>(neighborCell / Nx) - j;
+                bondOffset[b] = static_cast<uint16_t>(table.index(di, dj));
+                if (scaled) {
+                    double w = blend ? blend(i, j, di, dj) : 1.0;
+                    if (correction != nullptr) {
+                        w *= correction->bond(i, j, di, dj);
+                    }
+                    if (materialWeight) {
+                        w *= materialWeight(i, j, di, dj);
+                    }
+                    bondScale[b] = static_cast<float>(w);
+                }
+            });
+        }
+    });
+    return true;
+}
+
+void TensionProblem::applyNarrow(const std::vector<double>& p, std::vector<double>& q) const {
+    narrowDirection.resize(p.size());
+    parallelFor(dofs(), kVectorGrain, [&](long long i0, long long i1) {
+        for (long long i = i0; i < i1; ++i) {
+            narrowDirection[i] = static_cast<float>(p[i]);
+        }
+    });
+    applyKernel(narrowTable, narrowDirection.data(), q, 0.0);
+}
+
+void TensionProblem::inverseDiagonal(std::vector<double>& invDiag) const {
+    graph.forEachBlock([&](long long first, long long last) {
+        for (long long id = first; id < last; ++id) {
+            double dx = regularization * massOf(id);
+            double dy = dx;
+            for (long long b = graph.offsets[id]; b < graph.offsets[id + 1]; ++b) {
+                if (!graph.broken[b]) {
+                    size_t k = bondOffset[b];
+                    dx += scale(b) * table.xx[k];
+                    dy += scale(b) * table.yy[k];
+                }
+            }
+            invDiag[2 * id] = freeDof[2 * id] ? 1.0 / dx : 0.0;
+            invDiag[2 * id + 1] = freeDof[2 * id + 1] ? 1.0 / dy : 0.0;
+        }
+    });
+}
+
+double TensionProblem::dot(const std::vector<double>& a, const std::vector<double>& b) const {
+    return deterministicSum(dofs(), [&](long long i) { return a[i] * b[i]; });
+}
+
+void TensionProblem::residual(const std::vector<double>& u, std::vector<double>& r) const {
+    apply(u, r);
+    parallelFor(dofs(), kVectorGrain, [&](long long i0, long long i1) {
+        for (long long i = i0; i < i1; ++i) {
+            r[i] = -r[i];
+        }
+    });
+}
+
+// Preconditioned conjugate gradients on x, where r is the residual of x on
+// entry, until |r| <= limit; returns the iteration count, or -1 without
+// convergence
+template <typename Apply>
+int TensionProblem::conjugateGradients(std::vector<double>& x, std::vector<double>& r,
+                                       const std::vector<double>& invDiag, double limit, int maxIterations,
+                                       const Apply& applyK) const {
+    const long long n = dofs();
+    std::vector<double> z(n), p(n), q(n);
+    parallelFor(n, kVectorGrain, [&](long long i0, long long i1) {
+        for (long long i = i0; i < i1; ++i) {
+            z[i] = invDiag[i] * r[i];
+            p[i] = z[i];
+        }
+    });
+    double rz = dot(r, z);
+    for (int it = 0; it < maxIterations; ++it) {
+        if (std::sqrt(dot(r, r)) <= limit) {
+            return it;
+        }
+        applyK(p, q);
+        double pq = dot(p, q);
+        if (pq <= 0.0) {
+            return it;
+        }
+        double alpha = rz / pq;
+        parallelFor(n, kVectorGrain, [&](long long i0, long long i1) {
+            for (long long i = i0; i < i1; ++i) {
+                x[i] += alpha * p[i];
+                r[i] -= alpha * q[i];
+                z[i] = invDiag[i] * r[i];
+            }
+        });
+        double rzNext = dot(r, z);
+        double beta = rzNext / rz;
+        rz = rzNext;
+        parallelFor(n, kVectorGrain, [&](long long i0, long long i1) {
+            for (long long i = i0; i < i1; ++i) {
+                p[i] = z[i] + beta * p[i];
+            }
+        });
+    }
+    return -1;
+}
+
+int TensionProblem::solve(std::vector<double>& u) const {
+    const long long n = dofs();
+    std::vector<double> r(n), invDiag(n);
+    inverseDiagonal(invDiag);
+    residual(u, r);
+    const double limit = kSolverTolerance * forceScale;
+    if (!mixed) {
+        return conjugateGradients(u, r, invDiag, limit, kMaxSolverIterations,
+            [this](const std::vector<double>& p, std::vector<double>& q) { apply(p, q); });
+    }
+
+    // Float solves for the correction d of K d = r; u += d; repeat
+    std::vector<double> d(n);
+    int iterations = 0;
+    for (int refinement = 0; refinement < kMaxRefinements; ++refinement) {
+        double norm = std::sqrt(dot(r, r));
+        if (norm <= limit) {
+            return iterations;
+        }
+        std::fill(d.begin(), d.end(), 0.0);
+        int it = conjugateGradients(d, r, invDiag, std::max(limit, kInnerReduction * norm),
+            kMaxSolverIterations - iterations,
+            [this](const std::vector<double>& p, std::vector<double>& q) { applyNarrow(p, q); });
+        if (it < 0) {
+            return -1;
+        }
+        iterations += it;
+        parallelFor(n, kVectorGrain, [&](long long i0, long long i1) {
+            for (long long i = i0; i < i1; ++i) {
+                u[i] += d[i];
+            }
+        });
+        residual(u, r);
+    }
+    return -1;
+}
+
+template <typename Real>
+double TensionProblem::energy(const OffsetTable<Real>& t, const std::vector<double>& u) const {
+    std::vector<double> perParticle(graph.particles(), 0.0);
+    graph.forEachBlock([&](long long first, long long last) {
+        for (long long id = first; id < last; ++id) {
+            double e = 0.0;
+            graph.forEachBond(id, [&](long long b, long long nid) {
+                if (graph.broken[b]) {
+                    return;
+                }
+                size_t k = bondOffset[b];
+                Real dx = static_cast<Real>(u[2 * nid] - u[2 * id]);
+                Real dy = static_cast<Real>(u[2 * nid + 1] - u[2 * id + 1]);
+                e += static_cast<Real>(scale(b)) * (t.xx[k] * dx * dx + Real(2) * t.xy[k] * dx * dy + t.yy[k] * dy * dy);
+            });
+            perParticle[id] = 0.25 * e;
+        }
+    });
+    return deterministicSum(perParticle);
+}
+
+template double TensionProblem::energy(const OffsetTable<float>&, const std::vector<double>&) const;
+template double TensionProblem::energy(const OffsetTable<double>&, const std::vector<double>&) const;
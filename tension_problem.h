@@ -0,0 +1,245 @@
+#pragma once
+
+#include "bond_graph.h"
+#include "coupling.h"
+#include "lattice.h"
+#include "surface_correction.h"
+
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Linearized bond-based tension test on the stored bond graph, shared by the
+// fatigue solver and implicit dynamics.
+//
+// The specimen is pulled in x between two grips: the left `reach` columns
+// are clamped, the right ones are pulled to u_x = strain * x and may
+// contract in y. Displacements are interleaved (u_x, u_y) per particle and
+// always held in double. The stiffness K is applied matrix-free over the
+// intact bonds of the graph.
+//
+// Dynamics can load the specimen in two other ways (see LoadCase); there
+// the load parameter is a displacement in units of the specimen length W
+// (in dx).
+//
+// Mixed precision evaluates the bond terms in float and sums them per
+// particle in double. The solver then runs its conjugate gradient
+// iterations on float copies of the search direction and corrects the
+// displacements against a residual recomputed in double (iterative
+// refinement), so the converged field meets the same tolerance.
+
+// Linearized bond stiffness of each lattice offset (in units of dx):
+// a bond with direction e and length L contributes (e e^T) / L to the
+// stiffness, and its stretch is e . (u_j - u_i) / L. Real is float for
+// the mixed-precision kernels. Offsets count index lattice points, of which
+// there are `subdivision` per dx (see refinement.h).
+template <typename Real>
+struct OffsetTable {
+    int reach = 0;
+    int width = 0;
+    std::vector<Real> xx, xy, yy;   // e_x e_x / L, e_x e_y / L, e_y e_y / L
+    std::vector<Real> sx, sy;       // e_x / L, e_y / L
+
+    explicit OffsetTable(int r, int subdivision = 1) : reach(r), width(2 * r + 1) {
+        const size_t n = static_cast<size_t>(width) * width;
+        xx.assign(n, Real(0));
+        xy.assign(n, Real(0));
+        yy.assign(n, Real(0));
+        sx.assign(n, Real(0));
+        sy.assign(n, Real(0));
+        for (int dj = -r; dj <= r; ++dj) {
+            for (int di = -r; di <= r; ++di) {
+                double ex = static_cast<double>(di) / subdivision;
+                double ey = static_cast<double>(dj) / subdivision;
+                double L2 = ex * ex + ey * ey;
+                if (L2 == 0.0) {
+                    continue;
+                }
+                double L3 = L2 * std::sqrt(L2);
+                size_t k = index(di, dj);
+                xx[k] = static_cast<Real>(ex * ex / L3);
+                xy[k] = static_cast<Real>(ex * ey / L3);
+                yy[k] = static_cast<Real>(ey * ey / L3);
+                sx[k] = static_cast<Real>(ex / L2);
+                sy[k] = static_cast<Real>(ey / L2);
+            }
+        }
+    }
+
+    size_t index(int di, int dj) const {
+        return static_cast<size_t>(dj + reach) * width + (di + reach);
+    }
+};
+
+// Boundary conditions of the specimen (dynamics_load)
+enum class LoadCase {
+    Tension,  // grips as above: u_x = load * x on both
+    Impact,   // an impactor pushes the middle quarter (3/8 to 5/8 of the height)
+              // of the left `reach` columns to u_x = load * W; everything else
+              // is free (Kalthoff-Winkler)
+    Bend      // three-point bending: the bottom row within `reach` of either end
+              // rests on supports (u_y = 0, the left one pinned in x as well),
+              // and the top row within `reach` of the middle is pushed to
+              // u_y = -load * W
+};
+
+bool parseLoadCase(const std::string& name, LoadCase& load);
+const char* loadCaseName(LoadCase load);
+
+struct TensionProblem {
+    const BondGraph& graph;
+    int Nx = 0;                     // lattice the grid ids of graph refer to
+    int Ny = 0;
+    int reach = 0;                  // horizon and grip width in dx
+    int subdivision = 1;            // lattice points per dx (refined runs: see refinement.h)
+    bool mixed = false;
+    OffsetTable<double> table;
+    OffsetTable<float> narrowTable;
+    std::vector<uint8_t> freeDof;   // 0 = prescribed by a grip
+    double intactDiagonal = 0.0;    // diagonal stiffness of an intact particle
+    double regularization = 0.0;    // diagonal shift (times the mass): keeps detached particles from making K singular
+    double forceScale = 0.0;        // residual scale of the applied strain
+    MappedArray<uint16_t> bondOffset;  // table index of every directed bond
+    MappedArray<float> bondScale;      // stiffness factor of every bond (blending, surface correction)
+    bool scaled = false;
+    std::vector<double> mass;          // per particle (empty = unit masses)
+    SurfaceCorrection::BondWeight materialWeight;  // extra stiffness factor of a bond (empty = 1)
+    LoadCase load = LoadCase::Tension;
+
+    mutable std::vector<float> narrowDirection;  // float copy of the vector applied by applyNarrow
+
+    TensionProblem(const BondGraph& g, int nx, int ny, int r, bool mixedPrecision, int s = 1)
+        : graph(g), Nx(nx), Ny(ny), reach(r), subdivision(s), mixed(mixedPrecision), table(r * s, s),
+          narrowTable(mixedPrecision ? r * s : 0, s) {}
+
+    // Indexes the bonds (and their stiffness factors: blending in coupled
+    // runs, surface correction if requested), marks the prescribed degrees
+    // of freedom of the load case and sets the regularization. Prints an error and returns false
+    // on failure.
+    bool setUp(const BondStencil& stencil, const CouplingZone* coupling, bool surfaceCorrection,
+               const BondStorageOptions& storage);
+
+    // x and y of a particle in dx
+    double gridX(long long id) const {
+        return static_cast<double>(graph.gridId(id) % Nx) / subdivision;
+    }
+    double gridY(long long id) const {
+        return static_cast<double>(graph.gridId(id) / Nx) / subdivision;
+    }
+
+    // Specimen length W in dx
+    double specimenLength() const {
+        return static_cast<double>(Nx - 1) / subdivision;
+    }
+
+    // u_x = strain * x, u_y = 0 everywhere (grips included)
+    void homogeneousField(double strain, std::vector<double>& u) const;
+
+    // Displacement field of the load parameter value: the homogeneous field
+    // under tension, else the prescribed values with the free degrees of
+    // freedom at 0
+    void loadField(double value, std::vector<double>& u) const;
+
+    // Sets the prescribed degrees of freedom of u to their values under the
+    // load parameter value
+    void prescribe(double value, std::vector<double>& u) const;
+
+    long long dofs() const { return 2 * graph.particles(); }
+
+    double scale(long long b) const {
+        return scaled ? bondScale[b] : 1.0;
+    }
+
+    double massOf(long long id) const {
+        return mass.empty() ? 1.0 : mass[id];
+    }
+
+    // q = K p + regularization * M p on the free degrees of freedom (0 on
+    // prescribed ones), with the bond terms in Real and the per-particle sums
+    // in double. Bonds stretched beyond failureStretch (if positive) by p
+    // carry no force.
+    template <typename Real>
+    void applyKernel(const OffsetTable<Real>& t, const Real* p, std::vector<double>& q, double failureStretch) const {
+        const Real limit = static_cast<Real>(failureStretch);
+        const double* m = mass.empty() ? nullptr : mass.data();
+        graph.forEachBlock([&](long long first, long long last) {
+            for (long long id = first; id < last; ++id) {
+                Real px = p[2 * id];
+                Real py = p[2 * id + 1];
+                double shift = m ? regularization * m[id] : regularization;
+                double qx = shift * px;
+                double qy = shift * py;
+                graph.forEachBond(id, [&](long long b, long long nid) {
+                    if (graph.broken[b]) {
+                        return;
+                    }
+                    size_t k = bondOffset[b];
+                    Real dx = px - p[2 * nid];
+                    Real dy = py - p[2 * nid + 1];
+                    if (limit > Real(0) && -(t.sx[k] * dx + t.sy[k] * dy) > limit) {
+                        return;
+                    }
+                    Real w = static_cast<Real>(scale(b));
+                    dx *= w;
+                    dy *= w;
+                    qx += t.xx[k] * dx + t.xy[k] * dy;
+                    qy += t.xy[k] * dx + t.yy[k] * dy;
+                });
+                q[2 * id] = freeDof[2 * id] ? qx : 0.0;
+                q[2 * id + 1] = freeDof[2 * id + 1] ? qy : 0.0;
+            }
+        });
+    }
+
+    void apply(const std::vector<double>& p, std::vector<double>& q, double failureStretch = 0.0) const {
+        applyKernel(table, p.data(), q, failureStretch);
+    }
+
+    // q = K p from a float copy of p
+    void applyNarrow(const std::vector<double>& p, std::vector<double>& q) const;
+
+    // Inverse Jacobi preconditioner of the current (damaged) stiffness
+    // including the diagonal shift
+    void inverseDiagonal(std::vector<double>& invDiag) const;
+
+    double dot(const std::vector<double>& a, const std::vector<double>& b) const;
+
+    // r = -K u, the residual of u (the grips carry the load)
+    void residual(const std::vector<double>& u, std::vector<double>& r) const;
+
+    // Solves K u = 0 for the free degrees of freedom from the current u
+    // (warm start); returns the iteration count, or -1 without convergence
+    int solve(std::vector<double>& u) const;
+
+    // Stretch of bond b between particles id and nid. The displacement
+    // difference is taken in double (u holds the whole applied field), the
+    // rest in Real.
+    template <typename Real>
+    Real stretch(const OffsetTable<Real>& t, const std::vector<double>& u, long long id, long long nid,
+                 long long b) const {
+        size_t k = bondOffset[b];
+        return t.sx[k] * static_cast<Real>(u[2 * nid] - u[2 * id]) +
+               t.sy[k] * static_cast<Real>(u[2 * nid + 1] - u[2 * id + 1]);
+    }
+
+    double stretch(const std::vector<double>& u, long long id, long long nid, long long b) const {
+        return mixed ? stretch(narrowTable, u, id, nid, b) : stretch(table, u, id, nid, b);
+    }
+
+    // Elastic energy of the intact bonds (each stored twice, hence 1/4)
+    template <typename Real>
+    double energy(const OffsetTable<Real>& t, const std::vector<double>& u) const;
+
+    double energy(const std::vector<double>& u) const {
+        return mixed ? energy(narrowTable, u) : energy(table, u);
+    }
+
+private:
+    bool indexBonds(const SurfaceCorrection::BondWeight& blend, const SurfaceCorrection* correction,
+                    const BondStorageOptions& storage);
+
+    template <typename Apply>
+    int conjugateGradients(std::vector<double>& x, std::vector<double>& r, const std::vector<double>& invDiag,
+                           double limit, int maxIterations, const Apply& applyK) const;
+};
@@ -0,0 +1,210 @@
+#include "vtk_output.h"
+
+#include "async_writer.h"
+#include "metrics.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <limits>
+
+namespace {
+
+// Items formatted per parallel task
+const long long kFormatBlock = 65536;
+
+// Destination of the formatted text
+struct VtkSink {
+    std::ofstream* stream = nullptr;
+    AsyncFileWriter* async = nullptr;
+
+    bool write(const std::string& text) {
+        metricsCountBytesWritten(text.size());
+        if (async != nullptr) {
+            return async->append(text.data(), text.size());
+        }
+        stream->write(text.data(), static_cast<std::streamsize>(text.size()));
+        return static_cast<bool>(*stream);
+    }
+};
+
+// Same text as operator<< with std::fixed and setprecision(6)
+char* appendFixed(char* p, double v) {
+    return std::to_chars(p, p + 400, v, std::chars_format::fixed, 6).ptr;
+}
+
+char* appendInt(char* p, long long v) {
+    return std::to_chars(p, p + 24, v).ptr;
+}
+
+// Upper bound on the length of appendFixed() for finite values up to maxAbs
+// (inf and nan print shorter than any finite value)
+size_t fixedWidth(double maxAbs) {
+    if (!std::isfinite(maxAbs)) {
+        maxAbs = std::numeric_limits<double>::max();
+    }
+    double digits = (maxAbs >= 1.0) ? std::floor(std::log10(maxAbs)) + 1.0 : 1.0;
+    return static_cast<size_t>(digits) + 9;  // sign, point, 6 decimals, slack
+}
+
+// Format count items in parallel blocks and emit them in order.
+// format(i, p) writes item i at p (at most maxItemBytes) and returns the end.
+template <typename Format>
+bool emitFormatted(VtkSink& sink, long long count, size_t maxItemBytes, Format&& format) {
+    const long long batch = 2LL * workerThreads();
+    std::vector<std::string> texts(batch);
+    for (long long first = 0; first < count; first += batch * kFormatBlock) {
+        long long blocks = std::min(batch, (count - first + kFormatBlock - 1) / kFormatBlock);
+        parallelFor(blocks, 1, [&](long long b0, long long b1) {
+            for (long long b = b0; b < b1; ++b) {
+                long long begin = first + b * kFormatBlock;
+                long long end = std::min(count, begin + kFormatBlock);
+                std::string& text = texts[b];
+                text.resize(static_cast<size_t>(end - begin) * maxItemBytes);
+                char* p = text.data();
+                for (long long i = begin; i < end; ++i) {
+                    p = format(i, p);
+                }
+                text.resize(p - text.data());
+            }
+        });
+        for (long long b = 0; b < blocks; ++b) {
+            if (!sink.write(texts[b])) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+}  // namespace
+
+bool parseOutputBackend(const std::string& name, OutputBackend& backend) {
+    if (name == "stream") {
+        backend = OutputBackend::Stream;
+        return true;
+    }
+    if (name == "async") {
+        backend = OutputBackend::Async;
+        return true;
+    }
+    if (name == "pwrite") {
+        backend = OutputBackend::Pwrite;
+        return true;
+    }
+    return false;
+}
+
+bool writeVtkFile(const std::string& path, const std::vector<Particle>& particles,
+                  const std::vector<VtkField>& fields, const OutputOptions& options,
+                  OutputStats& stats) {
+    const long long N = static_cast<long long>(particles.size());
+    auto start = std::chrono::steady_clock::now();
+
+    // Worst-case line lengths, also used to preallocate the file
+    double maxCoord = 0.0;
+    for (const Particle& p : particles) {
+        maxCoord = std::max(maxCoord, std::max(std::fabs(p.x), std::fabs(p.y)));
+    }
+    size_t pointBytes = 2 * fixedWidth(maxCoord) + fixedWidth(0.0) + 3;
+    size_t vertexBytes = 24 + 3;
+    std::vector<size_t> fieldBytes;
+    unsigned long long expected = 4096 + N * (pointBytes + vertexBytes);
+    for (const VtkField& f : fields) {
+        double maxAbs = 0.0;
+        for (double v : *f.values) {
+            if (std::isfinite(v)) {
+                maxAbs = std::max(maxAbs, std::fabs(v));
+            }
+        }
+        fieldBytes.push_back(fixedWidth(maxAbs) + 1);
+        expected += N * fieldBytes.back() + 64;
+    }
+
+    std::ofstream stream;
+    AsyncFileWriter async;
+    VtkSink sink;
+    if (options.backend == OutputBackend::Stream) {
+        stream.open(path);
+        if (!stream) {
+            std::cerr << "Error: could not open " << path << " for writing.\n";
+            return false;
+        }
+        sink.stream = &stream;
+    }
+    else {
+        AsyncWriterOptions asyncOptions;
+        asyncOptions.buffers = options.buffers;
+        asyncOptions.bufferBytes = static_cast<size_t>(std::max(1, options.bufferMegabytes)) << 20;
+        asyncOptions.direct = options.direct;
+        asyncOptions.allowUring = (options.backend == OutputBackend::Async);
+        if (!async.open(path, expected, asyncOptions)) {
+            return false;
+        }
+        sink.async = &async;
+    }
+
+    std::string header = "# vtk DataFile Version 3.0\n"
+                         "Peridynamic porous pre-damage\n"
+                         "ASCII\n"
+                         "DATASET POLYDATA\n";
+
+    // Write points (z = 0 for 2D surface)
+    header += "POINTS " + std::to_string(N) + " float\n";
+    bool ok = sink.write(header);
+    ok = ok && emitFormatted(sink, N, pointBytes, [&](long long i, char* p) {
+        p = appendFixed(p, particles[i].x);
+        *p++ = ' ';
+        p = appendFixed(p, particles[i].y);
+        *p++ = ' ';
+        p = appendFixed(p, 0.0);
+        *p++ = '\n';
+        return p;
+    });
+
+    // Each point as a separate vertex cell
+    ok = ok && sink.write("VERTICES " + std::to_string(N) + " " + std::to_string(2 * N) + "\n");
+    ok = ok && emitFormatted(sink, N, vertexBytes, [&](long long i, char* p) {
+        *p++ = '1';
+        *p++ = ' ';
+        p = appendInt(p, i);
+        *p++ = '\n';
+        return p;
+    });
+
+    // Point data
+    ok = ok && sink.write("POINT_DATA " + std::to_string(N) + "\n");
+    for (size_t f = 0; f < fields.size(); ++f) {
+        const std::vector<double>& values = *fields[f].values;
+        ok = ok && sink.write(std::string("SCALARS ") + fields[f].name + " float 1\nLOOKUP_TABLE default\n");
+        ok = ok && emitFormatted(sink, N, fieldBytes[f], [&](long long i, char* p) {
+            p = appendFixed(p, values[i]);
+            *p++ = '\n';
+            return p;
+        });
+    }
+
+    if (sink.async != nullptr) {
+        ok = async.close() && ok;
+        stats.backend = async.backendName();
+        stats.direct = async.directIo();
+        stats.bytes = async.bytesWritten();
+    }
+    else {
+        stats.bytes = static_cast<unsigned long long>(stream.tellp());
+        stream.close();
+        ok = ok && !stream.fail();
+        stats.backend = "ofstream";
+    }
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    stats.megabytesPerSecond = (stats.seconds > 0.0) ? stats.bytes / (1024.0 * 1024.0) / stats.seconds : 0.0;
+
+    if (!ok) {
+        std::cerr << "Error: writing " << path << " failed.\n";
+    }
+    return ok;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "particle.h"
+
+#include <string>
+#include <vector>
+
+// How step 6 writes the VTK file
+enum class OutputBackend {
+    Stream,  // buffered std::ofstream
+    Async,   // io_uring (Linux) with aligned O_DIRECT buffers, else pwrite threads
+    Pwrite   // pwrite thread pool only
+};
+
+bool parseOutputBackend(const std::string& name, OutputBackend& backend);
+
+struct OutputOptions {
+    OutputBackend backend = OutputBackend::Stream;
+    int buffers = 4;           // async: buffers in flight
+    int bufferMegabytes = 4;   // async: size of each buffer
+    bool direct = true;        // async: try O_DIRECT
+};
+
+// One per-point scalar field
+struct VtkField {
+    const char* name;
+    const std::vector<double>* values;
+};
+
+struct OutputStats {
+    std::string backend;
+    bool direct = false;
+    unsigned long long bytes = 0;
+    double seconds = 0.0;
+    double megabytesPerSecond = 0.0;
+};
+
+// Write particles and point fields as ASCII VTK POLYDATA (one vertex per
+// particle). Text is formatted in parallel blocks; with the async backends
+// formatting of the next blocks overlaps with writing the previous ones.
+bool writeVtkFile(const std::string& path, const std::vector<Particle>& particles,
+                  const std::vector<VtkField>& fields, const OutputOptions& options,
+                  OutputStats& stats);
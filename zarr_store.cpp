@@ -0,0 +1,152 @@
+#include "zarr_store.h"
+
+#include "lz4_codec.h"
+#include "metrics.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace {
+
+bool writeTextFile(const std::filesystem::path& path, const std::string& text) {
+    std::ofstream out(path, std::ios::binary);
+    out << text;
+    return static_cast<bool>(out);
+}
+
+bool writeBinaryFile(const std::filesystem::path& path, const std::vector<uint8_t>& bytes) {
+    std::ofstream out(path, std::ios::binary);
+    out.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+    return static_cast<bool>(out);
+}
+
+// Zarr v2 array metadata: shuffle filter + numcodecs lz4 compressor
+std::string arrayMetadata(int Nx, int Ny, int chunk, const char* dtype) {
+    std::ostringstream json;
+    json << "{\n"
+         << "    \"zarr_format\": 2,\n"
+         << "    \"shape\": [" << Ny << ", " << Nx << "],\n"
+         << "    \"chunks\": [" << chunk << ", " << chunk << "],\n"
+         << "    \"dtype\": \"" << dtype << "\",\n"
+         << "    \"order\": \"C\",\n"
+         << "    \"fill_value\": 0,\n"
+         << "    \"filters\": [{\"id\": \"shuffle\", \"elementsize\": 4}],\n"
+         << "    \"compressor\": {\"id\": \"lz4\", \"acceleration\": 1},\n"
+         << "    \"dimension_separator\": \".\"\n"
+         << "}\n";
+    return json.str();
+}
+
+// Little-endian 4-byte element of the field at id
+inline void storeElement(const ZarrField& field, long long id, uint8_t* dst) {
+    uint32_t bits;
+    if (field.real != nullptr) {
+        float v = static_cast<float>((*field.real)[id]);
+        std::memcpy(&bits, &v, 4);
+    }
+    else {
+        int32_t v = (*field.integer)[id];
+        std::memcpy(&bits, &v, 4);
+    }
+    for (int b = 0; b < 4; ++b) {
+        dst[b] = static_cast<uint8_t>(bits >> (8 * b));
+    }
+}
+
+}  // namespace
+
+std::string zarrStoreName(const std::string& vtkName) {
+    std::filesystem::path p(vtkName);
+    p.replace_extension(".zarr");
+    return p.string();
+}
+
+bool writeZarrStore(const std::string& dir, int Nx, int Ny, int chunk,
+                    const std::vector<ZarrField>& fields,
+                    const std::vector<std::pair<std::string, double>>& attributes,
+                    ZarrStats& stats) {
+    auto start = std::chrono::steady_clock::now();
+    namespace fs = std::filesystem;
+    chunk = std::max(1, chunk);
+
+    std::error_code ec;
+    fs::path root(dir);
+    fs::create_directories(root, ec);
+    if (ec) {
+        std::cerr << "Error: could not create " << dir << ": " << ec.message() << "\n";
+        return false;
+    }
+
+    std::ostringstream attrs;
+    attrs.precision(17);
+    attrs << "{";
+    for (size_t a = 0; a < attributes.size(); ++a) {
+        attrs << (a ? ", " : "") << "\"" << attributes[a].first << "\": " << attributes[a].second;
+    }
+    attrs << "}\n";
+    bool ok = writeTextFile(root / ".zgroup", "{\"zarr_format\": 2}\n") &&
+              writeTextFile(root / ".zattrs", attrs.str());
+
+    const int chunksX = (Nx + chunk - 1) / chunk;
+    const int chunksY = (Ny + chunk - 1) / chunk;
+    const long long chunksPerField = static_cast<long long>(chunksX) * chunksY;
+    const size_t chunkElements = static_cast<size_t>(chunk) * chunk;
+
+    for (const ZarrField& field : fields) {
+        fs::path arrayDir = root / field.name;
+        fs::create_directories(arrayDir, ec);
+        ok = ok && !ec && writeTextFile(arrayDir / ".zarray",
+                                        arrayMetadata(Nx, Ny, chunk, field.real ? "<f4" : "<i4"));
+        if (!ok) {
+            std::cerr << "Error: could not write Zarr array " << field.name << "\n";
+            return false;
+        }
+
+        std::vector<unsigned long long> stored(chunksPerField, 0);
+        std::vector<char> chunkOk(chunksPerField, 1);
+        parallelFor(chunksPerField, 1, [&](long long c0, long long c1) {
+            std::vector<uint8_t> raw(chunkElements * 4), shuffled(chunkElements * 4), encoded;
+            for (long long c = c0; c < c1; ++c) {
+                int cy = static_cast<int>(c / chunksX);
+                int cx = static_cast<int>(c % chunksX);
+                // Edge chunks are stored full size, padded with the fill value
+                std::fill(raw.begin(), raw.end(), 0);
+                int j1 = std::min(Ny, (cy + 1) * chunk);
+                int i1 = std::min(Nx, (cx + 1) * chunk);
+                for (int j = cy * chunk; j < j1; ++j) {
+                    uint8_t* row = &raw[static_cast<size_t>(j - cy * chunk) * chunk * 4];
+                    for (int i = cx * chunk; i < i1; ++i) {
+                        storeElement(field, static_cast<long long>(j) * Nx + i, row + (i - cx * chunk) * 4);
+                    }
+                }
+                byteShuffle(raw.data(), shuffled.data(), chunkElements, 4);
+                lz4Compress(shuffled.data(), shuffled.size(), encoded);
+                std::string key = std::to_string(cy) + "." + std::to_string(cx);
+                chunkOk[c] = writeBinaryFile(arrayDir / key, encoded) ? 1 : 0;
+                stored[c] = encoded.size();
+                metricsCountBytesWritten(encoded.size());
+            }
+        });
+
+        for (long long c = 0; c < chunksPerField; ++c) {
+            ok = ok && chunkOk[c];
+            stats.storedBytes += stored[c];
+        }
+        stats.chunks += chunksPerField;
+        stats.rawBytes += static_cast<unsigned long long>(Nx) * Ny * 4;
+        if (!ok) {
+            std::cerr << "Error: could not write chunks of " << field.name << "\n";
+            return false;
+        }
+    }
+
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return ok;
+}
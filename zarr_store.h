@@ -0,0 +1,36 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+// Chunked Zarr (v2) directory store for per-particle lattice fields.
+//
+// Each field becomes an array of shape [Ny, Nx] split into fixed-size square
+// chunks. Every chunk is byte-shuffled and LZ4-compressed on its own and
+// written as a separate file, so readers (zarr-python, xarray, dask) can load
+// any sub-region lazily. Chunks are encoded and written in parallel, one task
+// per chunk.
+
+struct ZarrField {
+    std::string name;
+    const std::vector<double>* real = nullptr;  // stored as little-endian float32
+    const std::vector<int>* integer = nullptr;  // stored as little-endian int32
+};
+
+struct ZarrStats {
+    long long chunks = 0;
+    unsigned long long rawBytes = 0;
+    unsigned long long storedBytes = 0;
+    double seconds = 0.0;
+};
+
+// Write the group at dir (created if needed). attributes go to the group's
+// .zattrs as numeric values.
+bool writeZarrStore(const std::string& dir, int Nx, int Ny, int chunk,
+                    const std::vector<ZarrField>& fields,
+                    const std::vector<std::pair<std::string, double>>& attributes,
+                    ZarrStats& stats);
+
+// Store name matching a VTK output name ("a/b.vtk" -> "a/b.zarr")
+std::string zarrStoreName(const std::string& vtkName);